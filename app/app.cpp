@@ -7,6 +7,7 @@
 
 #include <modbuscpp/modbus.hpp>
 
+#include <libcamera/camera.hpp>
 #include <libcloud/cloud.hpp>
 #include <libcore/core.hpp>
 #include <libdetector/detector.hpp>
@@ -24,20 +25,22 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
   }
 
   // config
-  auto*          config = Config::get();
-  server::Config server_config{config};
-  cloud::Config  cloud_config{config};
-
-  cv::VideoCapture cap{config->camera_idx(), cv::CAP_V4L2};
-  if (!cap.isOpened()) {
-    LOG_ERROR("Camera cannot be opened!");
+  auto*           config = Config::get();
+  server::Config  server_config{config};
+  storage::Config storage_config{config};
+  cloud::Config   cloud_config{config};
+
+  camera::CaptureGroup captures{config};
+  if (!captures.active()) {
+    LOG_ERROR("Capture source cannot be opened!");
     return ATM_ERR;
   }
 
   server::Slave                      slave(&server_config);
   server::DataMapper                 data_mapper(&server_config, &slave);
   std::unique_ptr<storage::Database> internal_db =
-      std::make_unique<storage::InternalDatabase>(config->images_db());
+      std::make_unique<storage::InternalDatabase>(config->images_db(),
+                                                  &storage_config);
   std::unique_ptr<storage::Database> cloud_db =
       std::make_unique<cloud::Database>(&cloud_config);
 
@@ -52,20 +55,27 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
     return ATM_ERR;
   }
 
+  storage::Encoder encoder(&storage_config);
+  storage::Spool   spool(&storage_config);
+
   gui::Manager ui_manager;
 
   // images
-  cv::Mat frame;
   cv::Mat blob;
 
   // detector::BlobDetector blob_detector;
 
   // listeners
-  storage::StorageListener storage_listener{&server_config, &data_mapper,
-                                            internal_db.get(), &frame};
+  storage::StorageListener storage_listener{
+      &server_config, &storage_config, &data_mapper, internal_db.get(),
+      &encoder, &spool, &captures};
   cloud::CloudListener     cloud_listener{
       &cloud_config, internal_db.get(),
-      dynamic_cast<cloud::Database*>(cloud_db.get()), &cloud_storage};
+      dynamic_cast<cloud::Database*>(cloud_db.get()), &cloud_storage,
+      &encoder, &spool};
+
+  // uploads start as soon as a tray is stored
+  storage_listener.bind_stored([&cloud_listener] { cloud_listener.notify(); });
 
   ui_manager.init("Emmerich Vision", 400, 400);
 
@@ -100,27 +110,31 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
   slave.run();
 
   LOG_INFO("Running listeners...");
+  captures.start();
   storage_listener.start();
   cloud_listener.start();
 
   while (ui_manager.handle_events()) {
-    if (cap.read(frame)) {
-      frame.convertTo(frame, CV_8U, 1.0, 0);
+    // capture runs on its own thread, only show the latest frame here
+    auto frame = captures.primary().frame_buffer().snapshot();
+    if (frame.empty() || !frame.decode()) {
+      sleep_for<time_units::millis>(10);  // no frame yet
+      continue;
+    }
 
-      // show
-      image_window->frame(&frame);
+    // show
+    image_window->frame(&frame.image);
 
-      // blob_detector.detect(std::move(frame), std::move(blob));
-      // blob_window->frame(&blob);
+    // blob_detector.detect(std::move(frame.image), std::move(blob));
+    // blob_window->frame(&blob);
 
-      ui_manager.render();
-    }
+    ui_manager.render();
   }
 
+  captures.stop();
   storage_listener.stop();
   cloud_listener.stop();
   slave.stop();
-  cap.release();
   ui_manager.exit();
 
   return 0;
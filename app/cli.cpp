@@ -1,12 +1,20 @@
+#include <cerrno>
+#include <csignal>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 #include <utility>
 
+#include <pthread.h>
+#include <sys/resource.h>
+
 #include <modbuscpp/modbus.hpp>
 
+#include <libcamera/camera.hpp>
 #include <libcloud/cloud.hpp>
 #include <libcore/core.hpp>
 #include <libdetector/detector.hpp>
@@ -14,29 +22,73 @@
 #include <libstorage/storage.hpp>
 #include <libutil/util.hpp>
 
+/**
+ * Interval of the resource usage report in seconds
+ */
+static constexpr std::time_t REPORT_INTERVAL = 60;
+
+/**
+ * Block termination signals
+ *
+ * Must be called before any thread is spawned so every thread inherits the
+ * mask and the signals are only consumed by the main thread
+ *
+ * @return blocked signals
+ */
+static sigset_t block_termination_signals() {
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  return signals;
+}
+
+/**
+ * Get CPU time (user and system) consumed by the process so far
+ *
+ * @return CPU time in microseconds
+ */
+static time_unit cpu_micros() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  auto to_micros = [](const timeval& value) {
+    return static_cast<time_unit>(value.tv_sec) * 1000000 +
+           static_cast<time_unit>(value.tv_usec);
+  };
+
+  return to_micros(usage.ru_utime) + to_micros(usage.ru_stime);
+}
+
 int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
   USE_NAMESPACE
 
+  // before the logger and listeners spawn their threads
+  const auto signals = block_termination_signals();
+
   if (initialize_core()) {
     std::cerr << "cannot initialize config, state, and logger!" << std::endl;
     return ATM_ERR;
   }
 
   // config
-  auto*          config = Config::get();
-  server::Config server_config{config};
-  cloud::Config  cloud_config{config};
-
-  cv::VideoCapture cap{config->camera_idx(), cv::CAP_V4L2};
-  if (!cap.isOpened()) {
-    LOG_ERROR("Camera cannot be opened!");
+  auto*           config = Config::get();
+  server::Config  server_config{config};
+  storage::Config storage_config{config};
+  cloud::Config   cloud_config{config};
+
+  camera::CaptureGroup captures{config};
+  if (!captures.active()) {
+    LOG_ERROR("Capture source cannot be opened!");
     return ATM_ERR;
   }
 
   server::Slave                      slave(&server_config);
   server::DataMapper                 data_mapper(&server_config, &slave);
   std::unique_ptr<storage::Database> internal_db =
-      std::make_unique<storage::InternalDatabase>(config->images_db());
+      std::make_unique<storage::InternalDatabase>(config->images_db(),
+                                                  &storage_config);
   std::unique_ptr<storage::Database> cloud_db =
       std::make_unique<cloud::Database>(&cloud_config);
 
@@ -51,33 +103,124 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
     return ATM_ERR;
   }
 
-  // images
-  cv::Mat frame;
+  storage::Encoder encoder(&storage_config);
+  storage::Spool   spool(&storage_config);
 
   // listeners
-  storage::StorageListener storage_listener{&server_config, &data_mapper,
-                                            internal_db.get(), &frame};
+  storage::StorageListener storage_listener{
+      &server_config, &storage_config, &data_mapper, internal_db.get(),
+      &encoder, &spool, &captures};
   cloud::CloudListener     cloud_listener{
       &cloud_config, internal_db.get(),
-      dynamic_cast<cloud::Database*>(cloud_db.get()), &cloud_storage};
+      dynamic_cast<cloud::Database*>(cloud_db.get()), &cloud_storage,
+      &encoder, &spool};
+
+  // uploads start as soon as a tray is stored
+  storage_listener.bind_stored([&cloud_listener] { cloud_listener.notify(); });
 
   LOG_INFO("Running server...");
   slave.run();
 
   LOG_INFO("Running listeners...");
+  captures.start();
   storage_listener.start();
   cloud_listener.start();
 
+  // every listener runs on its own thread, the main thread only sleeps until
+  // a termination signal arrives or the next report is due
+  const auto&    primary = captures.primary().frame_buffer();
+  const timespec timeout{REPORT_INTERVAL, 0};
+  auto           last_cpu = cpu_micros();
+  auto           last_time = monotonic_micros();
+  auto           last_sequence = primary.sequence();
+  auto           last_encoded = encoder.encoded();
+  auto           last_bytes = encoder.encoded_bytes();
+  auto           last_encode_time = encoder.encode_time();
+  int            received = 0;
+
   while (true) {
-    if (cap.read(frame)) {
-      frame.convertTo(frame, CV_8U, 1.0, 0);
+    received = sigtimedwait(&signals, nullptr, &timeout);
+    if (received == SIGINT || received == SIGTERM) {
+      break;
+    }
+
+    if (received < 0 && errno != EAGAIN) {
+      continue;  // interrupted, nothing to report yet
     }
+
+    auto cpu = cpu_micros();
+    auto now = monotonic_micros();
+    auto sequence = primary.sequence();
+    auto elapsed = static_cast<double>(now - last_time);
+
+    LOG_INFO("CPU usage {:.1f}% of one core, capturing at {:.1f} fps",
+             100.0 * static_cast<double>(cpu - last_cpu) / elapsed,
+             1e6 * static_cast<double>(sequence - last_sequence) / elapsed);
+
+    auto encoded = encoder.encoded();
+    auto bytes = encoder.encoded_bytes();
+    auto encode_time = encoder.encode_time();
+    if (encoded > last_encoded) {
+      auto count = static_cast<double>(encoded - last_encoded);
+      LOG_INFO("Encoded {} images, {:.1f} KiB in {:.1f} ms on average",
+               encoded - last_encoded,
+               static_cast<double>(bytes - last_bytes) / 1024.0 / count,
+               static_cast<double>(encode_time - last_encode_time) / 1000.0 /
+                   count);
+    }
+
+    if (spool.staging()) {
+      LOG_INFO("Staging {} images, {:.1f} MiB, {} moved to flash so far",
+               spool.staged(),
+               static_cast<double>(spool.staged_bytes()) / 1048576.0,
+               spool.flushed());
+    }
+
+    if (spool.segmented()) {
+      const auto* segments = spool.segments();
+      LOG_INFO("Storing {} images, {:.1f} MiB in {} segments, {} compacted "
+               "so far",
+               segments->count(),
+               static_cast<double>(segments->live_bytes()) / 1048576.0,
+               segments->segments(), segments->compacted());
+    }
+
+    const auto& handshake = storage_listener.handshake();
+    if (handshake.dwell(server::handshake_state_t::busy).count > 0) {
+      auto average = [&handshake](server::handshake_state_t state) {
+        auto dwell = handshake.dwell(state);
+        return dwell.count == 0 ? 0.0
+                                : static_cast<double>(dwell.total) / 1000.0 /
+                                      static_cast<double>(dwell.count);
+      };
+      LOG_INFO(
+          "Handshake full {:.1f} ms, ready {:.1f} ms, busy {:.1f} ms, done "
+          "{:.1f} ms, rearm {:.1f} ms on average",
+          average(server::handshake_state_t::full),
+          average(server::handshake_state_t::ready),
+          average(server::handshake_state_t::busy),
+          average(server::handshake_state_t::done),
+          average(server::handshake_state_t::rearm));
+    }
+
+    last_cpu = cpu;
+    last_time = now;
+    last_sequence = sequence;
+    last_encoded = encoded;
+    last_bytes = bytes;
+    last_encode_time = encode_time;
   }
 
+  LOG_INFO("Received {}, shutting down...", strsignal(received));
+
+  // stop taking trays first and let the one in progress finish with frames
+  // still coming, then stop capturing and finish pending uploads
   storage_listener.stop();
+  captures.stop();
   cloud_listener.stop();
   slave.stop();
-  cap.release();
+
+  LOG_INFO("Shutdown complete");
 
   return 0;
 }
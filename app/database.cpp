@@ -5,19 +5,75 @@
 #include <iostream>
 #include <memory>
 #include <stdexcept>
+#include <string>
 #include <utility>
 
+#include <fmt/format.h>
+
 #include <libcloud/cloud.hpp>
 #include <libcore/core.hpp>
 #include <libstorage/storage.hpp>
 #include <libutil/util.hpp>
 
+/**
+ * Quote a name as a SQL literal
+ *
+ * @param name name
+ *
+ * @return quoted name
+ */
+static std::string quote(const std::string& name) {
+  std::string quoted = "'";
+  for (auto c : name) {
+    quoted += c;
+    if (c == '\'') {
+      quoted += c;
+    }
+  }
+  quoted += "'";
+  return quoted;
+}
+
+/**
+ * Get values of an ENUM type holding names of a code table
+ *
+ * @param table code table
+ *
+ * @return comma separated values
+ */
+static std::string enum_values(const ns(storage::CodeTable)& table) {
+  std::string values;
+  for (const auto& name : table.names()) {
+    values += quote(name) + ", ";
+  }
+  values += quote(table.unknown());
+  return values;
+}
+
+/**
+ * Add names of a code table missing from an ENUM type
+ *
+ * @param conn  connection
+ * @param type  ENUM type
+ * @param table code table
+ */
+static void update_enum(tao::pq::connection*          conn,
+                        const char*                   type,
+                        const ns(storage::CodeTable)& table) {
+  for (const auto& name : table.names()) {
+    conn->execute(
+        fmt::format("ALTER TYPE {} ADD VALUE IF NOT EXISTS {}", type,
+                    quote(name)));
+  }
+}
+
 int main([[maybe_unused]] int argc, char* argv[]) {
   USE_NAMESPACE
 
   if (argc != 2) {
-    std::cerr << "should pass 1 parameter either destroy or create"
-              << std::endl;
+    std::cerr
+        << "should pass 1 parameter either destroy, create or migrate"
+        << std::endl;
     return ATM_ERR;
   }
 
@@ -27,8 +83,12 @@ int main([[maybe_unused]] int argc, char* argv[]) {
   }
 
   // config
-  auto*         config = Config::get();
-  cloud::Config cloud_config{config};
+  auto*           config = Config::get();
+  cloud::Config   cloud_config{config};
+  storage::Config storage_config{config};
+
+  // same code tables as the storage listener
+  const auto& codes = storage_config.codes();
 
   auto cloud_db = std::make_unique<cloud::Database>(&cloud_config);
   auto conn = cloud_db->connection();
@@ -44,35 +104,14 @@ int main([[maybe_unused]] int argc, char* argv[]) {
   } else if (strcmp(argv[1], "create") == 0) {
     // conn->execute("SET timezone = 'US/Pacific'");
 
-    conn->execute(
-        "CREATE TYPE SKU_CARD_T AS ENUM ("
-        "'Colonize', "
-        "'Tend', "
-        "'ExposeFlip', "
-        "'FlipNylonFlip', "
-        "'TendFlipFlipCompFlip', "
-        "'FlipTend', "
-        "'HarvestBed', "
-        "'Unknown'"
-        ");");
+    conn->execute(fmt::format("CREATE TYPE SKU_CARD_T AS ENUM ({});",
+                              enum_values(codes.sku_card())));
 
-    conn->execute(
-        "CREATE TYPE SKU_NUMBER_T AS ENUM ("
-        "'Regen', "
-        "'Eskimo', "
-        "'Tiger', "
-        "'Sapien', "
-        "'Unknown'"
-        ");");
+    conn->execute(fmt::format("CREATE TYPE SKU_NUMBER_T AS ENUM ({});",
+                              enum_values(codes.sku_number())));
 
-    conn->execute(
-        "CREATE TYPE INFECTION_T AS ENUM ("
-        "'None', "
-        "'Blue/Green', "
-        "'Black/Brown', "
-        "'Metabolite', "
-        "'Unknown'"
-        ");");
+    conn->execute(fmt::format("CREATE TYPE INFECTION_T AS ENUM ({});",
+                              enum_values(codes.infection())));
 
     conn->execute(
         "CREATE TABLE images( "
@@ -91,7 +130,11 @@ int main([[maybe_unused]] int argc, char* argv[]) {
         "LID_BARCODE TEXT NOT NULL, "
         "BATCH_ID INTEGER NOT NULL, "
         "INFECTION INFECTION_T NOT NULL, "
-        "TAKEN_AT TIMESTAMP NOT NULL"
+        "TAKEN_AT TIMESTAMP NOT NULL, "
+        "VIEWS TEXT NOT NULL DEFAULT '', "
+        "CHECKSUM TEXT NOT NULL DEFAULT '', "
+        "LEVELS TEXT NOT NULL DEFAULT '', "
+        "EXTENSION TEXT NOT NULL DEFAULT ''"
         ");");
 
     conn->execute("CREATE UNIQUE INDEX HASH_IDX ON images (HASH)");
@@ -99,6 +142,7 @@ int main([[maybe_unused]] int argc, char* argv[]) {
         "CREATE UNIQUE INDEX HASH_LOWER_IDX ON images ((lower(HASH)))");
     conn->execute(
         "CREATE INDEX TAKEN_AT_IDX ON images ((TAKEN_AT::TIMESTAMP));");
+    conn->execute("CREATE INDEX CHECKSUM_IDX ON images (CHECKSUM)");
 
     // cloud_db->prepare_statements();
     // cloud_db->insert({-1, "TRAY_123", 2020, 10, 13, 0, 0, 0, "Colonize",
@@ -106,7 +150,29 @@ int main([[maybe_unused]] int argc, char* argv[]) {
     // auto img = cloud_db->get("TRAY_123");
     // LOG_INFO("{}", img);
     LOG_INFO("Successfully create `images` table");
+  } else if (strcmp(argv[1], "migrate") == 0) {
+    // names added to [codes] since the table has been created
+    update_enum(conn, "SKU_CARD_T", codes.sku_card());
+    update_enum(conn, "SKU_NUMBER_T", codes.sku_number());
+    update_enum(conn, "INFECTION_T", codes.infection());
+
+    // columns added since the table has been created
+    conn->execute(
+        "ALTER TABLE images "
+        "ADD COLUMN IF NOT EXISTS VIEWS TEXT NOT NULL DEFAULT ''");
+    conn->execute(
+        "ALTER TABLE images "
+        "ADD COLUMN IF NOT EXISTS CHECKSUM TEXT NOT NULL DEFAULT ''");
+    conn->execute(
+        "ALTER TABLE images "
+        "ADD COLUMN IF NOT EXISTS LEVELS TEXT NOT NULL DEFAULT ''");
+    conn->execute(
+        "ALTER TABLE images "
+        "ADD COLUMN IF NOT EXISTS EXTENSION TEXT NOT NULL DEFAULT ''");
+    conn->execute(
+        "CREATE INDEX IF NOT EXISTS CHECKSUM_IDX ON images (CHECKSUM)");
+    LOG_INFO("Successfully migrate `images` table");
   } else {
-    LOG_INFO("Parameter should be only destroy or create");
+    LOG_INFO("Parameter should be only destroy, create or migrate");
   }
 }
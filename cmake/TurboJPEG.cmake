@@ -0,0 +1,15 @@
+# only activate tools for top level project
+if(NOT PROJECT_SOURCE_DIR STREQUAL CMAKE_SOURCE_DIR)
+  return()
+endif()
+
+option(ENABLE_TURBOJPEG "Encode JPEG with the libjpeg-turbo SIMD API if available" ON)
+
+if(ENABLE_TURBOJPEG)
+  # libjpeg-turbo TurboJPEG API, shipped on Jetson as libturbojpeg
+  find_path(TurboJPEG_INCLUDE_DIR NAMES turbojpeg.h)
+  find_library(TurboJPEG_LIBRARY NAMES turbojpeg libturbojpeg.so.0)
+
+  include(FindPackageHandleStandardArgs)
+  find_package_handle_standard_args(TurboJPEG DEFAULT_MSG TurboJPEG_INCLUDE_DIR TurboJPEG_LIBRARY)
+endif()
@@ -0,0 +1,47 @@
+#ifndef LIB_CAMERA_CAMERA_HPP_
+#define LIB_CAMERA_CAMERA_HPP_
+
+/** @file camera.hpp
+ *  @brief Precompiled header for faster project compilation
+ *
+ * Every source file must include this file whether precompiled feature is
+ * enabled or not
+ */
+
+#pragma GCC system_header
+
+// 1. STL
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// 2. Vendors
+// 2.1. OpenCV
+#include <opencv4/opencv2/opencv.hpp>
+
+// 3. Inside project
+#include <libcore/core.hpp>
+#include <libutil/util.hpp>
+
+// 4. Local
+#include "capture-group.hpp"
+
+#include "config.hpp"
+
+#include "frame.hpp"
+
+#include "frame-buffer.hpp"
+
+#include "frame-pool.hpp"
+
+#include "listener.hpp"
+
+#include "mjpeg.hpp"
+
+#include "source.hpp"
+
+#endif  // LIB_CAMERA_CAMERA_HPP_
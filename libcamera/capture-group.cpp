@@ -0,0 +1,55 @@
+#include "camera.hpp"
+
+#include "capture-group.hpp"
+
+#include <algorithm>
+
+NAMESPACE_BEGIN
+
+namespace camera {
+CaptureGroup::CaptureGroup(const impl::ConfigImpl* config)
+    : configs_{Config::sources(config)} {
+  // configs_ is not resized anymore, listeners keep pointers into it
+  for (const auto& camera_config : configs_) {
+    listeners_.push_back(std::make_unique<CaptureListener>(&camera_config));
+    if (!listeners_.back()->active()) {
+      LOG_ERROR("Camera {} cannot be opened", camera_config.name());
+    }
+  }
+}
+
+CaptureGroup::~CaptureGroup() {}
+
+void CaptureGroup::start() {
+  for (auto& listener : listeners_) {
+    listener->start();
+  }
+}
+
+void CaptureGroup::stop() {
+  for (auto& listener : listeners_) {
+    listener->stop();
+  }
+}
+
+bool CaptureGroup::active() const {
+  return !listeners_.empty() &&
+         std::all_of(listeners_.begin(), listeners_.end(),
+                     [](const auto& listener) { return listener->active(); });
+}
+
+std::vector<Frame> CaptureGroup::frames(time_unit trigger) const {
+  std::vector<Frame> frames;
+  frames.reserve(size());
+
+  // the deadline is absolute, once the first camera is done waiting the
+  // others have been capturing all along and return (almost) immediately
+  for (const auto& listener : listeners_) {
+    frames.push_back(listener->frame(trigger));
+  }
+
+  return frames;
+}
+}  // namespace camera
+
+NAMESPACE_END
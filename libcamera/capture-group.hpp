@@ -0,0 +1,124 @@
+#ifndef LIB_CAMERA_CAPTURE_GROUP_HPP_
+#define LIB_CAMERA_CAPTURE_GROUP_HPP_
+
+/** @file capture-group.hpp
+ *  @brief Group of cameras triggered together
+ *
+ * Group of cameras triggered together
+ */
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <libcore/core.hpp>
+
+#include "config.hpp"
+#include "frame.hpp"
+#include "listener.hpp"
+
+NAMESPACE_BEGIN
+
+namespace camera {
+/**
+ * @brief Cameras looking at the same tray
+ *
+ * Owns one capture listener (thread) per configured camera, the first camera
+ * is the primary view
+ */
+class CaptureGroup : public StackObj {
+ public:
+  /**
+   * CaptureGroup constructor
+   *
+   * Opens every camera, check active() before starting
+   *
+   * @param config base config
+   */
+  explicit CaptureGroup(const impl::ConfigImpl* config);
+
+  /**
+   * CaptureGroup destructor
+   */
+  ~CaptureGroup();
+
+  /**
+   * Start every capture listener
+   */
+  void start();
+
+  /**
+   * Stop every capture listener
+   */
+  void stop();
+
+  /**
+   * Group active status
+   *
+   * @return true if every camera is opened
+   */
+  bool active() const;
+
+  /**
+   * Get number of cameras
+   *
+   * @return number of cameras
+   */
+  inline std::size_t size() const { return listeners_.size(); }
+
+  /**
+   * Get camera configuration
+   *
+   * @param camera camera number
+   *
+   * @return camera configuration
+   */
+  inline const Config& config(std::size_t camera) const {
+    return configs_[camera];
+  }
+
+  /**
+   * Get capture listener
+   *
+   * @param camera camera number
+   *
+   * @return capture listener
+   */
+  inline const CaptureListener& operator[](std::size_t camera) const {
+    return *listeners_[camera];
+  }
+
+  /**
+   * Get capture listener of the primary view
+   *
+   * @return capture listener
+   */
+  inline const CaptureListener& primary() const { return *listeners_.front(); }
+
+  /**
+   * Get frames of every camera aligned to a trigger
+   *
+   * All cameras capture on their own threads and share one deadline, so the
+   * wait is bounded by the slowest camera rather than the sum of all
+   *
+   * @param trigger monotonic trigger time in microseconds
+   *
+   * @return one frame per camera, in camera order
+   */
+  std::vector<Frame> frames(time_unit trigger) const;
+
+ private:
+  /**
+   * Camera configurations, one per listener
+   */
+  std::vector<Config> configs_;
+  /**
+   * Capture listeners
+   */
+  std::vector<std::unique_ptr<CaptureListener>> listeners_;
+};
+}  // namespace camera
+
+NAMESPACE_END
+
+#endif  // LIB_CAMERA_CAPTURE_GROUP_HPP_
@@ -0,0 +1,137 @@
+#include "camera.hpp"
+
+#include "config.hpp"
+
+#include <type_traits>
+
+NAMESPACE_BEGIN
+
+namespace camera {
+Config::Config(const impl::ConfigImpl* config)
+    : base_config_{config}, section_{nullptr} {
+  massert(config != nullptr, "sanity");
+  name_ = "main";
+  load();
+}
+
+Config::Config(const impl::ConfigImpl* config, std::size_t source)
+    : base_config_{config} {
+  massert(config != nullptr, "sanity");
+  section_ = &toml::find(config->config(), "camera", "sources")
+                  .as_array()
+                  .at(source);
+  name_ = fmt::format("camera-{}", source);
+  index_ = static_cast<int>(source);
+  load();
+}
+
+std::vector<Config> Config::sources(const impl::ConfigImpl* config) {
+  std::vector<Config> configs;
+
+  std::size_t count = 0;
+  if (config->config().contains("camera") &&
+      config->config().at("camera").contains("sources")) {
+    count = config->find<toml::array>("camera", "sources").size();
+  }
+
+  if (count == 0) {
+    configs.emplace_back(config);
+  }
+
+  for (std::size_t source = 0; source < count; ++source) {
+    configs.emplace_back(config, source);
+  }
+
+  return configs;
+}
+
+/**
+ * Convert a TOML value
+ *
+ * @param value TOML value
+ *
+ * @return converted value
+ */
+template <typename T>
+static T convert(const toml::value& value) {
+  // "rate = 0" is as valid as "rate = 0.0"
+  if constexpr (std::is_floating_point_v<T>) {
+    if (value.is_integer()) {
+      return static_cast<T>(value.as_integer());
+    }
+  }
+
+  return toml::get<T>(value);
+}
+
+template <typename T>
+bool Config::lookup(const char* key, T& value, bool shared) const {
+  if (section_ != nullptr && section_->contains(key)) {
+    value = convert<T>(section_->at(key));
+    return true;
+  }
+
+  if ((section_ == nullptr || shared) &&
+      base_config()->config().contains("camera") &&
+      base_config()->config().at("camera").contains(key)) {
+    value = convert<T>(base_config()->config().at("camera").at(key));
+    return true;
+  }
+
+  return false;
+}
+
+void Config::load() {
+  lookup("name", name_, false);
+
+  if (section_ == nullptr) {
+    index_ = base_config()->camera_idx();
+  }
+  lookup("index", index_, false);
+
+  source_ = source_t::device;
+  std::string source;
+  if (lookup("source", source)) {
+    if (source.compare("video") == 0) {
+      source_ = source_t::video;
+    } else if (source.compare("directory") == 0) {
+      source_ = source_t::directory;
+    }
+  }
+
+  lookup("path", path_, false);
+
+  rate_ = 0.0;  // as fast as possible
+  lookup("rate", rate_);
+
+  loop_ = true;
+  lookup("loop", loop_);
+
+  buffer_ = 3;  // triple buffering
+  lookup("buffer", buffer_);
+
+  int width = 0;
+  int height = 0;
+  if (lookup("width", width) && lookup("height", height)) {
+    resolution_ = cv::Size(width, height);
+  }
+
+  // every ring slot holds a buffer, the rest is left to consumers
+  pool_ = buffer_ + 4;
+  lookup("pool", pool_);
+
+  trigger_match_ = match_t::closest;
+  std::string trigger;
+  if (lookup("trigger", trigger) && trigger.compare("after") == 0) {
+    trigger_match_ = match_t::after;
+  }
+
+  trigger_timeout_ = 200;
+  lookup("trigger-timeout", trigger_timeout_);
+
+  passthrough_ = false;
+  lookup("passthrough", passthrough_);
+}
+}  // namespace camera
+
+NAMESPACE_END
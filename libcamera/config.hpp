@@ -0,0 +1,230 @@
+#ifndef LIB_CAMERA_CONFIG_HPP_
+#define LIB_CAMERA_CONFIG_HPP_
+
+/** @file config.hpp
+ *  @brief Camera config implementation
+ *
+ * Camera config Implementation
+ */
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <opencv4/opencv2/opencv.hpp>
+
+#include <libcore/core.hpp>
+
+#include "frame.hpp"
+#include "source.hpp"
+
+NAMESPACE_BEGIN
+
+namespace camera {
+class Config {
+ public:
+  /**
+   * Camera specialized configuration, single camera from [camera]
+   *
+   * @param config    base config
+   */
+  Config(const impl::ConfigImpl* config);
+
+  /**
+   * Camera specialized configuration, one of [[camera.sources]]
+   *
+   * Keys missing from the source fall back to [camera], except name, index,
+   * and path
+   *
+   * @param config    base config
+   * @param source    source number
+   */
+  Config(const impl::ConfigImpl* config, std::size_t source);
+
+  /**
+   * Load configuration of every camera
+   *
+   * @param config    base config
+   *
+   * @return one configuration per [[camera.sources]] entry, or the single
+   *         camera from [camera] if there is none
+   */
+  static std::vector<Config> sources(const impl::ConfigImpl* config);
+
+  /**
+   * Camera specialized configuration copy constructor
+   */
+  Config(const Config&) = default;
+
+  /**
+   * Get base config pointer
+   *
+   * @return base config pointer
+   */
+  inline const impl::ConfigImpl* base_config() const { return base_config_; }
+
+  /**
+   * Get camera name, used to tell views apart
+   *
+   * @return camera name
+   */
+  inline const std::string& name() const { return name_; }
+
+  /**
+   * Get camera index to feed into OpenCV
+   *
+   * @return opencv camera index
+   */
+  inline int index() const { return index_; }
+
+  /**
+   * Get kind of capture source
+   *
+   * @return capture source kind
+   */
+  inline source_t source() const { return source_; }
+
+  /**
+   * Get replay path (video file or image directory)
+   *
+   * @return replay path
+   */
+  inline const std::string& path() const { return path_; }
+
+  /**
+   * Get replay rate
+   *
+   * @return frames per second, zero for as fast as possible
+   */
+  inline double rate() const { return rate_; }
+
+  /**
+   * Get whether replay restarts at the end
+   *
+   * @return replay loop status
+   */
+  inline bool loop() const { return loop_; }
+
+  /**
+   * Get requested frame resolution
+   *
+   * @return frame size, empty for the source default
+   */
+  inline cv::Size resolution() const { return resolution_; }
+
+  /**
+   * Get number of pooled frame buffers
+   *
+   * @return number of pooled frame buffers
+   */
+  inline std::size_t pool() const { return pool_; }
+
+  /**
+   * Get number of frame buffer slots
+   *
+   * @return number of frame buffer slots
+   */
+  inline std::size_t buffer() const { return buffer_; }
+
+  /**
+   * Get how a frame is matched to a trigger
+   *
+   * @return trigger match
+   */
+  inline match_t trigger_match() const { return trigger_match_; }
+
+  /**
+   * Get maximum time to wait for a frame after a trigger in milliseconds
+   *
+   * @return trigger timeout in milliseconds
+   */
+  inline time_unit trigger_timeout() const { return trigger_timeout_; }
+
+  /**
+   * Get whether compressed frames are kept as delivered by the device
+   *
+   * @return true if passthrough is requested
+   */
+  inline bool passthrough() const { return passthrough_; }
+
+ private:
+  /**
+   * Load config
+   */
+  void load();
+
+  /**
+   * Find value of a key in the source table, then in [camera]
+   *
+   * @param key    key
+   * @param value  value destination, untouched if key is missing
+   * @param shared fall back to [camera] for a source
+   *
+   * @return true if key has been found
+   */
+  template <typename T>
+  bool lookup(const char* key, T& value, bool shared = true) const;
+
+ private:
+  /**
+   * Base config pointer
+   */
+  const impl::ConfigImpl* base_config_;
+  /**
+   * Source table, null for the single camera
+   */
+  const toml::value* section_;
+  /**
+   * Camera name
+   */
+  std::string name_;
+  /**
+   * Camera index
+   */
+  int index_;
+  /**
+   * Capture source kind
+   */
+  source_t source_;
+  /**
+   * Replay path
+   */
+  std::string path_;
+  /**
+   * Replay rate
+   */
+  double rate_;
+  /**
+   * Replay loop
+   */
+  bool loop_;
+  /**
+   * Requested frame resolution
+   */
+  cv::Size resolution_;
+  /**
+   * Number of pooled frame buffers
+   */
+  std::size_t pool_;
+  /**
+   * Number of frame buffer slots
+   */
+  std::size_t buffer_;
+  /**
+   * Trigger match
+   */
+  match_t trigger_match_;
+  /**
+   * Trigger timeout in milliseconds
+   */
+  time_unit trigger_timeout_;
+  /**
+   * Compressed frame passthrough
+   */
+  bool passthrough_;
+};
+}  // namespace camera
+
+NAMESPACE_END
+
+#endif  // LIB_CAMERA_CONFIG_HPP_
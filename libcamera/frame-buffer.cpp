@@ -0,0 +1,137 @@
+#include "camera.hpp"
+
+#include "frame-buffer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+NAMESPACE_BEGIN
+
+namespace camera {
+FrameBuffer::FrameBuffer(std::size_t capacity)
+    : capacity_{std::clamp<std::size_t>(capacity, 3, 64)},
+      slots_{std::make_unique<Slot[]>(capacity_)},
+      back_{0},
+      latest_{npos},
+      sequence_{0} {}
+
+FrameBuffer::~FrameBuffer() {}
+
+Frame& FrameBuffer::back() {
+  auto& frame = slots_[back_].frame;
+
+  detach(frame.image);
+  detach(frame.encoded);
+
+  return frame;
+}
+
+void FrameBuffer::detach(cv::Mat& mat) {
+  // a consumer still holds this buffer, leave it to it
+  if (mat.u != nullptr && CV_XADD(&mat.u->refcount, 0) > 1) {
+    mat.release();
+  }
+}
+
+void FrameBuffer::publish() {
+  auto& slot = slots_[back_];
+  auto  sequence = sequence_.load(std::memory_order_relaxed) + 1;
+
+  slot.frame.sequence = sequence;
+  slot.sequence.store(sequence);
+  latest_.store(back_);
+  sequence_.store(sequence, std::memory_order_release);
+
+  back_ = claim();
+}
+
+Frame FrameBuffer::snapshot() const {
+  Frame frame;
+
+  while (true) {
+    auto latest = latest_.load();
+    if (latest == npos || read(slots_[latest], frame)) {
+      return frame;
+    }
+  }
+}
+
+Frame FrameBuffer::at(time_unit timestamp, match_t match) const {
+  auto distance = [timestamp](const Frame& frame) {
+    return frame.timestamp > timestamp ? frame.timestamp - timestamp
+                                       : timestamp - frame.timestamp;
+  };
+
+  Frame best;
+  Frame candidate;
+
+  for (std::size_t i = 0; i < capacity(); ++i) {
+    if (!read(slots_[i], candidate)) {
+      continue;
+    }
+
+    if (match == match_t::after && candidate.timestamp < timestamp) {
+      continue;
+    }
+
+    if (best.empty() || distance(candidate) < distance(best)) {
+      best = candidate;
+    }
+  }
+
+  return best;
+}
+
+std::size_t FrameBuffer::claim() {
+  const auto latest = latest_.load(std::memory_order_relaxed);
+
+  while (true) {
+    std::uint64_t tried = 0;
+
+    while (true) {
+      // reuse the oldest slot first so the ring keeps the recent history
+      std::size_t   index = npos;
+      std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+      for (std::size_t i = 0; i < capacity(); ++i) {
+        if (i == latest || (tried & (1ULL << i)) != 0) {
+          continue;
+        }
+        auto sequence = slots_[i].sequence.load(std::memory_order_relaxed);
+        if (index == npos || sequence < oldest) {
+          index = i;
+          oldest = sequence;
+        }
+      }
+
+      if (index == npos) {
+        break;
+      }
+
+      // invalidate before checking readers, see FrameBuffer::read
+      auto& slot = slots_[index];
+      slot.sequence.store(0);
+      if (slot.readers.load() == 0) {
+        return index;
+      }
+      slot.sequence.store(oldest);
+      tried |= 1ULL << index;
+    }
+
+    // every free slot is being copied right now, it only takes a moment
+    std::this_thread::yield();
+  }
+}
+
+bool FrameBuffer::read(const Slot& slot, Frame& frame) {
+  slot.readers.fetch_add(1);
+  bool readable = slot.sequence.load() != 0;
+  if (readable) {
+    frame = slot.frame;
+  }
+  slot.readers.fetch_sub(1, std::memory_order_release);
+  return readable;
+}
+}  // namespace camera
+
+NAMESPACE_END
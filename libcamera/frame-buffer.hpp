@@ -0,0 +1,173 @@
+#ifndef LIB_CAMERA_FRAME_BUFFER_HPP_
+#define LIB_CAMERA_FRAME_BUFFER_HPP_
+
+/** @file frame-buffer.hpp
+ *  @brief Lock-free frame exchange
+ *
+ * Lock-free frame exchange between one producer and many consumers
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <libcore/core.hpp>
+
+#include "frame.hpp"
+
+NAMESPACE_BEGIN
+
+namespace camera {
+/**
+ * @brief Sequence-numbered N-slot frame ring
+ *
+ * Single producer writes into a private back slot and publishes it, any
+ * number of consumers take a consistent snapshot of the latest published slot.
+ *
+ * Consumers pin a slot only while copying the frame header, the producer
+ * claims a new back slot by invalidating its sequence first and then checking
+ * the pins (Dekker style), so a pinned slot is never written and a slot being
+ * written is never read. Pixels of a snapshot stay alive through cv::Mat
+ * reference counting; the producer detaches from a buffer that is still
+ * shared instead of overwriting it.
+ *
+ * The producer always recycles the oldest slot, so the ring doubles as a short
+ * history of the last frames that can be searched by timestamp.
+ *
+ * Capacity should be at least number of concurrent consumers + 2 so the
+ * producer always finds a free slot without waiting.
+ */
+class FrameBuffer : public StackObj {
+ public:
+  /**
+   * FrameBuffer constructor
+   *
+   * @param capacity number of slots (3 up to 64)
+   */
+  explicit FrameBuffer(std::size_t capacity = 3);
+
+  /**
+   * FrameBuffer destructor
+   */
+  ~FrameBuffer();
+
+  /**
+   * Get back frame to write (producer only)
+   *
+   * @return frame that is exclusively owned by producer
+   */
+  Frame& back();
+
+  /**
+   * Publish back frame and claim a new back slot (producer only)
+   */
+  void publish();
+
+  /**
+   * Take snapshot of the latest published frame
+   *
+   * @return latest frame, empty if nothing has been published yet
+   */
+  Frame snapshot() const;
+
+  /**
+   * Take snapshot of the frame matching given time from the history
+   *
+   * @param timestamp monotonic time in microseconds
+   * @param match     closest frame or first frame captured after timestamp
+   *
+   * @return matching frame, empty if there is none
+   */
+  Frame at(time_unit timestamp, match_t match = match_t::closest) const;
+
+  /**
+   * Get sequence number of the latest published frame
+   *
+   * @return latest sequence number
+   */
+  inline std::uint64_t sequence() const {
+    return sequence_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Get number of slots
+   *
+   * @return number of slots
+   */
+  inline std::size_t capacity() const { return capacity_; }
+
+ private:
+  /**
+   * Frame slot
+   */
+  struct Slot {
+    /**
+     * Number of consumers copying this slot
+     */
+    mutable std::atomic<std::uint32_t> readers{0};
+    /**
+     * Published sequence, zero while the producer owns the slot
+     */
+    std::atomic<std::uint64_t> sequence{0};
+    /**
+     * Frame
+     */
+    Frame frame;
+  };
+
+  /**
+   * Claim the oldest free slot as the new back slot
+   *
+   * @return slot index
+   */
+  std::size_t claim();
+
+  /**
+   * Copy frame out of a slot if it is readable
+   *
+   * @param slot  slot to copy
+   * @param frame frame destination
+   *
+   * @return true if frame is copied
+   */
+  static bool read(const Slot& slot, Frame& frame);
+
+  /**
+   * Drop buffer reference if it is still shared with a consumer
+   *
+   * @param mat buffer of the back frame
+   */
+  static void detach(cv::Mat& mat);
+
+ private:
+  /**
+   * Index for no slot
+   */
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+  /**
+   * Number of slots
+   */
+  const std::size_t capacity_;
+  /**
+   * Slots
+   */
+  std::unique_ptr<Slot[]> slots_;
+  /**
+   * Back slot index (producer only)
+   */
+  std::size_t back_;
+  /**
+   * Latest published slot index
+   */
+  std::atomic<std::size_t> latest_;
+  /**
+   * Latest published sequence
+   */
+  std::atomic<std::uint64_t> sequence_;
+};
+}  // namespace camera
+
+NAMESPACE_END
+
+#endif  // LIB_CAMERA_FRAME_BUFFER_HPP_
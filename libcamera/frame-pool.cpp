@@ -0,0 +1,130 @@
+#include "camera.hpp"
+
+#include "frame-pool.hpp"
+
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+NAMESPACE_BEGIN
+
+namespace camera {
+FramePool::FramePool(std::size_t count, std::size_t size)
+    : count_{size > 0 ? count : 0},
+      size_{size},
+      stride_{0},
+      memory_{nullptr},
+      slots_{std::make_unique<Slot[]>(count_)},
+      available_{0},
+      hint_{0},
+      fallbacks_{0},
+      locked_{false} {
+  if (count_ == 0) {
+    return;
+  }
+
+  const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  stride_ = (size_ + page - 1) / page * page;
+
+  // one mapping for all buffers, populated upfront so capture never faults
+  void* memory = mmap(nullptr, stride_ * count_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (memory == MAP_FAILED) {
+    LOG_ERROR("Cannot map {} frame buffers of {} bytes", count_, size_);
+    return;
+  }
+
+  memory_ = static_cast<unsigned char*>(memory);
+  locked_ = mlock(memory_, stride_ * count_) == 0;
+  if (!locked()) {
+    LOG_WARN("Cannot lock frame buffers in memory, check RLIMIT_MEMLOCK");
+  }
+
+  available_.store(count_, std::memory_order_release);
+}
+
+FramePool::~FramePool() {
+  if (memory_ != nullptr) {
+    if (locked()) {
+      munlock(memory_, stride_ * count_);
+    }
+    munmap(memory_, stride_ * count_);
+  }
+}
+
+cv::UMatData* FramePool::allocate(int                dims,
+                                  const int*         sizes,
+                                  int                type,
+                                  void*              data,
+                                  size_t*            step,
+                                  cv::AccessFlag     flags,
+                                  cv::UMatUsageFlags usage) const {
+  // same layout computation as the default allocator
+  std::size_t total = CV_ELEM_SIZE(type);
+  for (int i = dims - 1; i >= 0; --i) {
+    if (step != nullptr) {
+      if (data != nullptr && step[i] != CV_AUTOSTEP) {
+        total = step[i];
+      } else {
+        step[i] = total;
+      }
+    }
+    total *= static_cast<std::size_t>(sizes[i]);
+  }
+
+  if (data == nullptr && memory_ != nullptr && total <= size()) {
+    const auto start = hint_.load(std::memory_order_relaxed);
+    for (std::size_t n = 0; n < count(); ++n) {
+      const auto i = (start + n) % count();
+      bool       expected = false;
+      if (!slots_[i].in_use.compare_exchange_strong(
+              expected, true, std::memory_order_acquire)) {
+        continue;
+      }
+
+      available_.fetch_sub(1, std::memory_order_relaxed);
+      hint_.store((i + 1) % count(), std::memory_order_relaxed);
+
+      auto* u = new (slots_[i].header) cv::UMatData(this);
+      u->data = u->origdata = memory_ + i * stride_;
+      u->size = total;
+      return u;
+    }
+  }
+
+  fallbacks_.fetch_add(1, std::memory_order_relaxed);
+  return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step,
+                                              flags, usage);
+}
+
+bool FramePool::allocate(cv::UMatData*      data,
+                         cv::AccessFlag     flags,
+                         cv::UMatUsageFlags usage) const {
+  return cv::Mat::getStdAllocator()->allocate(data, flags, usage);
+}
+
+void FramePool::deallocate(cv::UMatData* data) const {
+  if (data == nullptr) {
+    return;
+  }
+
+  const auto i = find(data);
+  massert(i < count(), "sanity");
+
+  data->~UMatData();
+  slots_[i].in_use.store(false, std::memory_order_release);
+  available_.fetch_add(1, std::memory_order_release);
+}
+
+std::size_t FramePool::find(const cv::UMatData* data) const {
+  if (memory_ == nullptr || data->origdata < memory_ ||
+      data->origdata >= memory_ + stride_ * count()) {
+    return count();
+  }
+
+  return static_cast<std::size_t>(data->origdata - memory_) / stride_;
+}
+}  // namespace camera
+
+NAMESPACE_END
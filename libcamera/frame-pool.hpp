@@ -0,0 +1,182 @@
+#ifndef LIB_CAMERA_FRAME_POOL_HPP_
+#define LIB_CAMERA_FRAME_POOL_HPP_
+
+/** @file frame-pool.hpp
+ *  @brief Fixed-size frame buffer pool
+ *
+ * Fixed-size pool of page-locked frame buffers
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include <opencv4/opencv2/opencv.hpp>
+
+#include <libcore/core.hpp>
+
+NAMESPACE_BEGIN
+
+namespace camera {
+/**
+ * @brief Pool of pre-allocated, page-locked frame buffers
+ *
+ * Plugs into cv::Mat as its allocator, so the cv::Mat reference count is the
+ * handle: a buffer goes back to the pool when the last cv::Mat sharing it
+ * (capture, GUI, storage, detector) is released. All buffers are mapped and
+ * locked once on construction, a steady-state capture loop therefore does not
+ * touch the heap.
+ *
+ * Requests that do not fit a buffer, or arrive while every buffer is in use,
+ * are served by the default OpenCV allocator so no cv::Mat operation fails;
+ * the producer is expected to check available() and drop frames instead.
+ *
+ * The pool must outlive every cv::Mat allocated from it.
+ */
+class FramePool : public cv::MatAllocator {
+ public:
+  /**
+   * FramePool constructor
+   *
+   * @param count number of buffers
+   * @param size  size of each buffer in bytes
+   */
+  FramePool(std::size_t count, std::size_t size);
+
+  /**
+   * FramePool destructor
+   */
+  virtual ~FramePool() override;
+
+  FramePool(const FramePool&) = delete;
+  FramePool& operator=(const FramePool&) = delete;
+
+  /**
+   * Get number of buffers
+   *
+   * @return number of buffers
+   */
+  inline std::size_t count() const { return count_; }
+
+  /**
+   * Get size of each buffer
+   *
+   * @return buffer size in bytes
+   */
+  inline std::size_t size() const { return size_; }
+
+  /**
+   * Get number of buffers not in use
+   *
+   * @return number of free buffers
+   */
+  inline std::size_t available() const {
+    return available_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Get whether buffers are locked in memory
+   *
+   * @return true if buffers cannot be paged out
+   */
+  inline bool locked() const { return locked_; }
+
+  /**
+   * Get number of allocations served outside of the pool
+   *
+   * @return number of fallback allocations
+   */
+  inline std::size_t fallbacks() const {
+    return fallbacks_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Allocate matrix data, see cv::MatAllocator
+   */
+  virtual cv::UMatData* allocate(int                dims,
+                                 const int*         sizes,
+                                 int                type,
+                                 void*              data,
+                                 size_t*            step,
+                                 cv::AccessFlag     flags,
+                                 cv::UMatUsageFlags usage) const override;
+
+  /**
+   * Allocate data for existing matrix, see cv::MatAllocator
+   */
+  virtual bool allocate(cv::UMatData*      data,
+                        cv::AccessFlag     flags,
+                        cv::UMatUsageFlags usage) const override;
+
+  /**
+   * Return matrix data to the pool, see cv::MatAllocator
+   */
+  virtual void deallocate(cv::UMatData* data) const override;
+
+ private:
+  /**
+   * Pooled buffer
+   */
+  struct Slot {
+    /**
+     * Buffer is handed out
+     */
+    std::atomic<bool> in_use{false};
+    /**
+     * Storage for the matrix data descriptor, constructed on allocate
+     */
+    alignas(cv::UMatData) unsigned char header[sizeof(cv::UMatData)];
+  };
+
+  /**
+   * Find slot owning matrix data
+   *
+   * @param data matrix data
+   *
+   * @return slot index, count() if not from this pool
+   */
+  std::size_t find(const cv::UMatData* data) const;
+
+ private:
+  /**
+   * Number of buffers
+   */
+  const std::size_t count_;
+  /**
+   * Buffer size
+   */
+  const std::size_t size_;
+  /**
+   * Distance between buffers (size rounded up to whole pages)
+   */
+  std::size_t stride_;
+  /**
+   * Mapped memory holding all buffers
+   */
+  unsigned char* memory_;
+  /**
+   * Slots
+   */
+  std::unique_ptr<Slot[]> slots_;
+  /**
+   * Number of free buffers
+   */
+  mutable std::atomic<std::size_t> available_;
+  /**
+   * Slot to look at first on the next allocation
+   */
+  mutable std::atomic<std::size_t> hint_;
+  /**
+   * Number of allocations served by the default allocator
+   */
+  mutable std::atomic<std::size_t> fallbacks_;
+  /**
+   * Buffers are locked in memory
+   */
+  bool locked_;
+};
+}  // namespace camera
+
+NAMESPACE_END
+
+#endif  // LIB_CAMERA_FRAME_POOL_HPP_
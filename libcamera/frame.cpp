@@ -0,0 +1,17 @@
+#include "camera.hpp"
+
+#include "frame.hpp"
+
+NAMESPACE_BEGIN
+
+namespace camera {
+bool Frame::decode() {
+  if (image.empty() && !encoded.empty()) {
+    image = cv::imdecode(encoded, cv::IMREAD_COLOR);
+  }
+
+  return !image.empty();
+}
+}  // namespace camera
+
+NAMESPACE_END
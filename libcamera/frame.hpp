@@ -0,0 +1,76 @@
+#ifndef LIB_CAMERA_FRAME_HPP_
+#define LIB_CAMERA_FRAME_HPP_
+
+/** @file frame.hpp
+ *  @brief Captured frame definition
+ *
+ * Captured frame definition
+ */
+
+#include <cstdint>
+
+#include <opencv4/opencv2/opencv.hpp>
+
+#include <libcore/core.hpp>
+#include <libutil/util.hpp>
+
+NAMESPACE_BEGIN
+
+namespace camera {
+/**
+ * How to pick a frame for a given point in time
+ */
+enum class match_t { closest, after };
+
+/**
+ * @brief Captured frame
+ *
+ * Copying a frame only copies the cv::Mat header, pixels are shared
+ */
+struct Frame {
+  /**
+   * Decoded image (BGR), empty for a compressed frame until decode()
+   */
+  cv::Mat image;
+  /**
+   * Compressed bitstream (1xN CV_8U) as delivered by the device, empty if the
+   * frame has been decoded on capture
+   */
+  cv::Mat encoded;
+  /**
+   * Sequence number assigned on publish, zero means no frame
+   */
+  std::uint64_t sequence = 0;
+  /**
+   * Monotonic capture time in microseconds, see monotonic_micros()
+   */
+  time_unit timestamp = 0;
+
+  /**
+   * Check whether frame holds an image
+   *
+   * @return true if frame is empty
+   */
+  inline bool empty() const {
+    return sequence == 0 || (image.empty() && encoded.empty());
+  }
+
+  /**
+   * Check whether frame holds a compressed bitstream
+   *
+   * @return true if frame is compressed
+   */
+  inline bool compressed() const { return !encoded.empty(); }
+
+  /**
+   * Decode compressed bitstream into image if not decoded yet
+   *
+   * @return true if image is available
+   */
+  bool decode();
+};
+}  // namespace camera
+
+NAMESPACE_END
+
+#endif  // LIB_CAMERA_FRAME_HPP_
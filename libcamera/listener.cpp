@@ -0,0 +1,165 @@
+#include "camera.hpp"
+
+#include "listener.hpp"
+
+#include "config.hpp"
+#include "mjpeg.hpp"
+
+NAMESPACE_BEGIN
+
+namespace camera {
+/**
+ * Get size of a pooled buffer, a BGR frame (which also bounds the size of a
+ * camera JPEG)
+ *
+ * @param source     capture source
+ * @param resolution configured resolution, source resolution if empty
+ *
+ * @return buffer size in bytes, zero if unknown
+ */
+static std::size_t buffer_size(const CaptureSource* source,
+                               cv::Size             resolution) {
+  if (resolution.empty() && source->active()) {
+    resolution = source->resolution();
+  }
+
+  if (resolution.empty()) {
+    return 0;
+  }
+
+  return static_cast<std::size_t>(resolution.area()) * 3;
+}
+
+CaptureListener::CaptureListener(const Config* config, bool autorun)
+    : config_{config},
+      source_{CaptureSource::create(config)},
+      frame_pool_{config->pool(),
+                  buffer_size(source_.get(), config->resolution())},
+      frame_buffer_{config->buffer()},
+      dropped_{0},
+      passthrough_{false} {
+  if (!active()) {
+    return;
+  }
+
+  LOG_INFO("Capturing from {}", source_->description());
+  LOG_INFO("Frame pool has {} buffers of {} bytes{}", frame_pool_.count(),
+           frame_pool_.size(), frame_pool_.locked() ? ", locked" : "");
+
+  if (config->passthrough()) {
+    passthrough_ = source_->enable_passthrough();
+    if (!passthrough_) {
+      LOG_WARN("Source does not deliver MJPEG, decoding frames on capture");
+    }
+  }
+
+  if (autorun) {
+    start();
+  }
+}
+
+CaptureListener::~CaptureListener() {
+  running_ = false;
+  if (thread().joinable()) {
+    thread().join();
+  }
+}
+
+void CaptureListener::start() {
+  Listener::LockGuard lock(mutex());
+  if (!running()) {
+    LOG_INFO("Starting capture listener");
+    running_ = true;
+    thread_ = std::thread(&CaptureListener::execute, this);
+  }
+}
+
+void CaptureListener::stop() {
+  Listener::LockGuard lock(mutex());
+  if (running()) {
+    LOG_INFO("Stopping capture listener");
+    running_ = false;
+    if (thread().joinable()) {
+      thread().join();
+    }
+    LOG_INFO("Stopping capture listener complete");
+  }
+}
+
+Frame CaptureListener::frame(time_unit trigger) const {
+  const auto deadline = trigger + config()->trigger_timeout() * 1000;
+
+  // frames on both sides of the trigger are needed to find the closest one
+  while (frame_buffer().snapshot().timestamp < trigger &&
+         monotonic_micros() < deadline) {
+    sleep_for<time_units::millis>(1);
+  }
+
+  auto frame = frame_buffer().at(trigger, config()->trigger_match());
+
+  if (frame.empty()) {
+    LOG_WARN("No frame matches trigger at {}us, using the latest one",
+             trigger);
+    frame = frame_buffer().snapshot();
+  }
+
+  return frame;
+}
+
+void CaptureListener::execute() {
+  massert(State::get() != nullptr, "sanity");
+
+  while (running()) {
+    // grab blocks until the next frame is due
+    if (!source_->grab()) {
+      sleep_for<time_units::millis>(10);  // device hiccup, do not spin
+      continue;
+    }
+
+    // stamp before decoding so the time is as close to exposure as possible
+    auto timestamp = monotonic_micros();
+
+    auto& frame = frame_buffer_.back();
+    frame.image.allocator = &frame_pool_;
+    frame.encoded.allocator = &frame_pool_;
+    raw_.allocator = &frame_pool_;
+
+    // buffers still held by consumers are never reused, drop the frame if
+    // there is no free one left instead of growing
+    std::size_t needed = 0;
+    if (passthrough()) {
+      needed = (frame.encoded.empty() ? 1 : 0) + (raw_.empty() ? 1 : 0);
+    } else {
+      needed = frame.image.empty() ? 1 : 0;
+    }
+
+    if (frame_pool_.count() > 0 && needed > frame_pool_.available()) {
+      if (dropped_.fetch_add(1, std::memory_order_relaxed) == 0) {
+        LOG_WARN("Frame pool exhausted, dropping frames");
+      }
+      continue;
+    }
+
+    if (passthrough()) {
+      if (!source_->retrieve_encoded(raw_) || !mjpeg::valid(raw_)) {
+        continue;
+      }
+
+      // keep the bitstream, decoding is left to whoever needs the pixels
+      mjpeg::standalone(raw_, frame.encoded);
+      frame.image.release();
+    } else {
+      if (!source_->retrieve(frame.image)) {
+        continue;
+      }
+
+      frame.encoded.release();
+    }
+
+    frame.timestamp = timestamp;
+    frame_buffer_.publish();
+  }
+}
+}  // namespace camera
+
+NAMESPACE_END
@@ -0,0 +1,150 @@
+#ifndef LIB_CAMERA_LISTENER_HPP_
+#define LIB_CAMERA_LISTENER_HPP_
+
+/** @file listener.hpp
+ *  @brief Camera capture listener
+ *
+ * Reads frames on its own thread at the camera's native rate
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include <opencv4/opencv2/opencv.hpp>
+
+#include <libcore/core.hpp>
+
+#include "frame-buffer.hpp"
+#include "frame-pool.hpp"
+#include "source.hpp"
+
+NAMESPACE_BEGIN
+
+namespace camera {
+class Config;
+
+class CaptureListener : public Listener {
+ public:
+  /**
+   * CaptureListener constructor
+   *
+   * Opens the capture source, check active() before starting
+   *
+   * @param config  camera configuration
+   * @param autorun autorun listener
+   */
+  CaptureListener(const Config* config, bool autorun = false);
+
+  /**
+   * CaptureListener destructor
+   */
+  virtual ~CaptureListener() override;
+
+  /**
+   * Start capture listener
+   */
+  virtual void start() override;
+
+  /**
+   * Stop capture listener
+   */
+  virtual void stop() override;
+
+  /**
+   * Capture source active status
+   *
+   * @return true if capture source is opened
+   */
+  inline bool active() const { return source_ && source_->active(); }
+
+  /**
+   * Get frame buffer to take snapshots from
+   *
+   * @return frame buffer
+   */
+  inline const FrameBuffer& frame_buffer() const { return frame_buffer_; }
+
+  /**
+   * Get frame buffer pool
+   *
+   * @return frame buffer pool
+   */
+  inline const FramePool& frame_pool() const { return frame_pool_; }
+
+  /**
+   * Get number of frames dropped because the pool was exhausted
+   *
+   * @return number of dropped frames
+   */
+  inline std::size_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Compressed frame passthrough status
+   *
+   * @return true if frames are published without decoding
+   */
+  inline bool passthrough() const { return passthrough_; }
+
+  /**
+   * Get frame aligned to a trigger
+   *
+   * Waits (up to the configured timeout) until a frame newer than the trigger
+   * has been captured, then picks the matching one from the history
+   *
+   * @param trigger monotonic trigger time in microseconds
+   *
+   * @return frame aligned to the trigger, latest frame as fallback
+   */
+  Frame frame(time_unit trigger) const;
+
+ private:
+  /**
+   * Execute task
+   */
+  void execute();
+
+  /**
+   * Get config
+   *
+   * @return camera config
+   */
+  inline const Config* config() const { return config_; }
+
+ private:
+  /**
+   * Configuration
+   */
+  const Config* config_;
+  /**
+   * Capture source
+   */
+  std::unique_ptr<CaptureSource> source_;
+  /**
+   * Pixel buffers, must outlive every frame
+   */
+  FramePool frame_pool_;
+  /**
+   * Published frames
+   */
+  FrameBuffer frame_buffer_;
+  /**
+   * Compressed frame as delivered by the source, before fixing it up
+   */
+  cv::Mat raw_;
+  /**
+   * Number of dropped frames
+   */
+  std::atomic<std::size_t> dropped_;
+  /**
+   * Compressed frame passthrough
+   */
+  bool passthrough_;
+};
+}  // namespace camera
+
+NAMESPACE_END
+
+#endif  // LIB_CAMERA_LISTENER_HPP_
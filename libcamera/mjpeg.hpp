@@ -0,0 +1,44 @@
+#ifndef LIB_CAMERA_MJPEG_HPP_
+#define LIB_CAMERA_MJPEG_HPP_
+
+/** @file mjpeg.hpp
+ *  @brief Motion JPEG helpers
+ *
+ * Motion JPEG helpers for compressed frame passthrough
+ */
+
+#include <opencv4/opencv2/opencv.hpp>
+
+#include <libcore/core.hpp>
+
+NAMESPACE_BEGIN
+
+namespace camera {
+namespace mjpeg {
+/**
+ * Check whether buffer starts like a JPEG image (SOI marker)
+ *
+ * @param encoded compressed frame
+ *
+ * @return true if buffer looks like JPEG
+ */
+bool valid(const cv::Mat& encoded);
+
+/**
+ * Copy compressed frame into a standalone JPEG
+ *
+ * UVC cameras and MJPEG AVI files commonly omit the DHT segment and rely on
+ * the default Huffman tables of the JPEG standard (Annex K.3), which most
+ * image viewers do not assume. The default tables are inserted before the
+ * first SOS marker in that case, otherwise the buffer is copied as is.
+ *
+ * @param encoded compressed frame
+ * @param output  standalone JPEG, allocated through its own allocator
+ */
+void standalone(const cv::Mat& encoded, cv::Mat& output);
+}  // namespace mjpeg
+}  // namespace camera
+
+NAMESPACE_END
+
+#endif  // LIB_CAMERA_MJPEG_HPP_
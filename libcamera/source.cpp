@@ -0,0 +1,289 @@
+#include "camera.hpp"
+
+#include "source.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+#include <fmt/format.h>
+
+#include "config.hpp"
+
+NAMESPACE_BEGIN
+
+namespace camera {
+static const int MJPG_FOURCC = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+
+CaptureSource::CaptureSource() {}
+
+CaptureSource::~CaptureSource() {}
+
+std::unique_ptr<CaptureSource> CaptureSource::create(const Config* config) {
+  massert(config != nullptr, "sanity");
+
+  switch (config->source()) {
+    case source_t::video:
+      return std::make_unique<VideoSource>(config->path(), config->rate(),
+                                           config->loop());
+    case source_t::directory:
+      return std::make_unique<DirectorySource>(config->path(), config->rate(),
+                                               config->loop());
+    case source_t::device:
+    default:
+      return std::make_unique<DeviceSource>(config->index(),
+                                            config->resolution());
+  }
+}
+
+bool CaptureSource::retrieve_encoded([[maybe_unused]] cv::Mat& encoded) {
+  return false;
+}
+
+bool CaptureSource::enable_passthrough() {
+  return false;
+}
+
+DeviceSource::DeviceSource(int index, cv::Size resolution)
+    : index_{index}, capture_{index, cv::CAP_V4L2} {
+  if (active() && !resolution.empty()) {
+    capture_.set(cv::CAP_PROP_FRAME_WIDTH, resolution.width);
+    capture_.set(cv::CAP_PROP_FRAME_HEIGHT, resolution.height);
+  }
+}
+
+DeviceSource::~DeviceSource() {
+  capture_.release();
+}
+
+bool DeviceSource::grab() {
+  // blocks until the device delivers the next frame
+  return capture_.grab();
+}
+
+bool DeviceSource::retrieve(cv::Mat& image) {
+  if (!capture_.retrieve(image)) {
+    return false;
+  }
+
+  if (image.depth() != CV_8U) {
+    image.convertTo(image, CV_8U, 1.0, 0);
+  }
+
+  return true;
+}
+
+bool DeviceSource::retrieve_encoded(cv::Mat& encoded) {
+  return capture_.retrieve(encoded);
+}
+
+bool DeviceSource::enable_passthrough() {
+  capture_.set(cv::CAP_PROP_FOURCC, MJPG_FOURCC);
+  if (static_cast<int>(capture_.get(cv::CAP_PROP_FOURCC)) != MJPG_FOURCC) {
+    return false;
+  }
+
+  // without conversion the V4L2 backend hands out the driver buffer as is
+  return capture_.set(cv::CAP_PROP_CONVERT_RGB, 0) &&
+         capture_.get(cv::CAP_PROP_CONVERT_RGB) == 0;
+}
+
+cv::Size DeviceSource::resolution() const {
+  return cv::Size(static_cast<int>(capture_.get(cv::CAP_PROP_FRAME_WIDTH)),
+                  static_cast<int>(capture_.get(cv::CAP_PROP_FRAME_HEIGHT)));
+}
+
+std::string DeviceSource::description() const {
+  return fmt::format("camera {}", index_);
+}
+
+ReplaySource::ReplaySource(const std::string& path, double rate, bool loop)
+    : path_{path}, rate_{rate}, loop_{loop}, due_{0}, finished_{false} {}
+
+ReplaySource::~ReplaySource() {}
+
+bool ReplaySource::grab() {
+  if (finished_) {
+    return false;
+  }
+
+  if (!next(false) && !(loop() && next(true))) {
+    LOG_INFO("Replay of {} has finished", path());
+    finished_ = true;
+    return false;
+  }
+
+  pace();
+  return true;
+}
+
+void ReplaySource::pace() {
+  if (rate() <= 0) {
+    return;  // as fast as possible
+  }
+
+  const auto period = static_cast<time_unit>(1000000.0 / rate());
+  const auto now = monotonic_micros();
+
+  if (due_ == 0 || now > due_ + period) {
+    // first frame or the consumer fell behind, restart the schedule instead
+    // of releasing a burst of frames
+    due_ = now;
+  } else if (now < due_) {
+    sleep_for<time_units::micros>(due_ - now);
+  }
+
+  // schedule from the previous due time so the rate does not drift
+  due_ += period;
+}
+
+VideoSource::VideoSource(const std::string& path, double rate, bool loop)
+    : ReplaySource{path, rate, loop},
+      capture_{path, cv::CAP_FFMPEG},
+      raw_{false} {}
+
+VideoSource::~VideoSource() {
+  capture_.release();
+}
+
+bool VideoSource::next(bool rewind) {
+  if (rewind) {
+    capture_.set(cv::CAP_PROP_POS_FRAMES, 0);
+  }
+
+  return capture_.grab();
+}
+
+bool VideoSource::retrieve(cv::Mat& image) {
+  if (!raw_) {
+    return capture_.retrieve(image);
+  }
+
+  if (!capture_.retrieve(packet_)) {
+    return false;
+  }
+
+  // decode into the given buffer so its allocator is kept
+  cv::imdecode(packet_, cv::IMREAD_COLOR, &image);
+  return !image.empty();
+}
+
+bool VideoSource::retrieve_encoded(cv::Mat& encoded) {
+  return raw_ && capture_.retrieve(encoded);
+}
+
+bool VideoSource::enable_passthrough() {
+  // packets are only usable as images when every one of them is a JPEG
+  if (static_cast<int>(capture_.get(cv::CAP_PROP_FOURCC)) != MJPG_FOURCC) {
+    return false;
+  }
+
+  raw_ = capture_.set(cv::CAP_PROP_FORMAT, -1);
+  return raw_;
+}
+
+cv::Size VideoSource::resolution() const {
+  return cv::Size(static_cast<int>(capture_.get(cv::CAP_PROP_FRAME_WIDTH)),
+                  static_cast<int>(capture_.get(cv::CAP_PROP_FRAME_HEIGHT)));
+}
+
+std::string VideoSource::description() const {
+  return fmt::format("video {}", path());
+}
+
+/**
+ * Check whether file is an image by its extension
+ *
+ * @param path file path
+ * @param jpeg only accept JPEG
+ *
+ * @return true if file is an image
+ */
+static bool image_file(const fs::path& path, bool jpeg = false) {
+  auto extension = path.extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+
+  if (extension == ".jpg" || extension == ".jpeg") {
+    return true;
+  }
+
+  return !jpeg && (extension == ".png" || extension == ".bmp" ||
+                   extension == ".tif" || extension == ".tiff" ||
+                   extension == ".webp");
+}
+
+DirectorySource::DirectorySource(const std::string& path,
+                                 double             rate,
+                                 bool               loop)
+    : ReplaySource{path, rate, loop}, position_{0} {
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator(path, ec)) {
+    if (entry.is_regular_file() && image_file(entry.path())) {
+      files_.push_back(entry.path().string());
+    }
+  }
+
+  std::sort(files_.begin(), files_.end());
+
+  if (!files_.empty()) {
+    resolution_ = cv::imread(files_.front(), cv::IMREAD_COLOR).size();
+  }
+}
+
+DirectorySource::~DirectorySource() {}
+
+bool DirectorySource::next(bool rewind) {
+  if (rewind) {
+    position_ = 0;
+  }
+
+  while (position_ < files_.size()) {
+    const auto& file = files_[position_++];
+
+    fs::ifstream stream(file, std::ios::binary | std::ios::ate);
+    auto         size = static_cast<std::streamoff>(stream.tellg());
+    if (!stream || size <= 0) {
+      LOG_WARN("Cannot read {}, skipping", file);
+      continue;
+    }
+
+    content_.create(1, static_cast<int>(size), CV_8U);
+    stream.seekg(0);
+    if (stream.read(reinterpret_cast<char*>(content_.data), size)) {
+      return true;
+    }
+
+    LOG_WARN("Cannot read {}, skipping", file);
+  }
+
+  return false;
+}
+
+bool DirectorySource::retrieve(cv::Mat& image) {
+  // decode into the given buffer so its allocator is kept
+  cv::imdecode(content_, cv::IMREAD_COLOR, &image);
+  return !image.empty();
+}
+
+bool DirectorySource::retrieve_encoded(cv::Mat& encoded) {
+  content_.copyTo(encoded);
+  return !encoded.empty();
+}
+
+bool DirectorySource::enable_passthrough() {
+  return !files_.empty() &&
+         std::all_of(files_.begin(), files_.end(), [](const std::string& f) {
+           return image_file(f, true);
+         });
+}
+
+cv::Size DirectorySource::resolution() const {
+  return resolution_;
+}
+
+std::string DirectorySource::description() const {
+  return fmt::format("directory {} ({} images)", path(), files_.size());
+}
+}  // namespace camera
+
+NAMESPACE_END
@@ -0,0 +1,471 @@
+#ifndef LIB_CAMERA_SOURCE_HPP_
+#define LIB_CAMERA_SOURCE_HPP_
+
+/** @file source.hpp
+ *  @brief Capture source definition
+ *
+ * Capture sources feeding the capture listener
+ */
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv4/opencv2/opencv.hpp>
+
+#include <libcore/core.hpp>
+
+NAMESPACE_BEGIN
+
+namespace camera {
+// forward declaration
+class Config;
+
+/**
+ * Kind of capture source
+ */
+enum class source_t { device, video, directory };
+
+/**
+ * @brief Capture source
+ *
+ * Produces frames for the capture listener, grab() blocks until the next
+ * frame is due, then the frame is fetched either decoded or compressed
+ */
+class CaptureSource {
+ public:
+  /**
+   * CaptureSource constructor
+   */
+  CaptureSource();
+
+  /**
+   * CaptureSource destructor
+   */
+  virtual ~CaptureSource();
+
+  /**
+   * Create capture source from configuration
+   *
+   * @param config camera configuration
+   *
+   * @return capture source, check active() before using it
+   */
+  static std::unique_ptr<CaptureSource> create(const Config* config);
+
+  /**
+   * Source active status
+   *
+   * @return true if frames can be grabbed
+   */
+  virtual bool active() const = 0;
+
+  /**
+   * Wait for the next frame
+   *
+   * @return true if a frame is available
+   */
+  virtual bool grab() = 0;
+
+  /**
+   * Get grabbed frame decoded
+   *
+   * @param image frame destination (BGR)
+   *
+   * @return true if success
+   */
+  virtual bool retrieve(cv::Mat& image) = 0;
+
+  /**
+   * Get grabbed frame as compressed bitstream, only after enable_passthrough()
+   *
+   * @param encoded frame destination (1xN CV_8U)
+   *
+   * @return true if success
+   */
+  virtual bool retrieve_encoded(cv::Mat& encoded);
+
+  /**
+   * Switch source to deliver compressed frames as is
+   *
+   * @return true if source delivers MJPEG/JPEG bitstreams
+   */
+  virtual bool enable_passthrough();
+
+  /**
+   * Get frame resolution
+   *
+   * @return frame size, empty if unknown
+   */
+  virtual cv::Size resolution() const = 0;
+
+  /**
+   * Get human readable source description
+   *
+   * @return source description
+   */
+  virtual std::string description() const = 0;
+};
+
+/**
+ * @brief V4L2 camera
+ */
+class DeviceSource : public CaptureSource {
+ public:
+  /**
+   * DeviceSource constructor
+   *
+   * @param index      camera index
+   * @param resolution requested frame size, empty for the device default
+   */
+  DeviceSource(int index, cv::Size resolution = cv::Size());
+
+  /**
+   * DeviceSource destructor
+   */
+  virtual ~DeviceSource() override;
+
+  /**
+   * Source active status
+   *
+   * @return true if frames can be grabbed
+   */
+  inline virtual bool active() const override { return capture_.isOpened(); }
+
+  /**
+   * Wait for the next frame
+   *
+   * @return true if a frame is available
+   */
+  virtual bool grab() override;
+
+  /**
+   * Get grabbed frame decoded
+   *
+   * @param image frame destination (BGR)
+   *
+   * @return true if success
+   */
+  virtual bool retrieve(cv::Mat& image) override;
+
+  /**
+   * Get grabbed frame as compressed bitstream
+   *
+   * @param encoded frame destination (1xN CV_8U)
+   *
+   * @return true if success
+   */
+  virtual bool retrieve_encoded(cv::Mat& encoded) override;
+
+  /**
+   * Switch source to deliver compressed frames as is
+   *
+   * @return true if source delivers MJPEG/JPEG bitstreams
+   */
+  virtual bool enable_passthrough() override;
+
+  /**
+   * Get frame resolution
+   *
+   * @return frame size, empty if unknown
+   */
+  virtual cv::Size resolution() const override;
+
+  /**
+   * Get human readable source description
+   *
+   * @return source description
+   */
+  virtual std::string description() const override;
+
+ private:
+  /**
+   * Camera index
+   */
+  const int index_;
+  /**
+   * OpenCV capture
+   */
+  cv::VideoCapture capture_;
+};
+
+/**
+ * @brief Recorded input played back at a controlled rate
+ *
+ * Frames are released on a fixed schedule (rate frames per second) or as fast
+ * as the consumer takes them (rate zero), optionally looping at the end
+ */
+class ReplaySource : public CaptureSource {
+ public:
+  /**
+   * ReplaySource constructor
+   *
+   * @param path recording path
+   * @param rate frames per second, zero for as fast as possible
+   * @param loop restart at the end of the recording
+   */
+  ReplaySource(const std::string& path, double rate, bool loop);
+
+  /**
+   * ReplaySource destructor
+   */
+  virtual ~ReplaySource() override;
+
+  /**
+   * Wait for the next frame
+   *
+   * @return true if a frame is available
+   */
+  virtual bool grab() override;
+
+  /**
+   * Get recording path
+   *
+   * @return recording path
+   */
+  inline const std::string& path() const { return path_; }
+
+  /**
+   * Get replay rate
+   *
+   * @return frames per second, zero for as fast as possible
+   */
+  inline double rate() const { return rate_; }
+
+  /**
+   * Get loop status
+   *
+   * @return true if replay restarts at the end
+   */
+  inline bool loop() const { return loop_; }
+
+ protected:
+  /**
+   * Read next frame of the recording
+   *
+   * @param rewind start from the beginning of the recording
+   *
+   * @return true if a frame has been read, false at the end
+   */
+  virtual bool next(bool rewind) = 0;
+
+ private:
+  /**
+   * Wait until the next frame is due
+   */
+  void pace();
+
+ private:
+  /**
+   * Recording path
+   */
+  const std::string path_;
+  /**
+   * Frames per second
+   */
+  const double rate_;
+  /**
+   * Loop status
+   */
+  const bool loop_;
+  /**
+   * Time the next frame is due in microseconds (monotonic)
+   */
+  time_unit due_;
+  /**
+   * End of the recording has been reached
+   */
+  bool finished_;
+};
+
+/**
+ * @brief Video file replay
+ */
+class VideoSource : public ReplaySource {
+ public:
+  /**
+   * VideoSource constructor
+   *
+   * @param path video file path
+   * @param rate frames per second, zero for as fast as possible
+   * @param loop restart at the end of the video
+   */
+  VideoSource(const std::string& path, double rate, bool loop);
+
+  /**
+   * VideoSource destructor
+   */
+  virtual ~VideoSource() override;
+
+  /**
+   * Source active status
+   *
+   * @return true if frames can be grabbed
+   */
+  inline virtual bool active() const override { return capture_.isOpened(); }
+
+  /**
+   * Get grabbed frame decoded
+   *
+   * @param image frame destination (BGR)
+   *
+   * @return true if success
+   */
+  virtual bool retrieve(cv::Mat& image) override;
+
+  /**
+   * Get grabbed frame as compressed bitstream
+   *
+   * @param encoded frame destination (1xN CV_8U)
+   *
+   * @return true if success
+   */
+  virtual bool retrieve_encoded(cv::Mat& encoded) override;
+
+  /**
+   * Switch source to deliver compressed frames as is
+   *
+   * @return true if source delivers MJPEG/JPEG bitstreams
+   */
+  virtual bool enable_passthrough() override;
+
+  /**
+   * Get frame resolution
+   *
+   * @return frame size, empty if unknown
+   */
+  virtual cv::Size resolution() const override;
+
+  /**
+   * Get human readable source description
+   *
+   * @return source description
+   */
+  virtual std::string description() const override;
+
+ protected:
+  /**
+   * Read next frame of the recording
+   *
+   * @param rewind start from the beginning of the recording
+   *
+   * @return true if a frame has been read, false at the end
+   */
+  virtual bool next(bool rewind) override;
+
+ private:
+  /**
+   * OpenCV capture
+   */
+  cv::VideoCapture capture_;
+  /**
+   * Demuxer delivers packets instead of decoded frames
+   */
+  bool raw_;
+  /**
+   * Last packet in raw mode
+   */
+  cv::Mat packet_;
+};
+
+/**
+ * @brief Image directory replay
+ *
+ * Images are played back in file name order
+ */
+class DirectorySource : public ReplaySource {
+ public:
+  /**
+   * DirectorySource constructor
+   *
+   * @param path image directory path
+   * @param rate frames per second, zero for as fast as possible
+   * @param loop restart after the last image
+   */
+  DirectorySource(const std::string& path, double rate, bool loop);
+
+  /**
+   * DirectorySource destructor
+   */
+  virtual ~DirectorySource() override;
+
+  /**
+   * Source active status
+   *
+   * @return true if frames can be grabbed
+   */
+  inline virtual bool active() const override { return !files_.empty(); }
+
+  /**
+   * Get grabbed frame decoded
+   *
+   * @param image frame destination (BGR)
+   *
+   * @return true if success
+   */
+  virtual bool retrieve(cv::Mat& image) override;
+
+  /**
+   * Get grabbed frame as compressed bitstream
+   *
+   * @param encoded frame destination (1xN CV_8U)
+   *
+   * @return true if success
+   */
+  virtual bool retrieve_encoded(cv::Mat& encoded) override;
+
+  /**
+   * Switch source to deliver compressed frames as is
+   *
+   * @return true if source delivers MJPEG/JPEG bitstreams
+   */
+  virtual bool enable_passthrough() override;
+
+  /**
+   * Get frame resolution
+   *
+   * @return frame size, empty if unknown
+   */
+  virtual cv::Size resolution() const override;
+
+  /**
+   * Get human readable source description
+   *
+   * @return source description
+   */
+  virtual std::string description() const override;
+
+ protected:
+  /**
+   * Read next frame of the recording
+   *
+   * @param rewind start from the beginning of the recording
+   *
+   * @return true if a frame has been read, false at the end
+   */
+  virtual bool next(bool rewind) override;
+
+ private:
+  /**
+   * Image files in replay order
+   */
+  std::vector<std::string> files_;
+  /**
+   * Size of the first image
+   */
+  cv::Size resolution_;
+  /**
+   * Index of the next file
+   */
+  std::size_t position_;
+  /**
+   * Content of the current file
+   */
+  cv::Mat content_;
+};
+}  // namespace camera
+
+NAMESPACE_END
+
+#endif  // LIB_CAMERA_SOURCE_HPP_
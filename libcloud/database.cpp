@@ -23,6 +23,79 @@ namespace cloud {
       user=<user> dbname=postgres"
 */
 
+/**
+ * Convert a row of the images table
+ *
+ * @param value row
+ *
+ * @return image object
+ */
+static storage::schema::Image to_image(const tao::pq::row& value) {
+  return {value["id"].as<int>(),
+          value["hash"].as<storage::schema::Hash>(),
+          value["year"].as<long long>(),
+          value["month"].as<long long>(),
+          value["day"].as<long long>(),
+          value["hour"].as<long long>(),
+          value["minute"].as<long long>(),
+          value["second"].as<long long>(),
+          value["sku_card"].as<std::string>(),
+          value["sku_number"].as<std::string>(),
+          value["sku_prod_day"].as<long long>(),
+          value["tray_barcode"].as<long long>(),
+          value["lid_barcode"].as<std::string>(),
+          value["batch_id"].as<long long>(),
+          value["infection"].as<std::string>(),
+          value["views"].as<std::string>(),
+          value["checksum"].as<std::string>(),
+          value["levels"].as<std::string>(),
+          // only listed in the cloud once uploaded
+          storage::schema::UPLOADED,
+          value["extension"].as<std::string>()};
+}
+
+/**
+ * Get PostgreSQL array literal of strings, passed as a single parameter
+ *
+ * @param items strings
+ *
+ * @return array literal, every item quoted
+ */
+static std::string to_array(const std::vector<std::string>& items) {
+  std::string array{"{"};
+  for (const auto& item : items) {
+    array += array.size() > 1 ? ",\"" : "\"";
+    for (auto c : item) {
+      if (c == '"' || c == '\\') {
+        array += '\\';
+      }
+      array += c;
+    }
+    array += '"';
+  }
+  array += '}';
+  return array;
+}
+
+/**
+ * Insert one image
+ *
+ * @param tr    transaction
+ * @param image image metadata
+ */
+template <typename Transaction>
+static void insert_image(const Transaction&            tr,
+                         const storage::schema::Image& image) {
+  const auto taken_at =
+      fmt::format("{}-{}-{} {}:{}:{}-00", image.year, image.month, image.day,
+                  image.hour, image.minute, image.second);
+  tr->execute("insert", image.hash, image.year, image.month, image.day,
+              image.hour, image.minute, image.second, image.sku_card,
+              image.sku_number, image.sku_prod_day, image.tray_barcode,
+              image.lid_barcode, image.batch_id, image.infection_id, taken_at,
+              image.views, image.checksum, image.levels, image.extension);
+}
+
 Database::Database(const Config* config) : active_{false}, config_{config} {
   try {
     prepare_statements();
@@ -61,17 +134,30 @@ void Database::prepare_statements() {
       "insert",
       "INSERT INTO images(hash, year, month, day, hour, minute, second, "
       "sku_card, sku_number, sku_prod_day, tray_barcode, lid_barcode, "
-      "batch_id, infection, taken_at) VALUES ( $1, $2, $3, $4, $5, $6, $7, "
-      "$8, "
-      "$9, $10, $11, $12, $13, $14, $15 )");
+      "batch_id, infection, taken_at, views, checksum, levels, extension) "
+      "VALUES ( $1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13, $14, "
+      "$15, $16, $17, $18, $19 )");
   connection_->prepare("remove", "DELETE FROM images WHERE HASH=$1");
+  connection_->prepare("remove_many",
+                       "DELETE FROM images WHERE HASH = ANY($1::text[])");
   connection_->prepare("exist",
                        "SELECT EXISTS( SELECT 1 FROM IMAGES WHERE HASH=$1) ");
+  connection_->prepare(
+      "exist_checksum",
+      "SELECT EXISTS( SELECT 1 FROM IMAGES WHERE CHECKSUM=$1) ");
+  connection_->prepare(
+      "exist_duplicate",
+      "SELECT EXISTS( SELECT 1 FROM IMAGES WHERE CHECKSUM=$1 AND "
+      "TRAY_BARCODE=$2 AND YEAR=$3 AND MONTH=$4 AND DAY=$5 AND HOUR=$6 AND "
+      "MINUTE=$7 AND SECOND=$8) ");
   connection_->prepare("get", "SELECT * FROM IMAGES WHERE HASH=$1");
+  connection_->prepare("get_many",
+                       "SELECT * FROM images WHERE HASH = ANY($1::text[])");
   connection_->prepare("count",
                        "SELECT 100 * count(*) AS estimate FROM images "
                        "TABLESAMPLE SYSTEM (1);");
   connection_->prepare("first", "SELECT * FROM images LIMIT 1;");
+  connection_->prepare("all", "SELECT * FROM images;");
 }
 
 bool Database::active() {
@@ -100,23 +186,19 @@ storage::schema::Image Database::first() {
     throw std::runtime_error("Cannot get first image");
   }
 
-  auto value = res[0];
+  return to_image(res[0]);
+}
 
-  return {value["id"].as<int>(),
-          value["hash"].as<storage::schema::Hash>(),
-          value["year"].as<long long>(),
-          value["month"].as<long long>(),
-          value["day"].as<long long>(),
-          value["hour"].as<long long>(),
-          value["minute"].as<long long>(),
-          value["second"].as<long long>(),
-          value["sku_card"].as<std::string>(),
-          value["sku_number"].as<std::string>(),
-          value["sku_prod_day"].as<long long>(),
-          value["tray_barcode"].as<long long>(),
-          value["lid_barcode"].as<std::string>(),
-          value["batch_id"].as<long long>(),
-          value["batch_id"].as<std::string>()};
+std::vector<storage::schema::Image> Database::get_all() {
+  connect();
+  auto res = connection_->execute("all");
+
+  std::vector<storage::schema::Image> images;
+  images.reserve(res.size());
+  for (const auto& row : res) {
+    images.push_back(to_image(row));
+  }
+  return images;
 }
 
 storage::schema::Image Database::get(const storage::schema::Hash& hash) {
@@ -127,35 +209,44 @@ storage::schema::Image Database::get(const storage::schema::Hash& hash) {
     throw std::runtime_error(fmt::format("Cannot get image by hash={}", hash));
   }
 
-  auto value = res[0];
+  return to_image(res[0]);
+}
 
-  return {value["id"].as<int>(),
-          value["hash"].as<storage::schema::Hash>(),
-          value["year"].as<long long>(),
-          value["month"].as<long long>(),
-          value["day"].as<long long>(),
-          value["hour"].as<long long>(),
-          value["minute"].as<long long>(),
-          value["second"].as<long long>(),
-          value["sku_card"].as<std::string>(),
-          value["sku_number"].as<std::string>(),
-          value["sku_prod_day"].as<long long>(),
-          value["tray_barcode"].as<long long>(),
-          value["lid_barcode"].as<std::string>(),
-          value["batch_id"].as<long long>(),
-          value["batch_id"].as<std::string>()};
+std::vector<storage::schema::Image> Database::get_many(
+    const std::vector<storage::schema::Hash>& hashes) {
+  if (hashes.empty()) {
+    return {};
+  }
+
+  connect();
+  auto res = connection_->execute("get_many", to_array(hashes));
+
+  std::vector<storage::schema::Image> images;
+  images.reserve(res.size());
+  for (const auto& row : res) {
+    images.push_back(to_image(row));
+  }
+  return images;
 }
 
 void Database::insert(const storage::schema::Image& image) {
   connect();
   const auto tr = connection_->transaction();
-  const auto taken_at =
-      fmt::format("{}-{}-{} {}:{}:{}-00", image.year, image.month, image.day,
-                  image.hour, image.minute, image.second);
-  tr->execute("insert", image.hash, image.year, image.month, image.day,
-              image.hour, image.minute, image.second, image.sku_card,
-              image.sku_number, image.sku_prod_day, image.tray_barcode,
-              image.lid_barcode, image.batch_id, image.infection_id, taken_at);
+  insert_image(tr, image);
+  tr->commit();
+}
+
+void Database::insert_many(const std::vector<storage::schema::Image>& images) {
+  if (images.empty()) {
+    return;
+  }
+
+  connect();
+  // one commit for the whole batch
+  const auto tr = connection_->transaction();
+  for (const auto& image : images) {
+    insert_image(tr, image);
+  }
   tr->commit();
 }
 
@@ -166,6 +257,15 @@ void Database::remove(const storage::schema::Hash& hash) {
   tr->commit();
 }
 
+void Database::remove_many(const std::vector<storage::schema::Hash>& hashes) {
+  if (hashes.empty()) {
+    return;
+  }
+
+  connect();
+  connection_->execute("remove_many", to_array(hashes));
+}
+
 int Database::num_entries() {
   connect();
   auto res = connection_->execute("count");
@@ -182,6 +282,21 @@ bool Database::check(const storage::schema::Hash& hash) {
   auto res = connection_->execute("exist", hash);
   return res.as<bool>();
 }
+
+bool Database::check_checksum(const storage::schema::Checksum& checksum) {
+  connect();
+  auto res = connection_->execute("exist_checksum", checksum);
+  return res.as<bool>();
+}
+
+bool Database::check_duplicate(const storage::schema::Image& image) {
+  connect();
+  auto res = connection_->execute("exist_duplicate", image.checksum,
+                                  image.tray_barcode, image.year, image.month,
+                                  image.day, image.hour, image.minute,
+                                  image.second);
+  return res.as<bool>();
+}
 }  // namespace cloud
 
 NAMESPACE_END
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <tao/pq.hpp>
 
@@ -42,6 +43,13 @@ class Database : public storage::Database {
    */
   virtual storage::schema::Image first() override;
 
+  /**
+   * Get every image
+   *
+   * @return image objects
+   */
+  virtual std::vector<storage::schema::Image> get_all() override;
+
   /**
    * Get image by hash
    *
@@ -52,6 +60,16 @@ class Database : public storage::Database {
   virtual storage::schema::Image get(
       const storage::schema::Hash& hash) override;
 
+  /**
+   * Get images by hash, with one query
+   *
+   * @param hashes image hashes
+   *
+   * @return image objects, missing ones are left out
+   */
+  virtual std::vector<storage::schema::Image> get_many(
+      const std::vector<storage::schema::Hash>& hashes) override;
+
   /**
    * Insert image schema to database
    *
@@ -59,6 +77,14 @@ class Database : public storage::Database {
    */
   virtual void insert(const storage::schema::Image& image) override;
 
+  /**
+   * Insert images to database in one transaction
+   *
+   * @param images image metadata
+   */
+  virtual void insert_many(
+      const std::vector<storage::schema::Image>& images) override;
+
   /**
    * Remove image from database with specified hash
    *
@@ -66,6 +92,14 @@ class Database : public storage::Database {
    */
   virtual void remove(const storage::schema::Hash& hash) override;
 
+  /**
+   * Remove images from database, with one query
+   *
+   * @param hashes image hashes, missing ones are ignored
+   */
+  virtual void remove_many(
+      const std::vector<storage::schema::Hash>& hashes) override;
+
   /**
    * Check whether database empty
    *
@@ -80,6 +114,21 @@ class Database : public storage::Database {
    */
   virtual bool check(const storage::schema::Hash& hash) override;
 
+  /**
+   * Check if image exist by content checksum
+   *
+   * @param checksum checksum of the primary view
+   */
+  virtual bool check_checksum(
+      const storage::schema::Checksum& checksum) override;
+
+  /**
+   * Check if the same tray has been uploaded with the same content
+   *
+   * @param image image object
+   */
+  virtual bool check_duplicate(const storage::schema::Image& image) override;
+
   /**
    * Health check
    *
@@ -2,6 +2,13 @@
 
 #include "listener.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include <libserver/server.hpp>
 #include <libstorage/storage.hpp>
 #include <libutil/util.hpp>
@@ -13,15 +20,24 @@
 NAMESPACE_BEGIN
 
 namespace cloud {
-CloudListener::CloudListener(const Config*      config,
-                             storage::Database* internal_db,
-                             Database*          cloud_db,
-                             Storage*           storage,
-                             bool               autorun)
+/**
+ * Maximum number of images recorded in the databases at once
+ */
+static constexpr std::size_t UPLOAD_BATCH = 32;
+
+CloudListener::CloudListener(const Config*           config,
+                             storage::Database*      internal_db,
+                             Database*               cloud_db,
+                             Storage*                storage,
+                             const storage::Encoder* encoder,
+                             storage::Spool*         spool,
+                             bool                    autorun)
     : config_{config},
       internal_db_{internal_db},
       cloud_db_{cloud_db},
-      storage_{storage} {
+      storage_{storage},
+      encoder_{encoder},
+      spool_{spool} {
   if (autorun) {
     start();
   }
@@ -29,6 +45,7 @@ CloudListener::CloudListener(const Config*      config,
 
 CloudListener::~CloudListener() {
   running_ = false;
+  notify();
   if (thread().joinable()) {
     thread().join();
   }
@@ -48,6 +65,7 @@ void CloudListener::stop() {
   if (running()) {
     LOG_INFO("Stopping cloud listener");
     running_ = false;
+    notify();
     if (thread().joinable()) {
       thread().join();
     }
@@ -55,57 +73,194 @@ void CloudListener::stop() {
   }
 }
 
+void CloudListener::notify() {
+  {
+    Listener::LockGuard lock(wait_mutex());
+  }
+  signal().notify_all();
+}
+
 void CloudListener::execute() {
   massert(State::get() != nullptr, "sanity");
 
+  // doubled by every failed round up to 30s so an unreachable cloud is not
+  // hammered, stop() still interrupts the wait
+  auto backoff = std::chrono::seconds(1);
+  auto retry_later = [this, &backoff] {
+    LOG_WARN("Cannot upload images, retrying in {}s", backoff.count());
+    Listener::Lock lock(wait_mutex());
+    signal().wait_for(lock, backoff, [this] { return !running(); });
+    backoff = std::min(backoff * 2, std::chrono::seconds(30));
+  };
+
   while (running()) {
-    while (running() && internal_db_->empty()) {
-      // check every 1s
-      sleep_for<time_units::seconds>(1);
+    // a counter, checking the backlog costs the same however long it is
+    while (running() && internal_db_->pending_count() == 0) {
+      // woken up as soon as an image is stored, check every 1s regardless
+      Listener::Lock lock(wait_mutex());
+      signal().wait_for(lock, std::chrono::seconds(1), [this] {
+        return !running() || internal_db_->pending_count() > 0;
+      });
     }
 
     if (!running()) {
       break;
     }
 
-    if (!internal_db_->empty()) {
-      // upload to database frequently
-      auto img = internal_db_->first();
+    // oldest first, through the (state, id) index
+    auto pending = internal_db_->peek(UPLOAD_BATCH);
+
+    // recorded in both databases once per batch
+    std::vector<storage::schema::Image> uploaded;
+    // reused by every file of the batch
+    std::vector<std::uint8_t> data;
+    // uploads given up in this batch
+    std::size_t failed = 0;
+    for (auto& img : pending) {
+      if (!running()) {
+        break;
+      }
 
       LOG_DEBUG("Getting {}", img);
 
+      // stored before the extension was recorded, maybe in another format
+      if (img.extension.empty()) {
+        for (const auto& extension : storage::Encoder::extensions()) {
+          if (spool_->exists(storage::schema::file_name(img.hash, extension))) {
+            img.extension = extension;
+            break;
+          }
+        }
+      }
+
+      const auto files = encoder_->file_names(img);
+      const auto content_type = encoder_->content_type(img);
+
+      // only removed behind our back in every format, retrying the upload
+      // would loop forever
+      if (!spool_->exists(files.front())) {
+        LOG_WARN("Image {} has no file, removing database entry", img.hash);
+        internal_db_->remove(img.hash);
+        continue;
+      }
+
+      bool duplicate = false;
+      bool taken = false;
+      try {
+        duplicate = !img.checksum.empty() && cloud_db_->check_duplicate(img);
+        taken = !duplicate && !img.checksum.empty() &&
+                cloud_db_->check(img.hash);
+      } catch (...) {
+        // upload below fails the same way and is retried
+      }
+
+      if (duplicate) {
+        LOG_WARN("Image {} has already been uploaded, discarding", img.hash);
+        internal_db_->remove(img.hash);
+        for (const auto& file : files) {
+          spool_->remove(file);
+        }
+        continue;
+      }
+
+      if (taken) {
+        // another tray with the same hash has been uploaded, keep both
+        auto renamed = img;
+        renamed.hash =
+            fmt::format("{}_{}", img.hash, img.checksum.substr(0, 8));
+        const auto  renamed_files = encoder_->file_names(renamed);
+        std::size_t done = 0;
+        while (done < files.size() &&
+               spool_->rename(files[done], renamed_files[done])) {
+          done += 1;
+        }
+
+        if (done < files.size()) {
+          // being moved out of staging, retried on the next round
+          while (done-- > 0) {
+            spool_->rename(renamed_files[done], files[done]);
+          }
+          continue;
+        }
+
+        LOG_WARN("Image {} is already taken in the cloud, renamed to {}",
+                 img.hash, renamed.hash);
+        internal_db_->insert(renamed);
+        internal_db_->remove(img.hash);
+        continue;
+      }
+
       // always delete if image exists in storage
-      storage_->remove(img.hash);
-
-      if (storage_->insert(img.hash)) {
-        try {
-          cloud_db_->insert(img);
-          internal_db_->remove(img.hash);
-          storage_->update_metadata(img.hash);
-          fs::remove(fmt::format(
-              "{}/{}.jpg", config_->base_config()->images_dir(), img.hash));
-        } catch (...) {
-          storage_->remove(img.hash);
+      for (const auto& file : files) {
+        storage_->remove(file);
+      }
+
+      bool stored = std::all_of(
+          files.begin(), files.end(), [&](const std::string& file) {
+            // a staged file may have just been moved, retried next round
+            return spool_->read(file, data) &&
+                   storage_->insert(data.data(), data.size(), file,
+                                    content_type);
+          });
+
+      if (stored) {
+        // consumers of the cloud table find the files with it
+        img.extension = encoder_->extension(img);
+        uploaded.push_back(img);
+      } else {
+        failed += 1;
+        // do not leave a partial set of views behind
+        for (const auto& file : files) {
+          storage_->remove(file);
         }
       }
+    }
+
+    if (uploaded.empty()) {
+      // duplicates and renames alone made progress, no need to wait
+      if (failed > 0) {
+        retry_later();
+      }
+      continue;
+    }
 
-      // int  retry = 0;
-      // while (!storage_->insert(img.hash) && retry < 10) {
-      //   retry++;
-      //   sleep_for<time_units::millis>(250);
-      // }
-
-      // retry = 0;
-
-      // try {
-      //   cloud_db_->insert(img);
-      //   internal_db_->remove(img.hash);
-      // } catch (...) {
-      //   while (!storage_->remove(img.hash) && retry < 10) {
-      //     retry++;
-      //     sleep_for<time_units::millis>(250);
-      //   }
-      // }
+    try {
+      cloud_db_->insert_many(uploaded);
+    } catch (...) {
+      // the whole batch is uploaded again on the next round
+      for (const auto& img : uploaded) {
+        for (const auto& file : encoder_->file_names(img)) {
+          storage_->remove(file);
+        }
+      }
+      retry_later();
+      continue;
+    }
+    backoff = std::chrono::seconds(1);
+
+    // kept a while to discard the same tray stored again
+    std::vector<int> ids;
+    for (const auto& img : uploaded) {
+      ids.push_back(img.id);
+    }
+
+    bool marked = true;
+    try {
+      internal_db_->mark_uploaded(ids);
+    } catch (const std::exception& e) {
+      // found in the cloud on the next round and discarded there
+      LOG_WARN("Cannot mark {} images as uploaded: {}", ids.size(), e.what());
+      marked = false;
+    }
+
+    for (const auto& img : uploaded) {
+      const auto content_type = encoder_->content_type(img);
+      for (const auto& file : encoder_->file_names(img)) {
+        storage_->update_metadata(file, content_type);
+        if (marked) {
+          spool_->remove(file);
+        }
+      }
     }
   }
 }
@@ -9,6 +9,8 @@ NAMESPACE_BEGIN
 
 namespace storage {
 class Database;
+class Encoder;
+class Spool;
 }
 
 namespace cloud {
@@ -24,13 +26,18 @@ class CloudListener : public Listener {
    * @param config      cloud configuration
    * @param internal_db internal database
    * @param cloud_db    cloud database
+   * @param storage     cloud storage
+   * @param encoder     image encoder, resolves file names and content type
+   * @param spool       image files waiting for upload
    * @param autorun     autorun listener
    */
-  CloudListener(const Config*      config,
-                storage::Database* internal_db,
-                Database*          cloud_db,
-                Storage*           storage,
-                bool               autorun = false);
+  CloudListener(const Config*           config,
+                storage::Database*      internal_db,
+                Database*               cloud_db,
+                Storage*                storage,
+                const storage::Encoder* encoder,
+                storage::Spool*         spool,
+                bool                    autorun = false);
 
   /**
    * CloudListener destructor
@@ -47,6 +54,11 @@ class CloudListener : public Listener {
    */
   virtual void stop() override;
 
+  /**
+   * Wake up cloud listener, e.g. after an image has been stored
+   */
+  void notify();
+
  private:
   /**
    * Execute task
@@ -70,6 +82,14 @@ class CloudListener : public Listener {
    * Cloud storage
    */
   Storage* storage_;
+  /**
+   * Image encoder
+   */
+  const storage::Encoder* encoder_;
+  /**
+   * Image files
+   */
+  storage::Spool* spool_;
 };
 }  // namespace cloud
 
@@ -4,8 +4,6 @@
 
 #include <fmt/format.h>
 
-#include <fstream>
-
 #include "config.hpp"
 
 NAMESPACE_BEGIN
@@ -25,22 +23,22 @@ Storage::Storage(const Config* config)
 
 Storage::~Storage() {}
 
-bool Storage::insert(const storage::schema::Hash& hash) {
-  auto filename =
-      fmt::format("{}/{}.jpg", config_->base_config()->images_dir(), hash);
-  auto obj_name = fmt::format("{}.jpg", hash);
+bool Storage::insert(const std::uint8_t* data,
+                     std::size_t         size,
+                     const std::string&  name,
+                     const std::string&  content_type) {
+  const auto& obj_name = name;
 
-  LOG_DEBUG("Uploading {} to {} in bucket {}", filename, obj_name,
+  LOG_DEBUG("Uploading {} bytes to {} in bucket {}", size, obj_name,
             config_->storage_bucket());
 
-  std::ifstream img(filename, std::ios::binary);
-
   auto stream = client_->WriteObject(
       config_->storage_bucket(), obj_name, gcs::IfGenerationMatch(0),
       gcs::IfMetagenerationMatch(),
       gcs::WithObjectMetadata(
-          gcs::ObjectMetadata().set_content_type("image/jpeg")));
-  stream << img.rdbuf();
+          gcs::ObjectMetadata().set_content_type(content_type)));
+  stream.write(reinterpret_cast<const char*>(data),
+               static_cast<std::streamsize>(size));
   stream.Close();
 
   auto metadata = stream.metadata();
@@ -50,14 +48,14 @@ bool Storage::insert(const storage::schema::Hash& hash) {
     return false;
   }
 
-  LOG_DEBUG("Uploaded {} to object {} in bucket {}", filename, metadata->name(),
+  LOG_DEBUG("Uploaded object {} in bucket {}", metadata->name(),
             metadata->bucket());
 
   return true;
 }
 
-bool Storage::remove(const storage::schema::Hash& hash) {
-  auto obj_name = fmt::format("{}.jpg", hash);
+bool Storage::remove(const std::string& name) {
+  const auto& obj_name = name;
   auto status = client_->DeleteObject(config_->storage_bucket(), obj_name);
 
   if (status.ok()) {
@@ -70,8 +68,9 @@ bool Storage::remove(const storage::schema::Hash& hash) {
   }
 }
 
-void Storage::update_metadata(const storage::schema::Hash& hash) {
-  auto obj_name = fmt::format("{}.jpg", hash);
+void Storage::update_metadata(const std::string& name,
+                              const std::string& content_type) {
+  const auto& obj_name = name;
   auto obj_metadata =
       client_->GetObjectMetadata(config_->storage_bucket(), obj_name);
 
@@ -81,7 +80,7 @@ void Storage::update_metadata(const storage::schema::Hash& hash) {
   }
 
   auto desired = *obj_metadata;
-  desired.set_content_type("image/jpeg");
+  desired.set_content_type(content_type);
 
   auto updated =
       client_->UpdateObject(config_->storage_bucket(), obj_name, desired);
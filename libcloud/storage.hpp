@@ -1,6 +1,8 @@
 #ifndef LIB_CLOUD_STORAGE_HPP_
 #define LIB_CLOUD_STORAGE_HPP_
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -31,25 +33,36 @@ class Storage {
   ~Storage();
 
   /**
-   * Upload image to storage
+   * Upload image file to storage
    *
-   * @param hash image hash
+   * @param data         file content, see storage::Spool::read
+   * @param size         file size
+   * @param name         file name in images directory, see
+   *                     storage::Encoder::file_names
+   * @param content_type MIME type of the file, see storage::Encoder
    */
-  bool insert(const storage::schema::Hash& hash);
+  bool insert(const std::uint8_t* data,
+              std::size_t         size,
+              const std::string&  name,
+              const std::string&  content_type);
 
   /**
-   * Remove image from storage
+   * Remove image file from storage
    *
-   * @param hash image hash
+   * @param name file name in images directory, see
+   *             storage::Encoder::file_names
    */
-  bool remove(const storage::schema::Hash& hash);
+  bool remove(const std::string& name);
 
   /**
    * Update metadata
    *
-   * @param hash image hash
+   * @param name         file name in images directory, see
+   *                     storage::Encoder::file_names
+   * @param content_type MIME type of the file, see storage::Encoder
    */
-  void update_metadata(const storage::schema::Hash& hash);
+  void update_metadata(const std::string& name,
+                       const std::string& content_type);
 
   /**
    * Storage active status
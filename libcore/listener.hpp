@@ -34,11 +34,15 @@ class Listener {
   inline const std::condition_variable& signal() const { return signal_; }
   inline std::condition_variable&       signal() { return signal_; }
 
+  // waits on signal() hold this one, mutex() is held by stop() while joining
+  inline Mutex& wait_mutex() { return wait_mutex_; }
+
  protected:
   std::atomic<bool> running_;
   mutable Mutex           mutex_;
   std::thread thread_;
   std::condition_variable signal_;
+  Mutex                   wait_mutex_;
 };
 
 NAMESPACE_END
@@ -100,12 +100,43 @@ void Config::sort_mapping_info(mapping::info_t& info) {
 
 void Config::load() {
   load_server_info();
+  load_handshake();
   load_data();
 }
 
 void Config::load_server_info() {
   port_ =
       static_cast<std::uint16_t>(base_config()->find<int>("modbus", "port"));
+
+  backend_port_ = 1502;
+  if (base_config()->config().at("modbus").contains("backend-port")) {
+    backend_port_ = static_cast<std::uint16_t>(
+        base_config()->find<int>("modbus", "backend-port"));
+  }
+}
+
+void Config::load_handshake() {
+  done_hold_ = 100;
+  ack_timeout_ = 3000;
+  rearm_hold_ = 0;
+
+  const auto& modbus = base_config()->config().at("modbus");
+  if (!modbus.contains("handshake")) {
+    return;
+  }
+
+  const auto& handshake = modbus.at("handshake");
+  if (handshake.contains("done-hold")) {
+    done_hold_ = toml::find<time_unit>(handshake, "done-hold");
+  }
+
+  if (handshake.contains("ack-timeout")) {
+    ack_timeout_ = toml::find<time_unit>(handshake, "ack-timeout");
+  }
+
+  if (handshake.contains("rearm-hold")) {
+    rearm_hold_ = toml::find<time_unit>(handshake, "rearm-hold");
+  }
 }
 
 void Config::load_data_helper(const char*            key,
@@ -132,6 +132,35 @@ class Config {
    */
   inline std::uint16_t port() const { return port_; }
 
+  /**
+   * Get loopback port of the Modbus server behind the gateway
+   *
+   * @return backend port
+   */
+  inline std::uint16_t backend_port() const { return backend_port_; }
+
+  /**
+   * Get minimum time imaging-done stays raised
+   *
+   * @return done hold time in milliseconds
+   */
+  inline time_unit done_hold() const { return done_hold_; }
+
+  /**
+   * Get maximum time to wait for the PLC to drop imaging-request after
+   * imaging-done
+   *
+   * @return acknowledgement timeout in milliseconds
+   */
+  inline time_unit ack_timeout() const { return ack_timeout_; }
+
+  /**
+   * Get minimum time between dropping imaging-done and raising imaging-ready
+   *
+   * @return rearm hold time in milliseconds
+   */
+  inline time_unit rearm_hold() const { return rearm_hold_; }
+
  private:
   /**
    * Load config
@@ -143,6 +172,11 @@ class Config {
    */
   void load_server_info();
 
+  /**
+   * Load handshake timing
+   */
+  void load_handshake();
+
   /**
    * Load data mapping
    */
@@ -174,6 +208,22 @@ class Config {
    * Server port
    */
   std::uint16_t port_;
+  /**
+   * Loopback port of the Modbus server behind the gateway
+   */
+  std::uint16_t backend_port_;
+  /**
+   * Done hold time in milliseconds
+   */
+  time_unit done_hold_;
+  /**
+   * Acknowledgement timeout in milliseconds
+   */
+  time_unit ack_timeout_;
+  /**
+   * Rearm hold time in milliseconds
+   */
+  time_unit rearm_hold_;
   /**
    * Jetson data
    */
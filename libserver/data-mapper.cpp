@@ -2,7 +2,9 @@
 
 #include "data-mapper.hpp"
 
+#include <algorithm>
 #include <iterator>
+#include <utility>
 
 #include <modbuscpp/modbus.hpp>
 
@@ -11,10 +13,10 @@
 NAMESPACE_BEGIN
 
 namespace server {
-static long long convert_uint16_to_ll(
-    data::type_t                                                    type,
-    const modbus::block::registers::container_type::const_iterator& begin,
-    const modbus::block::registers::container_type::const_iterator& end) {
+template <typename Iterator>
+static long long convert_uint16_to_ll(data::type_t    type,
+                                      const Iterator& begin,
+                                      const Iterator& end) {
   auto diff = std::distance(begin, end);
 
   if (diff == 1 &&
@@ -35,10 +37,112 @@ static long long convert_uint16_to_ll(
   return -1;
 }
 
+/**
+ * Tray field by mapping name
+ */
+using tray_field_t = std::pair<const char*, long long data::tray_t::*>;
+
+/**
+ * Tray fields, same order as DataMapper::tray_meta_
+ */
+static constexpr std::array<tray_field_t, 13> TRAY_MAPPING{{
+    {"year", &data::tray_t::year},
+    {"month", &data::tray_t::month},
+    {"day", &data::tray_t::day},
+    {"hour", &data::tray_t::hour},
+    {"minute", &data::tray_t::minute},
+    {"second", &data::tray_t::second},
+    {"sku-card-instruction", &data::tray_t::sku_card_instruction},
+    {"sku-number", &data::tray_t::sku_number},
+    {"sku-production-day", &data::tray_t::sku_production_day},
+    {"tray-barcode", &data::tray_t::tray_barcode},
+    {"lid-barcode", &data::tray_t::lid_barcode},
+    {"batch-id", &data::tray_t::batch_id},
+    {"infection-id", &data::tray_t::infection_id},
+}};
+
 DataMapper::DataMapper(const Config* config, Slave* slave)
-    : config_{config}, slave_{slave} {}
+    : config_{config}, slave_{slave} {
+  static_assert(TRAY_MAPPING.size() == TRAY_FIELDS, "sanity");
+
+  // resolve names once, tray() only does arithmetic
+  const auto& block = config_->plc_data().meta;
+  const auto  limit = static_cast<std::size_t>(block.starting_address) +
+                     std::min<std::size_t>(block.capacity, MAX_REGISTERS);
+  for (std::size_t i = 0; i < TRAY_FIELDS; ++i) {
+    tray_meta_[i] = data::meta_t{data::type_t::byte, 0, 0};
+
+    for (const auto& [name, meta] : config_->plc_data().info) {
+      if (name != TRAY_MAPPING[i].first) {
+        continue;
+      }
+
+      if (meta.address < block.starting_address ||
+          static_cast<std::size_t>(meta.address) + meta.length > limit) {
+        LOG_WARN("PLC data {} is outside of the first {} registers, ignored",
+                 name, MAX_REGISTERS);
+        break;
+      }
+
+      tray_meta_[i] = meta;
+      tray_meta_[i].address =
+          static_cast<std::uint16_t>(meta.address - block.starting_address);
+      break;
+    }
+  }
+
+  slave_->bind_change(
+      [this]([[maybe_unused]] mapping::alt_type_t type) { notify_all(); });
+}
+
+DataMapper::~DataMapper() {
+  slave_->unbind_change();
+}
+
+DataMapper::Signal& DataMapper::signal() {
+  return signal_;
+}
+
+void DataMapper::notify_one() {
+  {
+    // a waiter is either before its predicate check or asleep, never between
+    std::lock_guard<std::mutex> lock(mutex_);
+  }
+  signal_.notify_one();
+}
+
+void DataMapper::notify_all() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+  }
+  signal_.notify_all();
+}
 
-DataMapper::~DataMapper() {}
+data::tray_t DataMapper::tray() const {
+  const auto& block = config_->plc_data().meta;
+  const auto  count = std::min<std::size_t>(block.capacity, MAX_REGISTERS);
+
+  // on the stack, no allocation
+  std::array<std::uint16_t, MAX_REGISTERS> snapshot;
+  slave_->exclusive([this, &block, count, &snapshot] {
+    auto [begin, end] = slave_->data_table().holding_registers().get(
+        modbus::address_t{block.starting_address},
+        modbus::read_num_regs_t{static_cast<std::uint16_t>(count)});
+    std::copy(begin, end, snapshot.begin());
+  });
+
+  data::tray_t tray;
+  for (std::size_t i = 0; i < TRAY_FIELDS; ++i) {
+    const auto& meta = tray_meta_[i];
+    auto        begin = snapshot.cbegin() + meta.address;
+    tray.*(TRAY_MAPPING[i].second) =
+        meta.length == 0
+            ? -1
+            : convert_uint16_to_ll(meta.type, begin, begin + meta.length);
+  }
+
+  return tray;
+}
 
 long long DataMapper::data(mapping::alt_type_t type,
                            const std::string&  id) const {
@@ -94,8 +198,10 @@ void DataMapper::status(mapping::alt_type_t type,
       break;
     }
     default:
-      break;
+      return;
   }
+
+  notify_all();
 }
 }  // namespace server
 
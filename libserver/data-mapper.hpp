@@ -7,7 +7,12 @@
  * Modbus data mapping from config to data table
  */
 
+#include <array>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
 #include <type_traits>
 
 #include <libcore/core.hpp>
@@ -19,6 +24,27 @@ NAMESPACE_BEGIN
 namespace server {
 class Slave;
 
+namespace data {
+/**
+ * Tray data written by the PLC, -1 for a field missing from the mapping
+ */
+struct tray_t {
+  long long year;
+  long long month;
+  long long day;
+  long long hour;
+  long long minute;
+  long long second;
+  long long sku_card_instruction;
+  long long sku_number;
+  long long sku_production_day;
+  long long tray_barcode;
+  long long lid_barcode;
+  long long batch_id;
+  long long infection_id;
+};
+}  // namespace data
+
 class DataMapper {
  public:
   using Signal = std::condition_variable;
@@ -26,6 +52,9 @@ class DataMapper {
   /**
    * DataMapper constructor
    *
+   * Listeners waiting on the signal are woken up whenever the PLC writes a
+   * new value or a status is set from here
+   *
    * @param config  server config
    * @param slave   server slave
    */
@@ -53,6 +82,35 @@ class DataMapper {
    */
   void notify_all();
 
+  /**
+   * Block until predicate is satisfied, evaluated on every notification
+   *
+   * Whatever makes the predicate true besides a data change (e.g. stopping a
+   * listener) must be followed by notify_all()
+   *
+   * @param predicate condition to wait for
+   */
+  template <typename Predicate>
+  void wait(Predicate predicate) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    signal_.wait(lock, predicate);
+  }
+
+  /**
+   * Block until predicate is satisfied or timeout expires
+   *
+   * @param timeout   timeout in milliseconds
+   * @param predicate condition to wait for
+   *
+   * @return predicate value
+   */
+  template <typename Predicate>
+  bool wait_for(time_unit timeout, Predicate predicate) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return signal_.wait_for(lock, std::chrono::milliseconds(timeout),
+                            predicate);
+  }
+
   /**
    * Get data
    *
@@ -77,6 +135,16 @@ class DataMapper {
     }
   }
 
+  /**
+   * Get every tray field at once
+   *
+   * The whole PLC data block is copied at once while writes of the PLC are
+   * held back, so fields never mix values of two trays
+   *
+   * @return tray data
+   */
+  data::tray_t tray() const;
+
   /**
    * Get status
    *
@@ -108,6 +176,24 @@ class DataMapper {
    * Signal
    */
   Signal signal_;
+  /**
+   * Signal mutex
+   */
+  std::mutex mutex_;
+
+  /**
+   * Maximum number of registers in the PLC data block
+   */
+  static constexpr std::size_t MAX_REGISTERS = 125;
+  /**
+   * Number of tray fields
+   */
+  static constexpr std::size_t TRAY_FIELDS = 13;
+  /**
+   * Tray field metadata, address relative to the block, zero length if
+   * missing
+   */
+  std::array<data::meta_t, TRAY_FIELDS> tray_meta_;
 };
 }  // namespace server
 
@@ -0,0 +1,340 @@
+#include "server.hpp"
+
+#include "gateway.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "logger.hpp"
+
+NAMESPACE_BEGIN
+
+namespace server {
+namespace {
+/**
+ * MBAP header size, unit identifier included
+ */
+constexpr std::size_t HEADER_SIZE = 7;
+
+/**
+ * Big endian word of a frame
+ *
+ * @param frame   frame bytes
+ * @param offset  offset of the high byte
+ *
+ * @return word
+ */
+std::uint16_t word(std::string_view frame, std::size_t offset) {
+  return static_cast<std::uint16_t>(
+      (static_cast<std::uint8_t>(frame[offset]) << 8) |
+      static_cast<std::uint8_t>(frame[offset + 1]));
+}
+
+/**
+ * Visit complete frames of a stream, partial ones are kept for later
+ *
+ * @param buffer  stream bytes not yet visited
+ * @param data    received bytes
+ * @param visit   called with every complete frame
+ */
+template <typename Function>
+void frames(std::string& buffer, std::string_view data, Function&& visit) {
+  buffer.append(data);
+
+  std::size_t offset = 0;
+  while (buffer.size() - offset >= HEADER_SIZE) {
+    // the length counts the unit identifier and the PDU
+    const std::size_t size = 6 + word(buffer, offset + 4);
+    if (size <= HEADER_SIZE) {
+      // nothing to resynchronize on, the server drops such a master anyway
+      buffer.clear();
+      return;
+    }
+    if (buffer.size() - offset < size) {
+      break;
+    }
+
+    visit(std::string_view{buffer}.substr(offset, size));
+    offset += size;
+  }
+  buffer.erase(0, offset);
+}
+
+/**
+ * Whether an address range overlaps a mapping block
+ *
+ * @param meta    mapping block
+ * @param address first address of the range
+ * @param count   number of addresses of the range
+ *
+ * @return true if they overlap
+ */
+bool overlaps(const mapping::meta_t& meta,
+              std::uint16_t          address,
+              std::uint16_t          count) {
+  return address < static_cast<std::size_t>(meta.starting_address) +
+                       meta.capacity &&
+         meta.starting_address < static_cast<std::size_t>(address) + count;
+}
+}  // namespace
+
+struct Gateway::Link {
+  /**
+   * Master session
+   */
+  std::weak_ptr<asio2::tcp_session> session;
+  /**
+   * Connection to the Modbus server
+   */
+  asio2::tcp_client client;
+  /**
+   * Partial request frame
+   */
+  std::string requests;
+  /**
+   * Partial response frame
+   */
+  std::string responses;
+  /**
+   * Writes of the PLC blocks waiting for their response, by transaction id
+   */
+  std::unordered_map<std::uint16_t, mapping::alt_type_t> writes;
+  /**
+   * Writes mutex
+   */
+  std::mutex mutex;
+};
+
+Gateway::Gateway(const Config* config) : config_{config} {
+  server_.bind_connect([this](auto& session) { on_connect(session); });
+  server_.bind_disconnect([this](auto& session) { on_disconnect(session); });
+  server_.bind_recv([this](auto& session, std::string_view data) {
+    on_request(session, data);
+  });
+}
+
+Gateway::~Gateway() {
+  stop();
+}
+
+void Gateway::run(const std::string& host, std::uint16_t port) {
+  if (!server_.start(host, port)) {
+    LOG_ERROR("Cannot accept Modbus masters on {}:{}", host, port);
+  }
+}
+
+void Gateway::stop() {
+  server_.stop();
+
+  std::unordered_map<asio2::tcp_session*, std::shared_ptr<Link>> links;
+  {
+    std::lock_guard<std::mutex> lock(links_mutex_);
+    links.swap(links_);
+  }
+  for (auto& [session, link] : links) {
+    link->client.stop();
+    drop(*link);
+  }
+}
+
+void Gateway::bind_write(write_cb_t callback) {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  massert(!on_write_, "sanity");
+  on_write_ = std::move(callback);
+}
+
+void Gateway::unbind_write() {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  on_write_ = nullptr;
+}
+
+void Gateway::on_connect(std::shared_ptr<asio2::tcp_session>& session) {
+  LOG_INFO(
+      "Modbus master enters [remote_addr={}, remote_port={}, local_addr={}, "
+      "local_port={}]",
+      session->remote_address(), session->remote_port(),
+      session->local_address(), session->local_port());
+
+  auto link = std::make_shared<Link>();
+  link->session = session;
+  link->client.bind_recv(
+      [this, raw = link.get()](std::string_view data) {
+        on_response(*raw, data);
+      });
+
+  // one connection per master keeps transaction ids apart
+  if (!link->client.start("127.0.0.1", config_->backend_port())) {
+    LOG_ERROR("Cannot reach the Modbus server on port {}, dropping master",
+              config_->backend_port());
+    session->stop();
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(links_mutex_);
+  links_.emplace(session.get(), std::move(link));
+}
+
+void Gateway::on_disconnect(std::shared_ptr<asio2::tcp_session>& session) {
+  LOG_INFO(
+      "Modbus master exits [remote_addr={}, remote_port={}, local_addr={}, "
+      "local_port={}]",
+      session->remote_address(), session->remote_port(),
+      session->local_address(), session->local_port());
+
+  std::shared_ptr<Link> link;
+  {
+    std::lock_guard<std::mutex> lock(links_mutex_);
+    auto it = links_.find(session.get());
+    if (it == links_.end()) {
+      return;
+    }
+    link = std::move(it->second);
+    links_.erase(it);
+  }
+  // no response callback runs anymore once the client is stopped
+  link->client.stop();
+  drop(*link);
+}
+
+void Gateway::on_request(std::shared_ptr<asio2::tcp_session>& session,
+                         std::string_view                     data) {
+  std::shared_ptr<Link> link;
+  {
+    std::lock_guard<std::mutex> lock(links_mutex_);
+    auto it = links_.find(session.get());
+    if (it == links_.end()) {
+      return;
+    }
+    link = it->second;
+  }
+
+  frames(link->requests, data, [this, &link](std::string_view frame) {
+    auto type = written(frame);
+    if (!type) {
+      return;
+    }
+
+    // before relaying, a tray snapshot never sees half of a write
+    const bool gated = *type == mapping::alt_type_t::plc_data;
+    if (gated) {
+      begin_write();
+    }
+
+    std::lock_guard<std::mutex> lock(link->mutex);
+    if (!link->writes.emplace(word(frame, 0), *type).second && gated) {
+      // transaction id reused before its response, one count is enough
+      end_write();
+    }
+  });
+
+  // relayed as received, the server does its own framing
+  link->client.send(std::string{data});
+}
+
+void Gateway::on_response(Link& link, std::string_view data) {
+  std::vector<mapping::alt_type_t> applied;
+  frames(link.responses, data, [this, &link, &applied](std::string_view frame) {
+    std::lock_guard<std::mutex> lock(link.mutex);
+    auto it = link.writes.find(word(frame, 0));
+    if (it == link.writes.end()) {
+      return;
+    }
+    // an exception response means nothing has been written
+    if ((static_cast<std::uint8_t>(frame[HEADER_SIZE]) & 0x80) == 0) {
+      applied.push_back(it->second);
+    }
+    if (it->second == mapping::alt_type_t::plc_data) {
+      end_write();
+    }
+    link.writes.erase(it);
+  });
+
+  if (auto session = link.session.lock()) {
+    session->send(std::string{data});
+  }
+
+  if (applied.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  if (!on_write_) {
+    return;
+  }
+  // in the order of the requests, the PLC writes the tray data first
+  for (auto type : applied) {
+    on_write_(type);
+  }
+}
+
+void Gateway::begin_write() {
+  std::unique_lock<std::mutex> lock(gate_mutex_);
+  gate_.wait(lock, [this] { return !reading_; });
+  ++writing_;
+}
+
+void Gateway::end_write(std::size_t count) {
+  std::lock_guard<std::mutex> lock(gate_mutex_);
+  writing_ -= count;
+  gate_.notify_all();
+}
+
+void Gateway::drop(Link& link) {
+  std::lock_guard<std::mutex> lock(link.mutex);
+  const auto count = std::count_if(
+      link.writes.begin(), link.writes.end(), [](const auto& write) {
+        return write.second == mapping::alt_type_t::plc_data;
+      });
+  link.writes.clear();
+  if (count > 0) {
+    end_write(static_cast<std::size_t>(count));
+  }
+}
+
+std::optional<mapping::alt_type_t> Gateway::written(
+    std::string_view frame) const {
+  const auto pdu = frame.substr(HEADER_SIZE);
+  if (pdu.size() < 5) {
+    return std::nullopt;
+  }
+
+  const auto address = word(pdu, 1);
+  switch (static_cast<std::uint8_t>(pdu[0])) {
+    case 0x05:  // write single coil
+      if (overlaps(config_->plc_status().meta, address, 1)) {
+        return mapping::alt_type_t::plc_status;
+      }
+      break;
+    case 0x0F:  // write multiple coils
+      if (overlaps(config_->plc_status().meta, address, word(pdu, 3))) {
+        return mapping::alt_type_t::plc_status;
+      }
+      break;
+    case 0x06:  // write single register
+    case 0x16:  // mask write register
+      if (overlaps(config_->plc_data().meta, address, 1)) {
+        return mapping::alt_type_t::plc_data;
+      }
+      break;
+    case 0x10:  // write multiple registers
+      if (overlaps(config_->plc_data().meta, address, word(pdu, 3))) {
+        return mapping::alt_type_t::plc_data;
+      }
+      break;
+    case 0x17:  // read/write multiple registers
+      if (pdu.size() >= 9 &&
+          overlaps(config_->plc_data().meta, word(pdu, 5), word(pdu, 7))) {
+        return mapping::alt_type_t::plc_data;
+      }
+      break;
+    default:
+      break;
+  }
+
+  return std::nullopt;
+}
+}  // namespace server
+
+NAMESPACE_END
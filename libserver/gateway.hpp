@@ -0,0 +1,220 @@
+#ifndef LIB_SERVER_GATEWAY_HPP_
+#define LIB_SERVER_GATEWAY_HPP_
+
+/** @file gateway.hpp
+ *  @brief Modbus TCP gateway
+ *
+ * Modbus TCP gateway in front of the Modbus slave
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <boost/core/noncopyable.hpp>
+
+#include <asio2/tcp/tcp_client.hpp>
+#include <asio2/tcp/tcp_server.hpp>
+
+#include <libcore/core.hpp>
+
+#include "config.hpp"
+
+NAMESPACE_BEGIN
+
+namespace server {
+/**
+ * Modbus TCP gateway
+ *
+ * The Modbus server has no write hook, so masters connect to the gateway,
+ * which relays every frame to the server on the loopback and reports a
+ * write of the PLC blocks once the server has answered it
+ */
+class Gateway : private boost::noncopyable {
+ public:
+  /**
+   * Write callback type, called with the kind of data written by the PLC
+   */
+  using write_cb_t = std::function<void(mapping::alt_type_t)>;
+
+  /**
+   * Modbus gateway constructor
+   *
+   * @param config    server config
+   */
+  Gateway(const Config* config);
+
+  /**
+   * Modbus gateway destructor
+   */
+  ~Gateway();
+
+  /**
+   * Accept masters
+   *
+   * @param host  listening host
+   * @param port  listening port
+   */
+  void run(const std::string& host, std::uint16_t port);
+
+  /**
+   * Disconnect masters and stop accepting them
+   */
+  void stop();
+
+  /**
+   * Report writes of the PLC blocks (coils and holding registers)
+   *
+   * @param callback called on a network thread once a write is applied
+   */
+  void bind_write(write_cb_t callback);
+
+  /**
+   * Stop reporting writes of the PLC blocks
+   *
+   * The write callback is not running anymore once this returns
+   */
+  void unbind_write();
+
+  /**
+   * Run a function while no write of the PLC data is being applied
+   *
+   * Writes of the PLC data received meanwhile wait for the function
+   *
+   * @param function  reads the PLC data from the data table
+   */
+  template <typename Function>
+  void exclusive(Function&& function) {
+    std::unique_lock<std::mutex> lock(gate_mutex_);
+    gate_.wait(lock, [this] { return !reading_; });
+    // new writes wait from here, the ones already relayed are answered soon
+    reading_ = true;
+    gate_.wait(lock, [this] { return writing_ == 0; });
+    lock.unlock();
+
+    function();
+
+    lock.lock();
+    reading_ = false;
+    gate_.notify_all();
+  }
+
+ private:
+  /**
+   * Master connection and its own connection to the Modbus server
+   */
+  struct Link;
+
+  /**
+   * Connect callback
+   *
+   * @param session master session
+   */
+  void on_connect(std::shared_ptr<asio2::tcp_session>& session);
+
+  /**
+   * Disconnect callback
+   *
+   * @param session master session
+   */
+  void on_disconnect(std::shared_ptr<asio2::tcp_session>& session);
+
+  /**
+   * Relay bytes sent by a master to the Modbus server
+   *
+   * @param session master session
+   * @param data    received bytes
+   */
+  void on_request(std::shared_ptr<asio2::tcp_session>& session,
+                  std::string_view                     data);
+
+  /**
+   * Relay bytes answered by the Modbus server to the master
+   *
+   * @param link  master connection
+   * @param data  received bytes
+   */
+  void on_response(Link& link, std::string_view data);
+
+  /**
+   * Kind of PLC data changed by a write request
+   *
+   * @param frame request frame
+   *
+   * @return plc_status or plc_data, nothing if neither is written
+   */
+  std::optional<mapping::alt_type_t> written(std::string_view frame) const;
+
+  /**
+   * Wait for readers of the PLC data, then count a write in flight
+   */
+  void begin_write();
+
+  /**
+   * Count a write of the PLC data answered or dropped
+   *
+   * @param count number of writes
+   */
+  void end_write(std::size_t count = 1);
+
+  /**
+   * Count writes of the PLC data a link leaves unanswered
+   *
+   * @param link  stopped master connection
+   */
+  void drop(Link& link);
+
+ private:
+  /**
+   * Config pointer
+   */
+  const Config* config_;
+  /**
+   * Server accepting masters
+   */
+  asio2::tcp_server server_;
+  /**
+   * Master connections
+   */
+  std::unordered_map<asio2::tcp_session*, std::shared_ptr<Link>> links_;
+  /**
+   * Master connections mutex
+   */
+  std::mutex links_mutex_;
+  /**
+   * Write callback
+   */
+  write_cb_t on_write_;
+  /**
+   * Write callback mutex
+   */
+  std::mutex write_mutex_;
+  /**
+   * Writes of the PLC data relayed and not answered yet
+   */
+  std::size_t writing_ = 0;
+  /**
+   * Whether the PLC data is being read
+   */
+  bool reading_ = false;
+  /**
+   * Gate between readers and writes of the PLC data
+   */
+  std::condition_variable gate_;
+  /**
+   * Gate mutex
+   */
+  std::mutex gate_mutex_;
+};
+}  // namespace server
+
+NAMESPACE_END
+
+#endif  // LIB_SERVER_GATEWAY_HPP_
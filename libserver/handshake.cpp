@@ -0,0 +1,175 @@
+#include "server.hpp"
+
+#include "handshake.hpp"
+
+#include "config.hpp"
+#include "data-mapper.hpp"
+
+NAMESPACE_BEGIN
+
+namespace server {
+/**
+ * Get state name
+ *
+ * @param state handshake state
+ *
+ * @return state name
+ */
+static const char* state_name(handshake_state_t state) {
+  switch (state) {
+    case handshake_state_t::ready:
+      return "ready";
+    case handshake_state_t::full:
+      return "full";
+    case handshake_state_t::busy:
+      return "busy";
+    case handshake_state_t::done:
+      return "done";
+    case handshake_state_t::rearm:
+      return "rearm";
+    default:
+      return "unknown";
+  }
+}
+
+Handshake::Handshake(const Config* config, DataMapper* data_mapper)
+    : config_{config},
+      data_mapper_{data_mapper},
+      state_{handshake_state_t::rearm},
+      entered_{0},
+      armed_{true} {
+  massert(config != nullptr, "sanity");
+  massert(data_mapper != nullptr, "sanity");
+
+  for (std::size_t i = 0; i < STATES; ++i) {
+    last_[i] = 0;
+    total_[i] = 0;
+    count_[i] = 0;
+  }
+}
+
+Handshake::~Handshake() {}
+
+bool Handshake::requested() const {
+  return data_mapper_->status(mapping::alt_type_t::plc_status,
+                              IMAGING_REQUEST_KEY);
+}
+
+void Handshake::write_status(bool ready, bool done) {
+  data_mapper_->status(mapping::alt_type_t::jetson_status, IMAGING_READY_KEY,
+                       ready);
+  data_mapper_->status(mapping::alt_type_t::jetson_status, IMAGING_DONE_KEY,
+                       done);
+}
+
+void Handshake::enter(handshake_state_t state) {
+  auto now = monotonic_micros();
+
+  // nothing to record before the first state
+  if (entered_ != 0) {
+    auto previous = static_cast<std::size_t>(state_.load());
+    auto elapsed = now - entered_;
+
+    last_[previous] = elapsed;
+    total_[previous] += elapsed;
+    count_[previous] += 1;
+
+    LOG_DEBUG("Handshake {} -> {} after {} us", state_name(state_),
+              state_name(state), elapsed);
+  }
+
+  entered_ = now;
+  state_ = state;
+}
+
+Handshake::Dwell Handshake::dwell(handshake_state_t state) const {
+  auto  index = static_cast<std::size_t>(state);
+  Dwell dwell;
+  dwell.last = last_[index];
+  dwell.total = total_[index];
+  dwell.count = count_[index];
+  return dwell;
+}
+
+bool Handshake::request(const std::atomic<bool>&     running,
+                        const std::function<bool()>& available) {
+  while (true) {
+    // imaging-ready follows the remaining capacity, the PLC only holds trays
+    // back while the pipeline is actually full
+    const bool capacity = !available || available();
+    const auto next =
+        capacity ? handshake_state_t::ready : handshake_state_t::full;
+    if (state() != next) {
+      write_status(capacity, false);
+      enter(next);
+    }
+
+    // a request left raised after an ack timeout belongs to the previous
+    // tray, wait for the PLC to drop it before taking a new one
+    bool taken = false;
+    data_mapper_->wait([this, &running, &available, capacity, &taken] {
+      if (!running) {
+        return true;
+      }
+
+      if (capacity != (!available || available())) {
+        return true;
+      }
+
+      bool raised = requested();
+      if (!raised) {
+        armed_ = true;
+      }
+      taken = capacity && armed_ && raised;
+      return taken;
+    });
+
+    if (!running) {
+      return false;
+    }
+
+    if (taken) {
+      break;
+    }
+  }
+
+  armed_ = false;
+  write_status(false, false);
+  enter(handshake_state_t::busy);
+  return true;
+}
+
+void Handshake::complete(const std::atomic<bool>& running) {
+  write_status(false, true);
+  enter(handshake_state_t::done);
+
+  const auto done_at = monotonic_micros();
+
+  // the PLC acknowledges by dropping the request
+  bool acknowledged = data_mapper_->wait_for(
+      config()->ack_timeout(),
+      [this, &running] { return !running || !requested(); });
+
+  // otherwise the request still raised belongs to this tray
+  armed_ = acknowledged;
+  if (!acknowledged) {
+    LOG_WARN("PLC has not dropped {} within {} ms", IMAGING_REQUEST_KEY,
+             config()->ack_timeout());
+  }
+
+  // let the PLC scan imaging-done at least once
+  auto held = (monotonic_micros() - done_at) / 1000;
+  if (running && held < config()->done_hold()) {
+    sleep_for<time_units::millis>(config()->done_hold() - held);
+  }
+
+  write_status(false, false);
+  enter(handshake_state_t::rearm);
+
+  if (running && config()->rearm_hold() > 0) {
+    sleep_for<time_units::millis>(config()->rearm_hold());
+  }
+}
+}  // namespace server
+
+NAMESPACE_END
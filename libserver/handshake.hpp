@@ -0,0 +1,195 @@
+#ifndef LIB_SERVER_HANDSHAKE_HPP_
+#define LIB_SERVER_HANDSHAKE_HPP_
+
+/** @file handshake.hpp
+ *  @brief Imaging handshake with the PLC
+ *
+ * Imaging handshake state machine
+ */
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include <libcore/core.hpp>
+
+NAMESPACE_BEGIN
+
+namespace server {
+// forward declarations
+class Config;
+class DataMapper;
+
+/**
+ * Handshake states, in order
+ */
+enum class handshake_state_t : std::size_t {
+  full,   // imaging-ready dropped, waiting for capacity
+  ready,  // imaging-ready raised, waiting for imaging-request
+  busy,   // request taken, tray is being imaged
+  done,   // imaging-done raised, waiting for the PLC to drop imaging-request
+  rearm,  // imaging-done dropped, waiting before raising imaging-ready
+};
+
+/**
+ * @brief Imaging handshake with the PLC
+ *
+ *   ready --request--> busy --complete()--> done --request dropped--> rearm
+ *    ^ |                                                                |
+ *    | v                                                                |
+ *   full <--no capacity------------------------------------------------+
+ *
+ * done lasts at least done-hold and at most ack-timeout, rearm lasts
+ * rearm-hold. A request still raised when the ack times out is not taken
+ * again until the PLC drops it.
+ *
+ * Used by a single listener thread, dwell times can be read from any thread
+ */
+class Handshake {
+ public:
+  /**
+   * Time spent in a state
+   */
+  struct Dwell {
+    /**
+     * Last time spent in microseconds
+     */
+    time_unit last = 0;
+    /**
+     * Total time spent in microseconds
+     */
+    time_unit total = 0;
+    /**
+     * Number of times the state has been left
+     */
+    std::uint64_t count = 0;
+  };
+
+  /**
+   * Handshake constructor
+   *
+   * @param config      server config
+   * @param data_mapper data mapper
+   */
+  Handshake(const Config* config, DataMapper* data_mapper);
+
+  /**
+   * Handshake destructor
+   */
+  ~Handshake();
+
+  /**
+   * Raise imaging-ready and block until the PLC requests imaging
+   *
+   * imaging-ready is only raised while there is capacity for another tray,
+   * whoever frees capacity must call DataMapper::notify_all()
+   *
+   * @param running   cleared to give up, followed by
+   *                  DataMapper::notify_all()
+   * @param available capacity check, always available if empty
+   *
+   * @return true if a request has been taken, false if stopped
+   */
+  bool request(const std::atomic<bool>&     running,
+               const std::function<bool()>& available = nullptr);
+
+  /**
+   * Raise imaging-done and wait for the PLC acknowledgement, then get ready
+   * for the next request
+   *
+   * @param running cleared to give up, followed by DataMapper::notify_all()
+   */
+  void complete(const std::atomic<bool>& running);
+
+  /**
+   * Get current state
+   *
+   * @return current state
+   */
+  inline handshake_state_t state() const { return state_; }
+
+  /**
+   * Get time spent in a state
+   *
+   * @param state handshake state
+   *
+   * @return dwell time
+   */
+  Dwell dwell(handshake_state_t state) const;
+
+ private:
+  /**
+   * Enter a state, records dwell time of the previous one
+   *
+   * @param state next state
+   */
+  void enter(handshake_state_t state);
+
+  /**
+   * Check whether imaging-request is raised
+   *
+   * @return imaging-request status
+   */
+  bool requested() const;
+
+  /**
+   * Set imaging-ready and imaging-done
+   *
+   * @param ready imaging-ready status
+   * @param done  imaging-done status
+   */
+  void write_status(bool ready, bool done);
+
+  /**
+   * Get config
+   *
+   * @return server config
+   */
+  inline const Config* config() const { return config_; }
+
+ private:
+  /**
+   * Number of states
+   */
+  static constexpr std::size_t STATES = 5;
+
+  /**
+   * Config
+   */
+  const Config* config_;
+  /**
+   * Data mapper
+   */
+  DataMapper* data_mapper_;
+  /**
+   * Current state
+   */
+  std::atomic<handshake_state_t> state_;
+  /**
+   * Time the current state has been entered
+   */
+  time_unit entered_;
+  /**
+   * Request raised from now on is a new one
+   */
+  bool armed_;
+  /**
+   * Last time spent per state in microseconds
+   */
+  std::array<std::atomic<time_unit>, STATES> last_;
+  /**
+   * Total time spent per state in microseconds
+   */
+  std::array<std::atomic<time_unit>, STATES> total_;
+  /**
+   * Number of times each state has been left
+   */
+  std::array<std::atomic<std::uint64_t>, STATES> count_;
+};
+}  // namespace server
+
+NAMESPACE_END
+
+#endif  // LIB_SERVER_HANDSHAKE_HPP_
@@ -12,6 +12,7 @@
 // 1. STL
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <functional>
@@ -28,6 +29,8 @@
 // 2. Vendor
 // 2.1. ModbusCPP
 #include <asio2/base/timer.hpp>
+#include <asio2/tcp/tcp_client.hpp>
+#include <asio2/tcp/tcp_server.hpp>
 #include <modbuscpp/modbus.hpp>
 
 // 3. Internal Project
@@ -42,10 +45,14 @@
 
 #include "config.hpp"
 
+#include "gateway.hpp"
+
 #include "slave.hpp"
 
 #include "data-mapper.hpp"
 
+#include "handshake.hpp"
+
 #include "data-window.hpp"
 
 #endif  // LIB_SERVER_SERVER_HPP_
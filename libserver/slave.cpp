@@ -4,15 +4,15 @@
 
 #include <chrono>
 #include <ctime>
-#include <functional>
 #include <string>
+#include <utility>
 
 #include "logger.hpp"
 
 NAMESPACE_BEGIN
 
 namespace server {
-Slave::Slave(const Config* config) : config_{config} {
+Slave::Slave(const Config* config) : config_{config}, gateway_{config} {
   init();
 }
 
@@ -21,7 +21,6 @@ Slave::~Slave() {
 }
 
 void Slave::init() {
-  using namespace std::placeholders;
   using namespace std::chrono_literals;
 
   modbus::logger::create<server::internal::Logger>(
@@ -42,8 +41,6 @@ void Slave::init() {
           config_->jetson_data().meta.capacity, 0}});
 
   server_ = modbus::server::create(std::move(data_table));
-  server_->bind_connect(std::bind(&Slave::on_connect, this, _1, _2));
-  server_->bind_disconnect(std::bind(&Slave::on_disconnect, this, _1, _2));
 
   // heartbeat
   timer_.start_timer(1, 780ms, [this]() {
@@ -78,29 +75,23 @@ void Slave::init() {
   });
 }
 
-void Slave::on_connect(modbus::server::session_ptr_t&  session,
-                       [[maybe_unused]] modbus::table& table) {
-  LOG_INFO(
-      "Modbus master enters [remote_addr={}, remote_port={}, local_addr={}, "
-      "local_port={}]",
-      session->remote_address(), session->remote_port(),
-      session->local_address(), session->local_port());
+void Slave::bind_change(change_cb_t callback) {
+  gateway_.bind_write(std::move(callback));
 }
 
-void Slave::on_disconnect(modbus::server::session_ptr_t&  session,
-                          [[maybe_unused]] modbus::table& table) {
-  LOG_INFO(
-      "Modbus master exits [remote_addr={}, remote_port={}, local_addr={}, "
-      "local_port={}]",
-      session->remote_address(), session->remote_port(),
-      session->local_address(), session->local_port());
+void Slave::unbind_change() {
+  gateway_.unbind_write();
 }
 
 void Slave::run() {
-  server_->run("0.0.0.0", std::to_string(config_->port()).c_str());
+  // the server has no write hook, masters go through the gateway which
+  // reports every write of the PLC once the server has applied it
+  server_->run("127.0.0.1", std::to_string(config_->backend_port()).c_str());
+  gateway_.run("0.0.0.0", config_->port());
 }
 
 void Slave::stop() {
+  gateway_.stop();
   server_->stop();
 }
 }  // namespace server
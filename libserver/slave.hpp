@@ -7,6 +7,10 @@
  * Modbus slave
  */
 
+#include <cstdint>
+#include <functional>
+#include <utility>
+
 #include <boost/core/noncopyable.hpp>
 
 #include <asio2/base/timer.hpp>
@@ -15,6 +19,7 @@
 #include <libcore/core.hpp>
 
 #include "config.hpp"
+#include "gateway.hpp"
 
 NAMESPACE_BEGIN
 
@@ -26,6 +31,11 @@ class Slave : private boost::noncopyable {
    */
   using conn_cb_t = modbus::server::conn_cb_t;
 
+  /**
+   * Change callback type, called with the kind of data written by the PLC
+   */
+  using change_cb_t = std::function<void(mapping::alt_type_t)>;
+
   /**
    * Modbus slave wrapper constructor
    *
@@ -48,6 +58,32 @@ class Slave : private boost::noncopyable {
    */
   void stop();
 
+  /**
+   * Watch values written by the PLC (coils and holding registers)
+   *
+   * Must be called once, before the server runs
+   *
+   * @param callback called on a network thread once a write is applied
+   */
+  void bind_change(change_cb_t callback);
+
+  /**
+   * Stop watching values written by the PLC
+   *
+   * The change callback is not running anymore once this returns
+   */
+  void unbind_change();
+
+  /**
+   * Run a function while no write of the PLC data is being applied
+   *
+   * @param function  reads the PLC data from the data table
+   */
+  template <typename Function>
+  void exclusive(Function&& function) {
+    gateway_.exclusive(std::forward<Function>(function));
+  }
+
   /**
    * Get data table
    *
@@ -70,23 +106,6 @@ class Slave : private boost::noncopyable {
    */
   void init();
 
-  /**
-   * Connect callback
-   *
-   * @param session client session
-   * @param table   data table
-   */
-  void on_connect(modbus::server::session_ptr_t& session, modbus::table& table);
-
-  /**
-   * Disconnect callback
-   *
-   * @param session client session
-   * @param table   data table
-   */
-  void on_disconnect(modbus::server::session_ptr_t& session,
-                     modbus::table&                 table);
-
  private:
   /**
    * Config pointer
@@ -96,6 +115,10 @@ class Slave : private boost::noncopyable {
    * Modbus server
    */
   modbus::server::pointer server_;
+  /**
+   * Gateway masters connect to, in front of the Modbus server
+   */
+  Gateway gateway_;
   /**
    * Asio2 timer
    */
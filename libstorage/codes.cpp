@@ -0,0 +1,136 @@
+#include "storage.hpp"
+
+#include "codes.hpp"
+
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+
+#include <fmt/format.h>
+
+NAMESPACE_BEGIN
+
+namespace storage {
+/**
+ * Code and its name
+ */
+using code_entry_t = std::pair<long long, std::string>;
+
+/**
+ * Fill a code table from a table of [codes], or from defaults if missing
+ *
+ * @param table    code table
+ * @param codes    [codes] table, may be null
+ * @param key      key of the table in [codes]
+ * @param defaults codes used when the table is missing
+ */
+static void load_table(CodeTable&                          table,
+                       const toml::value*                  codes,
+                       const char*                         key,
+                       std::initializer_list<code_entry_t> defaults) {
+  if (codes == nullptr || !codes->contains(key)) {
+    for (const auto& [code, name] : defaults) {
+      table.add(code, name);
+    }
+    return;
+  }
+
+  // keys are unordered, names are listed in order of the codes
+  std::vector<code_entry_t> entries;
+  for (const auto& [k, _] : toml::find<toml::table>(*codes, key)) {
+    try {
+      std::size_t end = 0;
+      auto        code = std::stoll(k, &end);
+      if (end != k.size()) {
+        throw std::invalid_argument(k);
+      }
+      entries.emplace_back(code, toml::find<std::string>(*codes, key, k));
+    } catch (const std::logic_error&) {
+      LOG_WARN("Ignoring code {} of [codes.{}], not a number", k, key);
+    }
+  }
+
+  std::sort(entries.begin(), entries.end());
+  for (const auto& [code, name] : entries) {
+    if (!table.add(code, name)) {
+      LOG_WARN("Ignoring code {} of [codes.{}], out of range", code, key);
+    }
+  }
+}
+
+CodeTable::CodeTable(std::string unknown) : unknown_{std::move(unknown)} {}
+
+bool CodeTable::add(long long code, const std::string& name) {
+  if (code < 0 || static_cast<std::size_t>(code) > MAX_CODE) {
+    return false;
+  }
+
+  auto it = std::find(names_.begin(), names_.end(), name);
+  auto position = static_cast<std::int32_t>(it - names_.begin());
+  if (it == names_.end()) {
+    names_.push_back(name);
+  }
+
+  auto index = static_cast<std::size_t>(code);
+  if (index >= index_.size()) {
+    index_.resize(index + 1, -1);
+  }
+  index_[index] = position;
+  return true;
+}
+
+Codes::Codes(const impl::ConfigImpl* config)
+    : sku_card_{"Unknown"},
+      sku_number_{"Unknown"},
+      lid_type_{"UNK"},
+      infection_{"Unknown"} {
+  massert(config != nullptr, "sanity");
+  load(config);
+}
+
+void Codes::load(const impl::ConfigImpl* config) {
+  const toml::value* codes = nullptr;
+  if (config->config().contains("codes")) {
+    codes = &config->config().at("codes");
+  }
+
+  load_table(sku_card_, codes, "sku-card",
+             {{0, "Colonize"},
+              {1, "Tend"},
+              {2, "ExposeFlip"},
+              {3, "FlipNylonFlip"},
+              {4, "TendFlipFlipCompFlip"},
+              {5, "FlipTend"},
+              {8, "HarvestBed"}});
+
+  load_table(sku_number_, codes, "sku-number",
+             {{1, "Eskimo"}, {2, "Tiger"}, {3, "Sapien"}, {99, "Regen"}});
+
+  load_table(lid_type_, codes, "lid-type",
+             {{0, "NO_LID"},
+              {100, "CL:NH"},
+              {101, "CL:HP1"},
+              {102, "CL:HP2"},
+              {103, "CL:HP3"},
+              {201, "GL:HP1"},
+              {202, "GL:HP2"},
+              {203, "GL:HP3"}});
+
+  load_table(infection_, codes, "infection",
+             {{0, "None"},
+              {1, "Blue/Green"},
+              {2, "Black/Brown"},
+              {3, "Metabolite"}});
+}
+
+std::string Codes::lid_barcode(long long barcode) const {
+  if (barcode < 1000000 || barcode > 9999999) {
+    return std::to_string(barcode);
+  }
+
+  return fmt::format("{}-{:04}", lid_type()[barcode / 10000], barcode % 10000);
+}
+}  // namespace storage
+
+NAMESPACE_END
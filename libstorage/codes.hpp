@@ -0,0 +1,177 @@
+#ifndef LIB_STORAGE_CODES_HPP_
+#define LIB_STORAGE_CODES_HPP_
+
+/** @file codes.hpp
+ *  @brief Code tables implementation
+ *
+ * Names of the numeric codes written by the PLC
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libcore/core.hpp>
+
+NAMESPACE_BEGIN
+
+namespace storage {
+/**
+ * @brief Code table
+ *
+ * Maps a numeric code to its name with a flat index, lookup does not
+ * allocate. Every distinct name is stored once
+ */
+class CodeTable {
+ public:
+  /**
+   * Largest code that can be added
+   */
+  static constexpr std::size_t MAX_CODE = 9999;
+
+  /**
+   * Code table constructor
+   *
+   * @param unknown name of codes missing from the table
+   */
+  explicit CodeTable(std::string unknown = "Unknown");
+
+  /**
+   * Add a code, replaces previous name of the same code
+   *
+   * @param code code
+   * @param name name
+   *
+   * @return false if code is out of range
+   */
+  bool add(long long code, const std::string& name);
+
+  /**
+   * Get name of a code
+   *
+   * @param code code
+   *
+   * @return name, unknown name if code is missing
+   */
+  inline std::string_view operator[](long long code) const {
+    if (code < 0 || static_cast<std::size_t>(code) >= index_.size() ||
+        index_[static_cast<std::size_t>(code)] < 0) {
+      return unknown_;
+    }
+    return names_[static_cast<std::size_t>(
+        index_[static_cast<std::size_t>(code)])];
+  }
+
+  /**
+   * Get distinct names, in order of the codes
+   *
+   * @return names, without the unknown name
+   */
+  inline const std::vector<std::string>& names() const { return names_; }
+
+  /**
+   * Get name of codes missing from the table
+   *
+   * @return unknown name
+   */
+  inline const std::string& unknown() const { return unknown_; }
+
+ private:
+  /**
+   * Distinct names
+   */
+  std::vector<std::string> names_;
+  /**
+   * Position of the name of each code, -1 if missing
+   */
+  std::vector<std::int32_t> index_;
+  /**
+   * Unknown name
+   */
+  std::string unknown_;
+};
+
+/**
+ * @brief Code tables
+ *
+ * Loaded once from [codes], new codes only need a config change
+ */
+class Codes {
+ public:
+  /**
+   * Code tables constructor
+   *
+   * @param config base config
+   */
+  Codes(const impl::ConfigImpl* config);
+
+  /**
+   * Get SKU card instructions
+   *
+   * @return code table
+   */
+  inline const CodeTable& sku_card() const { return sku_card_; }
+
+  /**
+   * Get SKU numbers
+   *
+   * @return code table
+   */
+  inline const CodeTable& sku_number() const { return sku_number_; }
+
+  /**
+   * Get lid types, by the first three digits of the lid barcode
+   *
+   * @return code table
+   */
+  inline const CodeTable& lid_type() const { return lid_type_; }
+
+  /**
+   * Get infection types
+   *
+   * @return code table
+   */
+  inline const CodeTable& infection() const { return infection_; }
+
+  /**
+   * Get printable lid barcode
+   *
+   * @param barcode lid barcode, lid type followed by 4 digits lid id
+   *
+   * @return "{lid type}-{lid id}", barcode as is if it is not 7 digits long
+   */
+  std::string lid_barcode(long long barcode) const;
+
+ private:
+  /**
+   * Load code tables
+   *
+   * @param config base config
+   */
+  void load(const impl::ConfigImpl* config);
+
+ private:
+  /**
+   * SKU card instructions
+   */
+  CodeTable sku_card_;
+  /**
+   * SKU numbers
+   */
+  CodeTable sku_number_;
+  /**
+   * Lid types
+   */
+  CodeTable lid_type_;
+  /**
+   * Infection types
+   */
+  CodeTable infection_;
+};
+}  // namespace storage
+
+NAMESPACE_END
+
+#endif  // LIB_STORAGE_CODES_HPP_
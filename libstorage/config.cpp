@@ -0,0 +1,218 @@
+#include "storage.hpp"
+
+#include "config.hpp"
+
+#include <algorithm>
+
+#include <fmt/format.h>
+
+NAMESPACE_BEGIN
+
+namespace storage {
+/**
+ * Find value of a key in a table
+ *
+ * @param table table, may be null
+ * @param key   key
+ * @param value value destination, untouched if key is missing
+ *
+ * @return true if key has been found
+ */
+template <typename T>
+static bool lookup(const toml::value* table, const char* key, T& value) {
+  if (table == nullptr || !table->contains(key)) {
+    return false;
+  }
+
+  value = toml::find<T>(*table, key);
+  return true;
+}
+
+Config::Config(const impl::ConfigImpl* config)
+    : base_config_{config}, codes_{config} {
+  massert(config != nullptr, "sanity");
+  load();
+}
+
+void Config::load() {
+  images_dir_ = base_config()->images_dir();
+
+  const toml::value* storage = nullptr;
+  const toml::value* encoder = nullptr;
+  const toml::value* staging = nullptr;
+  const toml::value* segments = nullptr;
+  const toml::value* trace = nullptr;
+  const toml::value* database = nullptr;
+  if (base_config()->config().contains("storage")) {
+    storage = &base_config()->config().at("storage");
+    if (storage->contains("encoder")) {
+      encoder = &storage->at("encoder");
+    }
+    if (storage->contains("staging")) {
+      staging = &storage->at("staging");
+    }
+    if (storage->contains("segments")) {
+      segments = &storage->at("segments");
+    }
+    if (storage->contains("trace")) {
+      trace = &storage->at("trace");
+    }
+    if (storage->contains("database")) {
+      database = &storage->at("database");
+    }
+  }
+
+  workers_ = 2;
+  lookup(storage, "workers", workers_);
+  workers_ = std::max<std::size_t>(1, workers_);
+
+  queue_ = 4;
+  lookup(storage, "queue", queue_);
+  queue_ = std::max<std::size_t>(1, queue_);
+
+  trays_ = 2;  // one being stored while the next one is taken
+  lookup(storage, "trays", trays_);
+  trays_ = std::max<std::size_t>(1, trays_);
+
+  // the PLC only triggers the next tray once this one is acknowledged, trays
+  // only overlap if that happens before they are written
+  durability_ = durability_t::enqueue;
+  std::string durability;
+  if (lookup(storage, "durability", durability)) {
+    if (durability.compare("write") == 0) {
+      durability_ = durability_t::write;
+    } else if (durability.compare("fsync") == 0) {
+      durability_ = durability_t::fsync;
+    }
+  }
+
+  format_ = format_t::jpeg;
+  std::string format;
+  if (lookup(encoder, "format", format)) {
+    if (format.compare("png") == 0) {
+      format_ = format_t::png;
+    } else if (format.compare("webp") == 0) {
+      format_ = format_t::webp;
+    } else if (format.compare("raw") == 0) {
+      format_ = format_t::raw;
+    }
+  }
+
+  quality_ = 95;  // same as imwrite
+  lookup(encoder, "quality", quality_);
+  quality_ = std::clamp(quality_, 1, 101);
+
+  subsampling_ = subsampling_t::s420;
+  std::string subsampling;
+  if (lookup(encoder, "subsampling", subsampling)) {
+    if (subsampling.compare("444") == 0) {
+      subsampling_ = subsampling_t::s444;
+    } else if (subsampling.compare("422") == 0) {
+      subsampling_ = subsampling_t::s422;
+    }
+  }
+
+  png_level_ = 1;  // same as imwrite
+  lookup(encoder, "png-level", png_level_);
+  png_level_ = std::clamp(png_level_, 0, 9);
+
+  fast_ = true;
+  lookup(encoder, "fast", fast_);
+
+  levels_.clear();  // disabled
+  lookup(encoder, "levels", levels_);
+  // each level is reduced from the previous one
+  std::sort(levels_.begin(), levels_.end());
+  levels_.erase(std::unique(levels_.begin(), levels_.end()), levels_.end());
+  levels_.erase(std::remove_if(levels_.begin(), levels_.end(),
+                               [](std::size_t level) {
+                                 return level < 2 || level > 64;
+                               }),
+                levels_.end());
+
+  staging_dir_.clear();  // disabled
+  lookup(staging, "directory", staging_dir_);
+
+  staging_age_ = 30;
+  lookup(staging, "max-age", staging_age_);
+
+  std::size_t budget = 256;  // MiB
+  lookup(staging, "budget", budget);
+  staging_budget_ = budget * 1024 * 1024;
+
+  segments_ = false;
+  lookup(segments, "enabled", segments_);
+
+  segments_dir_.clear();
+  lookup(segments, "directory", segments_dir_);
+  if (segments_dir_.empty()) {
+    segments_dir_ = fmt::format("{}/segments", images_dir_);
+  }
+
+  std::size_t segment_size = 256;  // MiB
+  lookup(segments, "size", segment_size);
+  segment_size_ =
+      std::clamp<std::size_t>(segment_size, 16, 4096) * 1024 * 1024;
+
+  segments_capacity_ = 65536;
+  lookup(segments, "capacity", segments_capacity_);
+
+  segments_compact_ = 50;
+  lookup(segments, "compact", segments_compact_);
+  segments_compact_ = std::min<std::size_t>(segments_compact_, 90);
+
+  trace_window_ = 256;
+  lookup(trace, "window", trace_window_);
+  trace_window_ = std::max<std::size_t>(1, trace_window_);
+
+  trace_interval_ = 60;
+  lookup(trace, "interval", trace_interval_);
+
+  trace_file_.clear();  // disabled
+  lookup(trace, "file", trace_file_);
+
+  // writers and the upload do not block each other
+  database_journal_ = "wal";
+  std::string journal;
+  if (lookup(database, "journal", journal)) {
+    if (journal.compare("delete") == 0 || journal.compare("truncate") == 0 ||
+        journal.compare("persist") == 0 || journal.compare("memory") == 0 ||
+        journal.compare("off") == 0) {
+      database_journal_ = journal;
+    }
+  }
+
+  // commits do not wait for the disk, an entry lost on power loss only
+  // leaves files removed on the next start
+  database_synchronous_ = "normal";
+  std::string synchronous;
+  if (lookup(database, "synchronous", synchronous)) {
+    if (synchronous.compare("off") == 0 || synchronous.compare("full") == 0 ||
+        synchronous.compare("extra") == 0) {
+      database_synchronous_ = synchronous;
+    }
+  }
+  // acknowledged trays must survive a power loss with their entry
+  if (durability_ == durability_t::fsync &&
+      (database_synchronous_.compare("off") == 0 ||
+       database_synchronous_.compare("normal") == 0)) {
+    database_synchronous_ = "full";
+  }
+
+  std::size_t cache = 8;  // MiB
+  lookup(database, "cache", cache);
+  database_cache_ = std::max<std::size_t>(1, cache) * 1024 * 1024;
+
+  std::size_t mmap = 64;  // MiB
+  lookup(database, "mmap", mmap);
+  database_mmap_ = mmap * 1024 * 1024;
+
+  database_history_ = 1000;
+  lookup(database, "history", database_history_);
+
+  database_readers_ = 2;
+  lookup(database, "readers", database_readers_);
+}
+}  // namespace storage
+
+NAMESPACE_END
@@ -0,0 +1,411 @@
+#ifndef LIB_STORAGE_CONFIG_HPP_
+#define LIB_STORAGE_CONFIG_HPP_
+
+/** @file config.hpp
+ *  @brief Storage config implementation
+ *
+ * Storage config Implementation
+ */
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <libcore/core.hpp>
+
+#include "codes.hpp"
+
+NAMESPACE_BEGIN
+
+namespace storage {
+/**
+ * When a tray is acknowledged to the PLC
+ */
+enum class durability_t {
+  enqueue,  // frames are queued for encoding
+  write,    // files are written and the database entry exists
+  fsync,    // as write, and files are flushed to the disk
+};
+
+/**
+ * Image file format
+ */
+enum class format_t {
+  jpeg,
+  png,
+  webp,
+  raw,  // uncompressed binary PPM/PGM
+};
+
+/**
+ * JPEG chroma subsampling
+ */
+enum class subsampling_t {
+  s444,
+  s422,
+  s420,
+};
+
+class Config {
+ public:
+  /**
+   * Storage specialized configuration
+   *
+   * @param config    base config
+   */
+  Config(const impl::ConfigImpl* config);
+
+  /**
+   * Storage specialized configuration copy constructor
+   */
+  Config(const Config&) = default;
+
+  /**
+   * Get base config pointer
+   *
+   * @return base config pointer
+   */
+  inline const impl::ConfigImpl* base_config() const { return base_config_; }
+
+  /**
+   * Get images directory
+   *
+   * @return images directory
+   */
+  inline const std::string& images_dir() const { return images_dir_; }
+
+  /**
+   * Get number of encoder threads
+   *
+   * @return number of encoder threads
+   */
+  inline std::size_t workers() const { return workers_; }
+
+  /**
+   * Get maximum number of files waiting to be encoded
+   *
+   * @return queue capacity
+   */
+  inline std::size_t queue() const { return queue_; }
+
+  /**
+   * Get maximum number of trays being stored at once
+   *
+   * @return number of trays in flight
+   */
+  inline std::size_t trays() const { return trays_; }
+
+  /**
+   * Get when a tray is acknowledged
+   *
+   * @return durability policy
+   */
+  inline durability_t durability() const { return durability_; }
+
+  /**
+   * Get image file format
+   *
+   * @return image file format
+   */
+  inline format_t format() const { return format_; }
+
+  /**
+   * Get JPEG and WebP quality
+   *
+   * @return quality from 1 to 100, above 100 is lossless WebP
+   */
+  inline int quality() const { return quality_; }
+
+  /**
+   * Get JPEG chroma subsampling
+   *
+   * @return chroma subsampling
+   */
+  inline subsampling_t subsampling() const { return subsampling_; }
+
+  /**
+   * Get PNG compression level
+   *
+   * @return compression level from 0 to 9
+   */
+  inline int png_level() const { return png_level_; }
+
+  /**
+   * Get whether JPEG is encoded with libjpeg-turbo directly when available
+   *
+   * @return true if fast JPEG path is requested
+   */
+  inline bool fast() const { return fast_; }
+
+  /**
+   * Get downscale factors of the reduced copies stored with every view
+   *
+   * @return downscale factors, smallest first, empty if disabled
+   */
+  inline const std::vector<std::size_t>& levels() const { return levels_; }
+
+  /**
+   * Get RAM-backed staging directory
+   *
+   * @return staging directory, empty if staging is disabled
+   */
+  inline const std::string& staging_dir() const { return staging_dir_; }
+
+  /**
+   * Get age after which a staged file is moved to the images directory
+   *
+   * @return age in seconds
+   */
+  inline time_unit staging_age() const { return staging_age_; }
+
+  /**
+   * Get maximum size of the staged files
+   *
+   * @return size in bytes
+   */
+  inline std::size_t staging_budget() const { return staging_budget_; }
+
+  /**
+   * Check whether images are appended to segment files
+   *
+   * @return true if segments are enabled
+   */
+  inline bool segments() const { return segments_; }
+
+  /**
+   * Get directory of the segment files and their index
+   *
+   * @return segments directory
+   */
+  inline const std::string& segments_dir() const { return segments_dir_; }
+
+  /**
+   * Get size of a segment file, allocated when it is created
+   *
+   * @return size in bytes
+   */
+  inline std::size_t segment_size() const { return segment_size_; }
+
+  /**
+   * Get number of images the segment index holds before it grows
+   *
+   * @return number of images
+   */
+  inline std::size_t segments_capacity() const { return segments_capacity_; }
+
+  /**
+   * Get share of a segment still in use below which it is compacted
+   *
+   * @return percentage of the segment size, 0 to only remove unused
+   *         segments
+   */
+  inline std::size_t segments_compact() const { return segments_compact_; }
+
+  /**
+   * Get number of trays the timing percentiles are computed over
+   *
+   * @return number of trays
+   */
+  inline std::size_t trace_window() const { return trace_window_; }
+
+  /**
+   * Get interval between two reports of the tray timings
+   *
+   * @return interval in seconds, 0 if disabled
+   */
+  inline time_unit trace_interval() const { return trace_interval_; }
+
+  /**
+   * Get path of the tray timings stats file
+   *
+   * @return stats file path, empty if disabled
+   */
+  inline const std::string& trace_file() const { return trace_file_; }
+
+  /**
+   * Get SQLite journal mode of the internal database
+   *
+   * @return journal mode, "wal", "delete", "truncate", "persist", "memory"
+   *         or "off"
+   */
+  inline const std::string& database_journal() const {
+    return database_journal_;
+  }
+
+  /**
+   * Get SQLite synchronous level of the internal database
+   *
+   * @return synchronous level, "off", "normal", "full" or "extra"
+   */
+  inline const std::string& database_synchronous() const {
+    return database_synchronous_;
+  }
+
+  /**
+   * Get page cache size of the internal database
+   *
+   * @return size in bytes
+   */
+  inline std::size_t database_cache() const { return database_cache_; }
+
+  /**
+   * Get memory-mapped size of the internal database
+   *
+   * @return size in bytes, 0 if disabled
+   */
+  inline std::size_t database_mmap() const { return database_mmap_; }
+
+  /**
+   * Get number of uploaded images kept in the internal database
+   *
+   * @return number of images
+   */
+  inline std::size_t database_history() const { return database_history_; }
+
+  /**
+   * Get number of read-only connections to the internal database
+   *
+   * @return number of connections, 0 to read through the writer
+   */
+  inline std::size_t database_readers() const { return database_readers_; }
+
+  /**
+   * Get code tables
+   *
+   * @return code tables
+   */
+  inline const Codes& codes() const { return codes_; }
+
+ private:
+  /**
+   * Load config
+   */
+  void load();
+
+ private:
+  /**
+   * Base config pointer
+   */
+  const impl::ConfigImpl* base_config_;
+  /**
+   * Images directory
+   */
+  std::string images_dir_;
+  /**
+   * Number of encoder threads
+   */
+  std::size_t workers_;
+  /**
+   * Queue capacity
+   */
+  std::size_t queue_;
+  /**
+   * Number of trays in flight
+   */
+  std::size_t trays_;
+  /**
+   * Durability policy
+   */
+  durability_t durability_;
+  /**
+   * Image file format
+   */
+  format_t format_;
+  /**
+   * JPEG and WebP quality
+   */
+  int quality_;
+  /**
+   * JPEG chroma subsampling
+   */
+  subsampling_t subsampling_;
+  /**
+   * PNG compression level
+   */
+  int png_level_;
+  /**
+   * Fast JPEG path
+   */
+  bool fast_;
+  /**
+   * Downscale factors
+   */
+  std::vector<std::size_t> levels_;
+  /**
+   * Staging directory
+   */
+  std::string staging_dir_;
+  /**
+   * Staging age in seconds
+   */
+  time_unit staging_age_;
+  /**
+   * Staging budget in bytes
+   */
+  std::size_t staging_budget_;
+  /**
+   * Segments enabled
+   */
+  bool segments_;
+  /**
+   * Segments directory
+   */
+  std::string segments_dir_;
+  /**
+   * Segment size in bytes
+   */
+  std::size_t segment_size_;
+  /**
+   * Initial index capacity
+   */
+  std::size_t segments_capacity_;
+  /**
+   * Compaction threshold in percent
+   */
+  std::size_t segments_compact_;
+  /**
+   * Number of trays in the timing window
+   */
+  std::size_t trace_window_;
+  /**
+   * Report interval in seconds
+   */
+  time_unit trace_interval_;
+  /**
+   * Stats file path
+   */
+  std::string trace_file_;
+  /**
+   * Journal mode
+   */
+  std::string database_journal_;
+  /**
+   * Synchronous level
+   */
+  std::string database_synchronous_;
+  /**
+   * Page cache size in bytes
+   */
+  std::size_t database_cache_;
+  /**
+   * Memory-mapped size in bytes
+   */
+  std::size_t database_mmap_;
+  /**
+   * Number of uploaded images kept
+   */
+  std::size_t database_history_;
+  /**
+   * Number of read-only connections
+   */
+  std::size_t database_readers_;
+  /**
+   * Code tables
+   */
+  Codes codes_;
+};
+}  // namespace storage
+
+NAMESPACE_END
+
+#endif  // LIB_STORAGE_CONFIG_HPP_
@@ -2,11 +2,142 @@
 
 #include "database.hpp"
 
+#include <stdexcept>
+#include <system_error>
+
+#include <fmt/format.h>
+
 #include <libutil/util.hpp>
 
+#include "config.hpp"
+
 NAMESPACE_BEGIN
 
 namespace storage {
+/**
+ * Every column, in the order of schema::Image
+ */
+#define IMAGE_COLUMNS                                                        \
+  "ID, HASH, YEAR, MONTH, DAY, HOUR, MINUTE, SECOND, SKU_CARD, SKU_NUMBER, " \
+  "SKU_PROD_DAY, TRAY_BARCODE, LID_BARCODE, BATCH_ID, INFECTION_ID, VIEWS, " \
+  "CHECKSUM, LEVELS, STATE, EXTENSION"
+
+// states are written literally below
+static_assert(schema::PENDING == 0 && schema::UPLOADED == 1);
+
+/**
+ * SQL of the cached queries, in the order of InternalDatabase::query_t
+ *
+ * Queries by state walk the (STATE, ID) index, their cost does not grow
+ * with the backlog
+ */
+static const char* const QUERY_SQL[] = {
+    "INSERT INTO IMAGES (HASH, YEAR, MONTH, DAY, HOUR, MINUTE, SECOND, "
+    "SKU_CARD, SKU_NUMBER, SKU_PROD_DAY, TRAY_BARCODE, LID_BARCODE, BATCH_ID, "
+    "INFECTION_ID, VIEWS, CHECKSUM, LEVELS, STATE, EXTENSION) "
+    "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    "DELETE FROM IMAGES WHERE HASH = ?",
+    "SELECT STATE FROM IMAGES WHERE HASH = ?",
+    "SELECT " IMAGE_COLUMNS " FROM IMAGES WHERE HASH = ? LIMIT 1",
+    "SELECT " IMAGE_COLUMNS " FROM IMAGES WHERE STATE = 0 ORDER BY ID LIMIT ?",
+    "SELECT " IMAGE_COLUMNS " FROM IMAGES ORDER BY ID",
+    "SELECT 1 FROM IMAGES WHERE HASH = ? LIMIT 1",
+    "SELECT 1 FROM IMAGES WHERE CHECKSUM = ? LIMIT 1",
+    "SELECT 1 FROM IMAGES WHERE CHECKSUM = ? AND TRAY_BARCODE = ? AND "
+    "YEAR = ? AND MONTH = ? AND DAY = ? AND HOUR = ? AND MINUTE = ? AND "
+    "SECOND = ? LIMIT 1",
+    "SELECT COUNT(*) FROM IMAGES",
+    "SELECT COUNT(*) FROM IMAGES WHERE STATE = 0",
+    "UPDATE IMAGES SET STATE = 1 WHERE ID = ? AND STATE = 0",
+    "DELETE FROM IMAGES WHERE STATE = 1 AND ID <= (SELECT ID FROM IMAGES "
+    "WHERE STATE = 1 ORDER BY ID DESC LIMIT 1 OFFSET ?)",
+    "UPDATE IMAGES SET VIEWS = ?, LEVELS = ?, EXTENSION = ? WHERE HASH = ?",
+    "BEGIN IMMEDIATE",
+    "COMMIT",
+    "ROLLBACK",
+};
+
+#undef IMAGE_COLUMNS
+
+/**
+ * Indexes not known to sqlite_orm, created after the schema is synced
+ */
+static constexpr const char* INDEXES =
+    "CREATE INDEX IF NOT EXISTS IMAGES_STATE_IDX ON IMAGES (STATE, ID); "
+    "CREATE INDEX IF NOT EXISTS IMAGES_CHECKSUM_IDX ON IMAGES (CHECKSUM);";
+
+/**
+ * Time a connection waits for a lock held by another one, in milliseconds
+ */
+static constexpr int BUSY_TIMEOUT = 5000;
+
+/**
+ * @brief Statement in use
+ *
+ * Resets the statement once done, a statement left stepping keeps its read
+ * transaction open and holds back WAL checkpoints
+ */
+class StatementGuard {
+ public:
+  explicit StatementGuard(sqlite3_stmt* stmt) : stmt_{stmt} {}
+
+  ~StatementGuard() {
+    sqlite3_reset(stmt_);
+    sqlite3_clear_bindings(stmt_);
+  }
+
+  StatementGuard(const StatementGuard&) = delete;
+  StatementGuard& operator=(const StatementGuard&) = delete;
+
+ private:
+  sqlite3_stmt* stmt_;
+};
+
+/**
+ * Bind a text parameter, the value must outlive the step
+ *
+ * @param stmt  statement
+ * @param index parameter index, from 1
+ * @param value value
+ *
+ * @return result code
+ */
+static int bind(sqlite3_stmt* stmt, int index, const std::string& value) {
+  return sqlite3_bind_text(stmt, index, value.data(),
+                           static_cast<int>(value.size()), SQLITE_STATIC);
+}
+
+/**
+ * Bind an integer parameter
+ *
+ * @param stmt  statement
+ * @param index parameter index, from 1
+ * @param value value
+ *
+ * @return result code
+ */
+static int bind(sqlite3_stmt* stmt, int index, long long value) {
+  return sqlite3_bind_int64(stmt, index, value);
+}
+
+/**
+ * Read a text column
+ *
+ * @param stmt  statement
+ * @param index column index, from 0
+ *
+ * @return value, empty if null
+ */
+static std::string column_text(sqlite3_stmt* stmt, int index) {
+  const auto* text = sqlite3_column_text(stmt, index);
+  if (text == nullptr) {
+    return {};
+  }
+
+  auto size = static_cast<std::size_t>(sqlite3_column_bytes(stmt, index));
+  return std::string{reinterpret_cast<const char*>(text), size};
+}
+
 static Storage init_storage(const std::string& path) {
   using namespace sqlite_orm;
   fs::path p = path;
@@ -33,57 +164,604 @@ static Storage init_storage(const std::string& path) {
           sqlite_orm::make_column("LID_BARCODE", &schema::Image::lid_barcode),
           sqlite_orm::make_column("BATCH_ID", &schema::Image::batch_id),
           sqlite_orm::make_column("INFECTION_ID",
-                                  &schema::Image::infection_id)));
+                                  &schema::Image::infection_id),
+          // added later, the default keeps sync_schema from dropping rows
+          sqlite_orm::make_column("VIEWS", &schema::Image::views,
+                                  default_value(std::string{})),
+          sqlite_orm::make_column("CHECKSUM", &schema::Image::checksum,
+                                  default_value(std::string{})),
+          sqlite_orm::make_column("LEVELS", &schema::Image::levels,
+                                  default_value(std::string{})),
+          // existing rows are waiting for upload
+          sqlite_orm::make_column("STATE", &schema::Image::state,
+                                  default_value(schema::PENDING)),
+          // empty for rows stored before the format was recorded
+          sqlite_orm::make_column("EXTENSION", &schema::Image::extension,
+                                  default_value(std::string{}))));
 }
 
 Database::Database() {}
 
 Database::~Database() {}
 
-InternalDatabase::InternalDatabase(const std::string& path)
-    : path_{std::move(path)}, storage_{init_storage(path)} {
+std::vector<schema::Image> Database::peek(std::size_t count) {
+  if (count == 0 || empty()) {
+    return {};
+  }
+
+  return {first()};
+}
+
+void Database::mark_uploaded(const std::vector<int>& /* ids */) {
+  throw std::logic_error("Database has no upload state");
+}
+
+void Database::update_views(const std::vector<schema::Image>& /* images */) {
+  throw std::logic_error("Database has no upload state");
+}
+
+std::size_t Database::pending_count() {
+  return static_cast<std::size_t>(num_entries());
+}
+
+/**
+ * @brief Reader connection held for one call
+ *
+ * Falls back to the writer connection when there is no reader
+ */
+class InternalDatabase::Reader {
+ public:
+  explicit Reader(InternalDatabase* database)
+      : database_{database}, connection_{nullptr} {
+    if (database->readers_.empty()) {
+      lock_ = std::unique_lock<std::mutex>(database->writer_mutex_);
+      connection_ = &database->writer_;
+    } else {
+      connection_ = database->acquire();
+    }
+  }
+
+  ~Reader() {
+    if (!lock_.owns_lock()) {
+      database_->release(connection_);
+    }
+  }
+
+  Reader(const Reader&) = delete;
+  Reader& operator=(const Reader&) = delete;
+
+  inline Connection& operator*() { return *connection_; }
+
+ private:
+  InternalDatabase*            database_;
+  Connection*                  connection_;
+  std::unique_lock<std::mutex> lock_;
+};
+
+InternalDatabase::InternalDatabase(const std::string& path,
+                                   const Config*      config)
+    : path_{path}, config_{config}, storage_{init_storage(path)}, pending_{0} {
+  massert(config != nullptr, "sanity");
+
+  // the writer connection lives as long as the database, prepared
+  // statements belong to it
+  storage().on_open = [this](sqlite3* db) { configure(db); };
+  storage().open_forever();
   storage().sync_schema();
+
+  // recreated along with the table whenever the schema changes
+  char* error = nullptr;
+  if (sqlite3_exec(writer_.db, INDEXES, nullptr, nullptr, &error) !=
+      SQLITE_OK) {
+    LOG_WARN("Cannot create indexes of {}: {}", path,
+             error != nullptr ? error : "unknown error");
+    sqlite3_free(error);
+  }
+
+  {
+    // counted once, then maintained by every change
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    auto*                       stmt = statement(writer_, query_t::pending);
+    StatementGuard              guard(stmt);
+    if (step(writer_, stmt)) {
+      pending_ = static_cast<std::size_t>(sqlite3_column_int64(stmt, 0));
+    }
+  }
+
+  open_readers();
+}
+
+InternalDatabase::~InternalDatabase() {
+  for (auto& reader : readers_) {
+    finalize(*reader);
+    sqlite3_close(reader->db);
+  }
+
+  // before the storage closes the writer connection
+  finalize(writer_);
+}
+
+void InternalDatabase::configure(sqlite3* db) {
+  writer_.db = db;
+
+  // a reader starting a snapshot may briefly hold a lock, wait for it
+  sqlite3_busy_timeout(db, BUSY_TIMEOUT);
+
+  auto pragmas = fmt::format(
+      "PRAGMA journal_mode={}; PRAGMA synchronous={}; PRAGMA cache_size=-{}; "
+      "PRAGMA mmap_size={};",
+      config()->database_journal(), config()->database_synchronous(),
+      config()->database_cache() / 1024, config()->database_mmap());
+
+  char* error = nullptr;
+  if (sqlite3_exec(db, pragmas.c_str(), nullptr, nullptr, &error) !=
+      SQLITE_OK) {
+    LOG_WARN("Cannot configure database {}: {}", path(),
+             error != nullptr ? error : "unknown error");
+    sqlite3_free(error);
+    return;
+  }
+
+  LOG_INFO("Opened database {}, journal {}, synchronous {}", path(),
+           config()->database_journal(), config()->database_synchronous());
+}
+
+void InternalDatabase::open_readers() {
+  if (config()->database_readers() == 0) {
+    return;
+  }
+
+  // readers would block the writer, or fail, with a rollback journal
+  if (config()->database_journal().compare("wal") != 0) {
+    LOG_INFO("Database {} is not in WAL mode, reading through the writer",
+             path());
+    return;
+  }
+
+  const auto pragmas = fmt::format(
+      "PRAGMA cache_size=-{}; PRAGMA mmap_size={};",
+      config()->database_cache() / 1024, config()->database_mmap());
+
+  for (std::size_t i = 0; i < config()->database_readers(); ++i) {
+    // used by one thread at a time, no need for SQLite to lock
+    auto reader = std::make_unique<Connection>();
+    int  rc = sqlite3_open_v2(path().c_str(), &reader->db,
+                             SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+                             nullptr);
+    if (rc == SQLITE_OK) {
+      sqlite3_busy_timeout(reader->db, BUSY_TIMEOUT);
+      rc = sqlite3_exec(reader->db, pragmas.c_str(), nullptr, nullptr,
+                        nullptr);
+    }
+
+    if (rc != SQLITE_OK) {
+      LOG_WARN("Cannot open reader of {}: {}", path(),
+               reader->db != nullptr ? sqlite3_errmsg(reader->db)
+                                     : sqlite3_errstr(rc));
+      sqlite3_close(reader->db);
+      break;
+    }
+
+    idle_.push_back(reader.get());
+    readers_.push_back(std::move(reader));
+  }
+
+  LOG_INFO("Opened {} readers of {}", readers_.size(), path());
+}
+
+InternalDatabase::Connection* InternalDatabase::acquire() {
+  std::unique_lock<std::mutex> lock(readers_mutex_);
+  reader_released_.wait(lock, [this] { return !idle_.empty(); });
+
+  auto* connection = idle_.back();
+  idle_.pop_back();
+  return connection;
+}
+
+void InternalDatabase::release(Connection* connection) {
+  {
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    idle_.push_back(connection);
+  }
+  reader_released_.notify_one();
+}
+
+sqlite3_stmt* InternalDatabase::statement(Connection& connection,
+                                          query_t     query) {
+  static_assert(sizeof(QUERY_SQL) / sizeof(QUERY_SQL[0]) == QUERIES);
+
+  auto& stmt = connection.statements[static_cast<std::size_t>(query)];
+  if (stmt == nullptr) {
+    const auto* sql = QUERY_SQL[static_cast<std::size_t>(query)];
+    int rc = sqlite3_prepare_v3(connection.db, sql, -1,
+                                SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+      stmt = nullptr;
+      fail(connection, rc);
+    }
+  }
+
+  return stmt;
+}
+
+void InternalDatabase::finalize(Connection& connection) {
+  for (auto*& stmt : connection.statements) {
+    sqlite3_finalize(stmt);
+    stmt = nullptr;
+  }
+}
+
+void InternalDatabase::execute(query_t query) {
+  auto*          stmt = statement(writer_, query);
+  StatementGuard guard(stmt);
+  step(writer_, stmt);
+}
+
+bool InternalDatabase::step(Connection& connection, sqlite3_stmt* stmt) {
+  int rc = sqlite3_step(stmt);
+  if (rc == SQLITE_ROW) {
+    return true;
+  }
+
+  if (rc != SQLITE_DONE) {
+    fail(connection, rc);
+  }
+
+  return false;
+}
+
+void InternalDatabase::fail(const Connection& connection, int rc) {
+  throw std::system_error(
+      std::error_code(rc, sqlite_orm::get_sqlite_error_category()),
+      sqlite3_errmsg(connection.db));
+}
+
+schema::Image InternalDatabase::read(sqlite3_stmt* stmt) {
+  return schema::Image{sqlite3_column_int(stmt, 0),
+                       column_text(stmt, 1),
+                       sqlite3_column_int64(stmt, 2),
+                       sqlite3_column_int64(stmt, 3),
+                       sqlite3_column_int64(stmt, 4),
+                       sqlite3_column_int64(stmt, 5),
+                       sqlite3_column_int64(stmt, 6),
+                       sqlite3_column_int64(stmt, 7),
+                       column_text(stmt, 8),
+                       column_text(stmt, 9),
+                       sqlite3_column_int64(stmt, 10),
+                       sqlite3_column_int64(stmt, 11),
+                       column_text(stmt, 12),
+                       sqlite3_column_int64(stmt, 13),
+                       column_text(stmt, 14),
+                       column_text(stmt, 15),
+                       column_text(stmt, 16),
+                       column_text(stmt, 17),
+                       sqlite3_column_int(stmt, 18),
+                       column_text(stmt, 19)};
+}
+
+template <typename Function>
+void InternalDatabase::transaction(Function&& function) {
+  execute(query_t::begin);
+  try {
+    function();
+    execute(query_t::commit);
+  } catch (...) {
+    try {
+      execute(query_t::rollback);
+    } catch (...) {
+      // already rolled back by SQLite
+    }
+    throw;
+  }
 }
 
-InternalDatabase::~InternalDatabase() {}
+bool InternalDatabase::get_row(Connection&         connection,
+                               const schema::Hash& hash,
+                               schema::Image&      image) {
+  auto*          stmt = statement(connection, query_t::get);
+  StatementGuard guard(stmt);
+
+  if (bind(stmt, 1, hash) != SQLITE_OK) {
+    fail(connection, sqlite3_errcode(connection.db));
+  }
+
+  if (!step(connection, stmt)) {
+    return false;
+  }
+
+  image = read(stmt);
+  return true;
+}
 
 schema::Image InternalDatabase::get(const schema::Hash& hash) {
-  using namespace sqlite_orm;
-  auto images = storage().select(&schema::Image::id,
-                                 where(is_equal(&schema::Image::hash, hash)));
-  return storage().get<schema::Image>(images[0]);
+  Reader reader(this);
+
+  schema::Image image;
+  if (!get_row(*reader, hash, image)) {
+    throw std::runtime_error(fmt::format("Image {} does not exist", hash));
+  }
+
+  return image;
+}
+
+std::vector<schema::Image> InternalDatabase::get_many(
+    const std::vector<schema::Hash>& hashes) {
+  Reader reader(this);
+
+  std::vector<schema::Image> images;
+  images.reserve(hashes.size());
+
+  schema::Image image;
+  for (const auto& hash : hashes) {
+    if (get_row(*reader, hash, image)) {
+      images.push_back(std::move(image));
+    }
+  }
+
+  return images;
+}
+
+bool InternalDatabase::insert_row(const schema::Image& image) {
+  auto*          stmt = statement(writer_, query_t::insert);
+  StatementGuard guard(stmt);
+
+  int  rc = SQLITE_OK;
+  int  index = 0;
+  auto next = [stmt, &rc, &index](const auto& value) {
+    if (rc == SQLITE_OK) {
+      rc = bind(stmt, ++index, value);
+    }
+  };
+
+  next(image.hash);
+  next(image.year);
+  next(image.month);
+  next(image.day);
+  next(image.hour);
+  next(image.minute);
+  next(image.second);
+  next(image.sku_card);
+  next(image.sku_number);
+  next(image.sku_prod_day);
+  next(image.tray_barcode);
+  next(image.lid_barcode);
+  next(image.batch_id);
+  next(image.infection_id);
+  next(image.views);
+  next(image.checksum);
+  next(image.levels);
+  next(static_cast<long long>(image.state));
+  next(image.extension);
+
+  if (rc != SQLITE_OK) {
+    fail(writer_, rc);
+  }
+
+  step(writer_, stmt);
+  return image.state == schema::PENDING;
 }
 
 void InternalDatabase::insert(const schema::Image& image) {
-  storage().insert(image);
+  std::lock_guard<std::mutex> lock(writer_mutex_);
+  if (insert_row(image)) {
+    pending_ += 1;
+  }
 }
 
-schema::Image InternalDatabase::first() {
-  using namespace sqlite_orm;
-  auto users = storage().get_all<schema::Image>(limit(1));
-  return users.front();
+void InternalDatabase::insert_many(const std::vector<schema::Image>& images) {
+  if (images.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(writer_mutex_);
+
+  // one commit, and one disk flush, for the whole batch
+  std::size_t pending = 0;
+  transaction([this, &images, &pending] {
+    for (const auto& image : images) {
+      pending += insert_row(image) ? 1 : 0;
+    }
+  });
+
+  pending_ += pending;
+}
+
+bool InternalDatabase::remove_row(const schema::Hash& hash) {
+  // the counter only follows images waiting for upload
+  bool pending = false;
+  {
+    auto*          stmt = statement(writer_, query_t::state);
+    StatementGuard guard(stmt);
+    if (bind(stmt, 1, hash) != SQLITE_OK) {
+      fail(writer_, sqlite3_errcode(writer_.db));
+    }
+    pending = step(writer_, stmt) &&
+              sqlite3_column_int(stmt, 0) == schema::PENDING;
+  }
+
+  auto*          stmt = statement(writer_, query_t::remove);
+  StatementGuard guard(stmt);
+
+  if (bind(stmt, 1, hash) != SQLITE_OK) {
+    fail(writer_, sqlite3_errcode(writer_.db));
+  }
+
+  step(writer_, stmt);
+  return pending && sqlite3_changes(writer_.db) > 0;
 }
 
 void InternalDatabase::remove(const schema::Hash& hash) {
-  using namespace sqlite_orm;
-  storage().remove_all<schema::Image>(
-      where(is_equal(&schema::Image::hash, hash)));
+  std::lock_guard<std::mutex> lock(writer_mutex_);
+  if (remove_row(hash)) {
+    pending_ -= 1;
+  }
+}
+
+void InternalDatabase::remove_many(const std::vector<schema::Hash>& hashes) {
+  if (hashes.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(writer_mutex_);
+
+  std::size_t pending = 0;
+  transaction([this, &hashes, &pending] {
+    for (const auto& hash : hashes) {
+      pending += remove_row(hash) ? 1 : 0;
+    }
+  });
+
+  pending_ -= pending;
+}
+
+schema::Image InternalDatabase::first() {
+  auto images = peek(1);
+  if (images.empty()) {
+    throw std::runtime_error("No image is waiting for upload");
+  }
+
+  return images.front();
+}
+
+std::vector<schema::Image> InternalDatabase::peek(std::size_t count) {
+  Reader reader(this);
+  auto*  stmt = statement(*reader, query_t::peek);
+
+  StatementGuard guard(stmt);
+  if (bind(stmt, 1, static_cast<long long>(count)) != SQLITE_OK) {
+    fail(*reader, sqlite3_errcode((*reader).db));
+  }
+
+  std::vector<schema::Image> images;
+  while (step(*reader, stmt)) {
+    images.push_back(read(stmt));
+  }
+
+  return images;
+}
+
+void InternalDatabase::mark_uploaded(const std::vector<int>& ids) {
+  if (ids.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(writer_mutex_);
+
+  // one commit for every image
+  std::size_t marked = 0;
+  transaction([this, &ids, &marked] {
+    for (auto id : ids) {
+      auto*          stmt = statement(writer_, query_t::mark);
+      StatementGuard guard(stmt);
+      if (bind(stmt, 1, static_cast<long long>(id)) != SQLITE_OK) {
+        fail(writer_, sqlite3_errcode(writer_.db));
+      }
+      step(writer_, stmt);
+      marked += static_cast<std::size_t>(sqlite3_changes(writer_.db));
+    }
+
+    auto*          stmt = statement(writer_, query_t::prune);
+    StatementGuard guard(stmt);
+    auto history = static_cast<long long>(config()->database_history());
+    if (bind(stmt, 1, history) != SQLITE_OK) {
+      fail(writer_, sqlite3_errcode(writer_.db));
+    }
+    step(writer_, stmt);
+  });
+
+  pending_ -= marked;
+}
+
+void InternalDatabase::update_views(const std::vector<schema::Image>& images) {
+  if (images.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(writer_mutex_);
+
+  // rows keep their id, and their place in the upload queue
+  transaction([this, &images] {
+    for (const auto& image : images) {
+      auto*          stmt = statement(writer_, query_t::update);
+      StatementGuard guard(stmt);
+      if (bind(stmt, 1, image.views) != SQLITE_OK ||
+          bind(stmt, 2, image.levels) != SQLITE_OK ||
+          bind(stmt, 3, image.extension) != SQLITE_OK ||
+          bind(stmt, 4, image.hash) != SQLITE_OK) {
+        fail(writer_, sqlite3_errcode(writer_.db));
+      }
+      step(writer_, stmt);
+    }
+  });
+}
+
+std::vector<schema::Image> InternalDatabase::get_all() {
+  Reader         reader(this);
+  auto*          stmt = statement(*reader, query_t::all);
+  StatementGuard guard(stmt);
+
+  std::vector<schema::Image> images;
+  while (step(*reader, stmt)) {
+    images.push_back(read(stmt));
+  }
+
+  return images;
 }
 
 int InternalDatabase::num_entries() {
-  return storage().count<schema::Image>();
+  Reader         reader(this);
+  auto*          stmt = statement(*reader, query_t::count);
+  StatementGuard guard(stmt);
+
+  return step(*reader, stmt) ? sqlite3_column_int(stmt, 0) : 0;
 }
 
 bool InternalDatabase::empty() {
-  return num_entries() == 0;
+  // polled by the upload, answered without a query
+  return pending_count() == 0;
 }
 
 bool InternalDatabase::check(const storage::schema::Hash& hash) {
-  using namespace sqlite_orm;
-  auto images = storage().select(&schema::Image::hash,
-                                 where(is_equal(&schema::Image::hash, hash)));
+  Reader         reader(this);
+  auto*          stmt = statement(*reader, query_t::check);
+  StatementGuard guard(stmt);
+
+  if (bind(stmt, 1, hash) != SQLITE_OK) {
+    fail(*reader, sqlite3_errcode((*reader).db));
+  }
+
+  return step(*reader, stmt);
+}
+
+bool InternalDatabase::check_checksum(const schema::Checksum& checksum) {
+  Reader         reader(this);
+  auto*          stmt = statement(*reader, query_t::check_checksum);
+  StatementGuard guard(stmt);
+
+  if (bind(stmt, 1, checksum) != SQLITE_OK) {
+    fail(*reader, sqlite3_errcode((*reader).db));
+  }
+
+  return step(*reader, stmt);
+}
+
+bool InternalDatabase::check_duplicate(const schema::Image& image) {
+  Reader         reader(this);
+  auto*          stmt = statement(*reader, query_t::duplicate);
+  StatementGuard guard(stmt);
+
+  if (bind(stmt, 1, image.checksum) != SQLITE_OK ||
+      bind(stmt, 2, image.tray_barcode) != SQLITE_OK ||
+      bind(stmt, 3, image.year) != SQLITE_OK ||
+      bind(stmt, 4, image.month) != SQLITE_OK ||
+      bind(stmt, 5, image.day) != SQLITE_OK ||
+      bind(stmt, 6, image.hour) != SQLITE_OK ||
+      bind(stmt, 7, image.minute) != SQLITE_OK ||
+      bind(stmt, 8, image.second) != SQLITE_OK) {
+    fail(*reader, sqlite3_errcode((*reader).db));
+  }
 
-  return images.size() == 1;
+  return step(*reader, stmt);
 }
 }  // namespace storage
 
@@ -1,9 +1,15 @@
 #ifndef LIB_STORAGE_DATABASE_HPP_
 #define LIB_STORAGE_DATABASE_HPP_
 
+#include <array>
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <sqlite3.h>
 #include <sqlite_orm/sqlite_orm.h>
@@ -15,6 +21,9 @@
 NAMESPACE_BEGIN
 
 namespace storage {
+// forward declarations
+class Config;
+
 class Database {
  public:
   /**
@@ -34,6 +43,13 @@ class Database {
    */
   virtual void insert(const schema::Image& image) = 0;
 
+  /**
+   * Insert images to database at once, all or none
+   *
+   * @param images image metadata
+   */
+  virtual void insert_many(const std::vector<schema::Image>& images) = 0;
+
   /**
    * Remove image from database with specified hash
    *
@@ -41,6 +57,13 @@ class Database {
    */
   virtual void remove(const schema::Hash& hash) = 0;
 
+  /**
+   * Remove images from database at once, all or none
+   *
+   * @param hashes image hashes, missing ones are ignored
+   */
+  virtual void remove_many(const std::vector<schema::Hash>& hashes) = 0;
+
   /**
    * Get image by hash
    *
@@ -61,6 +84,16 @@ class Database {
    */
   virtual schema::Image get(const schema::Hash& hash) = 0;
 
+  /**
+   * Get images by hash
+   *
+   * @param hashes image hashes
+   *
+   * @return image objects, missing ones are left out
+   */
+  virtual std::vector<schema::Image> get_many(
+      const std::vector<schema::Hash>& hashes) = 0;
+
   /**
    * Get first image
    *
@@ -68,6 +101,13 @@ class Database {
    */
   virtual schema::Image first() = 0;
 
+  /**
+   * Get every image
+   *
+   * @return image objects
+   */
+  virtual std::vector<schema::Image> get_all() = 0;
+
   /**
    * Check if image exist by hash
    *
@@ -77,6 +117,27 @@ class Database {
    */
   virtual bool check(const schema::Hash& hash) = 0;
 
+  /**
+   * Check if image exist by content checksum
+   *
+   * @param checksum checksum of the primary view
+   *
+   * @return true if an image with the same content exists
+   */
+  virtual bool check_checksum(const schema::Checksum& checksum) = 0;
+
+  /**
+   * Check if the same tray has been stored with the same content
+   *
+   * A stalled camera gives different trays the same frame, only the same
+   * checksum, tray barcode and time make a duplicate
+   *
+   * @param image image object
+   *
+   * @return true if a duplicate of image exists
+   */
+  virtual bool check_duplicate(const schema::Image& image) = 0;
+
   /**
    * Check whether database empty
    *
@@ -91,6 +152,46 @@ class Database {
    */
   virtual int num_entries() = 0;
 
+  /**
+   * Get oldest images waiting for upload, in insertion order
+   *
+   * Defaults to the first image, for databases without an upload state
+   *
+   * @param count maximum number of images
+   *
+   * @return image objects
+   */
+  virtual std::vector<schema::Image> peek(std::size_t count);
+
+  /**
+   * Mark images as uploaded, they are not returned by peek() anymore
+   *
+   * Not supported by databases without an upload state
+   *
+   * @param ids image ids
+   */
+  virtual void mark_uploaded(const std::vector<int>& ids);
+
+  /**
+   * Update the views, reduced copies and extension listed by images,
+   * keeping their place in the upload queue
+   *
+   * Not supported by databases without an upload state
+   *
+   * @param images image objects, found by hash
+   */
+  virtual void update_views(const std::vector<schema::Image>& images);
+
+  /**
+   * Get number of images waiting for upload
+   *
+   * Defaults to the number of entries, for databases without an upload
+   * state
+   *
+   * @return number of images
+   */
+  virtual std::size_t pending_count();
+
   /**
    * Check whether database is active or not
    *
@@ -99,14 +200,34 @@ class Database {
   inline virtual bool active() { return true; }
 };
 
+/**
+ * @brief SQLite database of the images waiting for upload
+ *
+ * Connections are kept open for the lifetime of the database and tuned by
+ * [storage.database]:
+ *
+ *   - one writer connection, changes are serialized by a mutex
+ *   - a small pool of read-only connections, each used by one thread at a
+ *     time, with WAL journal only
+ *
+ * In WAL mode readers see the last commit and never wait for the writer,
+ * the uploader and tools reading the database do not delay a tray insert.
+ * Without readers every query goes through the writer connection.
+ *
+ * Frequent queries are prepared once per connection and reused, the schema
+ * is kept up to date by sqlite_orm.
+ *
+ * Safe to use from several threads at once
+ */
 class InternalDatabase : public Database {
  public:
   /**
    * Database constructor
    *
-   * @param path database path
+   * @param path   database path
+   * @param config storage configuration
    */
-  InternalDatabase(const std::string& path);
+  InternalDatabase(const std::string& path, const Config* config);
 
   /**
    * Database destructor
@@ -121,12 +242,19 @@ class InternalDatabase : public Database {
   virtual int num_entries() override;
 
   /**
-   * Get first image
+   * Get oldest image waiting for upload
    *
    * @return image object
    */
   virtual schema::Image first() override;
 
+  /**
+   * Get every image
+   *
+   * @return image objects
+   */
+  virtual std::vector<schema::Image> get_all() override;
+
   /**
    * Get image by hash
    *
@@ -136,6 +264,16 @@ class InternalDatabase : public Database {
    */
   virtual schema::Image get(const schema::Hash& hash) override;
 
+  /**
+   * Get images by hash
+   *
+   * @param hashes image hashes
+   *
+   * @return image objects, missing ones are left out
+   */
+  virtual std::vector<schema::Image> get_many(
+      const std::vector<schema::Hash>& hashes) override;
+
   /**
    * Insert image schema to database
    *
@@ -143,6 +281,13 @@ class InternalDatabase : public Database {
    */
   virtual void insert(const schema::Image& image) override;
 
+  /**
+   * Insert images to database in one transaction
+   *
+   * @param images image metadata
+   */
+  virtual void insert_many(const std::vector<schema::Image>& images) override;
+
   /**
    * Remove image from database with specified hash
    *
@@ -150,6 +295,13 @@ class InternalDatabase : public Database {
    */
   virtual void remove(const schema::Hash& hash) override;
 
+  /**
+   * Remove images from database in one transaction
+   *
+   * @param hashes image hashes, missing ones are ignored
+   */
+  virtual void remove_many(const std::vector<schema::Hash>& hashes) override;
+
   /**
    * Check whether database empty
    *
@@ -164,7 +316,218 @@ class InternalDatabase : public Database {
    */
   virtual bool check(const storage::schema::Hash& hash) override;
 
+  /**
+   * Check if image exist by content checksum
+   *
+   * @param checksum checksum of the primary view
+   */
+  virtual bool check_checksum(const schema::Checksum& checksum) override;
+
+  /**
+   * Check if the same tray has been stored with the same content
+   *
+   * @param image image object
+   */
+  virtual bool check_duplicate(const schema::Image& image) override;
+
+  /**
+   * Get oldest images waiting for upload, in insertion order
+   *
+   * @param count maximum number of images
+   *
+   * @return image objects
+   */
+  virtual std::vector<schema::Image> peek(std::size_t count) override;
+
+  /**
+   * Mark images as uploaded, the oldest uploaded images beyond the
+   * configured history are removed
+   *
+   * @param ids image ids
+   */
+  virtual void mark_uploaded(const std::vector<int>& ids) override;
+
+  /**
+   * Update the views, reduced copies and extension listed by images, in
+   * one transaction
+   *
+   * @param images image objects, found by hash
+   */
+  virtual void update_views(const std::vector<schema::Image>& images) override;
+
+  /**
+   * Get number of images waiting for upload, without a query
+   *
+   * @return number of images
+   */
+  inline virtual std::size_t pending_count() override { return pending_; }
+
  protected:
+  /**
+   * Cached queries
+   */
+  enum class query_t : std::size_t {
+    insert,
+    remove,
+    state,
+    get,
+    peek,
+    all,
+    check,
+    check_checksum,
+    duplicate,
+    count,
+    pending,
+    mark,
+    prune,
+    update,
+    begin,
+    commit,
+    rollback,
+  };
+
+  /**
+   * Number of cached queries
+   */
+  static constexpr std::size_t QUERIES = 17;
+
+  /**
+   * Open connection with its prepared statements
+   */
+  struct Connection {
+    /**
+     * Connection handle
+     */
+    sqlite3* db = nullptr;
+    /**
+     * Prepared statements, null until first use
+     */
+    std::array<sqlite3_stmt*, QUERIES> statements{};
+  };
+
+  /**
+   * Reader connection held for one call, defined in the source file
+   */
+  class Reader;
+
+  /**
+   * Open the reader connections
+   */
+  void open_readers();
+
+  /**
+   * Take an idle reader connection, waits while every reader is busy
+   *
+   * @return reader connection
+   */
+  Connection* acquire();
+
+  /**
+   * Give a reader connection back
+   *
+   * @param connection reader connection
+   */
+  void release(Connection* connection);
+
+  /**
+   * Run a statement without parameters nor result on the writer, must hold
+   * writer mutex
+   *
+   * @param query query
+   */
+  void execute(query_t query);
+
+  /**
+   * Insert one image, must hold writer mutex
+   *
+   * @param image image metadata
+   *
+   * @return true if the image is waiting for upload
+   */
+  bool insert_row(const schema::Image& image);
+
+  /**
+   * Remove one image, must hold writer mutex
+   *
+   * @param hash image hash
+   *
+   * @return true if an image waiting for upload has been removed
+   */
+  bool remove_row(const schema::Hash& hash);
+
+  /**
+   * Get one image
+   *
+   * @param connection connection held by the caller
+   * @param hash       image hash
+   * @param image      image object, untouched if missing
+   *
+   * @return true if found
+   */
+  static bool get_row(Connection&         connection,
+                      const schema::Hash& hash,
+                      schema::Image&      image);
+
+  /**
+   * Run a function in a transaction on the writer, rolled back if it
+   * throws, must hold writer mutex
+   *
+   * @param function function to run
+   */
+  template <typename Function>
+  void transaction(Function&& function);
+
+  /**
+   * Apply pragmas to a new connection
+   *
+   * @param db connection
+   */
+  void configure(sqlite3* db);
+
+  /**
+   * Get prepared statement of a query, prepared on first use
+   *
+   * @param connection connection held by the caller
+   * @param query      query
+   *
+   * @return statement, reset and without bindings
+   */
+  static sqlite3_stmt* statement(Connection& connection, query_t query);
+
+  /**
+   * Step a statement, throws on error
+   *
+   * @param connection connection of the statement
+   * @param stmt       statement
+   *
+   * @return true if a row is available
+   */
+  static bool step(Connection& connection, sqlite3_stmt* stmt);
+
+  /**
+   * Read the current row of a statement selecting every column
+   *
+   * @param stmt statement
+   *
+   * @return image object
+   */
+  static schema::Image read(sqlite3_stmt* stmt);
+
+  /**
+   * Throw the last error of a connection
+   *
+   * @param connection connection
+   * @param rc         result code
+   */
+  [[noreturn]] static void fail(const Connection& connection, int rc);
+
+  /**
+   * Finalize prepared statements of a connection
+   *
+   * @param connection connection
+   */
+  static void finalize(Connection& connection);
+
   /**
    * Get database path
    *
@@ -186,15 +549,54 @@ class InternalDatabase : public Database {
    */
   inline const Storage& storage() const { return storage_; }
 
+  /**
+   * Get config
+   *
+   * @return storage config
+   */
+  inline const Config* config() const { return config_; }
+
  private:
   /**
    * Internal database path
    */
   const std::string path_;
   /**
-   * Storage
+   * Configuration
+   */
+  const Config* config_;
+  /**
+   * Storage, only used to sync the schema
    */
   Storage storage_;
+  /**
+   * Writer connection, kept open by the storage
+   */
+  Connection writer_;
+  /**
+   * Serializes use of the writer connection
+   */
+  std::mutex writer_mutex_;
+  /**
+   * Reader connections
+   */
+  std::vector<std::unique_ptr<Connection>> readers_;
+  /**
+   * Idle reader connections
+   */
+  std::vector<Connection*> idle_;
+  /**
+   * Idle readers mutex
+   */
+  std::mutex readers_mutex_;
+  /**
+   * Signalled when a reader is given back
+   */
+  std::condition_variable reader_released_;
+  /**
+   * Number of images waiting for upload, maintained by every change
+   */
+  std::atomic<std::size_t> pending_;
 };
 }  // namespace storage
 
@@ -0,0 +1,218 @@
+#include "storage.hpp"
+
+#include "encoder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#ifdef ATM_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+#include "config.hpp"
+
+NAMESPACE_BEGIN
+
+namespace storage {
+/**
+ * Extension and content type of every format, images keep the extension
+ * they have been stored with
+ */
+static constexpr std::array<std::pair<const char*, const char*>, 4> FORMATS{{
+    {".jpg", "image/jpeg"},
+    {".png", "image/png"},
+    {".webp", "image/webp"},
+    {".ppm", "image/x-portable-pixmap"},
+}};
+
+/**
+ * Get MIME type of files of an extension
+ *
+ * @param extension file extension with the leading dot
+ *
+ * @return content type
+ */
+static std::string mime_type(const std::string& extension) {
+  for (const auto& [known, type] : FORMATS) {
+    if (extension == known) {
+      return type;
+    }
+  }
+  return "application/octet-stream";
+}
+
+#ifdef ATM_TURBOJPEG
+/**
+ * TurboJPEG compressor owned by one thread
+ */
+struct TurboHandle {
+  TurboHandle() : handle{tjInitCompress()} {}
+  ~TurboHandle() {
+    if (handle != nullptr) {
+      tjDestroy(handle);
+    }
+  }
+
+  tjhandle handle;
+};
+#endif
+
+Encoder::Encoder(const Config* config)
+    : config_{config}, encoded_{0}, encoded_bytes_{0}, encode_time_{0} {
+  massert(config != nullptr, "sanity");
+
+  switch (config->format()) {
+    case format_t::png:
+      extension_ = ".png";
+      params_ = {cv::IMWRITE_PNG_COMPRESSION, config->png_level()};
+      break;
+    case format_t::webp:
+      extension_ = ".webp";
+      params_ = {cv::IMWRITE_WEBP_QUALITY, config->quality()};
+      break;
+    case format_t::raw:
+      extension_ = ".ppm";
+      params_ = {cv::IMWRITE_PXM_BINARY, 1};
+      break;
+    case format_t::jpeg:
+    default:
+      extension_ = ".jpg";
+      params_ = {cv::IMWRITE_JPEG_QUALITY, std::min(config->quality(), 100),
+                 cv::IMWRITE_JPEG_OPTIMIZE, 0};
+#if CV_VERSION_MAJOR > 4 || \
+    (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR > 5) || \
+    (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR == 5 && CV_VERSION_REVISION >= 5)
+      params_.push_back(cv::IMWRITE_JPEG_SAMPLING_FACTOR);
+      switch (config->subsampling()) {
+        case subsampling_t::s444:
+          params_.push_back(cv::IMWRITE_JPEG_SAMPLING_FACTOR_444);
+          break;
+        case subsampling_t::s422:
+          params_.push_back(cv::IMWRITE_JPEG_SAMPLING_FACTOR_422);
+          break;
+        case subsampling_t::s420:
+        default:
+          params_.push_back(cv::IMWRITE_JPEG_SAMPLING_FACTOR_420);
+          break;
+      }
+#endif
+      break;
+  }
+
+  content_type_ = mime_type(extension_);
+
+#ifndef ATM_TURBOJPEG
+  if (config->format() == format_t::jpeg && config->fast()) {
+    LOG_DEBUG("Built without libjpeg-turbo, encoding JPEG with OpenCV");
+  }
+#endif
+}
+
+Encoder::~Encoder() {}
+
+std::string Encoder::content_type(const schema::Image& image) const {
+  return image.extension.empty() ? content_type_ : mime_type(image.extension);
+}
+
+const std::vector<std::string>& Encoder::extensions() {
+  static const std::vector<std::string> extensions = [] {
+    std::vector<std::string> known;
+    for (const auto& format : FORMATS) {
+      known.emplace_back(format.first);
+    }
+    return known;
+  }();
+  return extensions;
+}
+
+bool Encoder::accepts_jpeg() const {
+  return config()->format() == format_t::jpeg;
+}
+
+bool Encoder::encode(const cv::Mat& image, std::vector<std::uint8_t>& output) {
+  if (image.empty()) {
+    return false;
+  }
+
+  const auto start = monotonic_micros();
+
+  bool ok = config()->format() == format_t::jpeg && config()->fast() &&
+            encode_turbo(image, output);
+  if (!ok) {
+    ok = cv::imencode(extension(), image, output, params_);
+  }
+
+  if (!ok) {
+    return false;
+  }
+
+  const auto elapsed = monotonic_micros() - start;
+  encoded_ += 1;
+  encoded_bytes_ += output.size();
+  encode_time_ += elapsed;
+
+  LOG_DEBUG("Encoded {}x{} image into {} bytes of {} in {} us", image.cols,
+            image.rows, output.size(), content_type(), elapsed);
+
+  return true;
+}
+
+#ifdef ATM_TURBOJPEG
+bool Encoder::encode_turbo(const cv::Mat&             image,
+                           std::vector<std::uint8_t>& output) {
+  if (image.depth() != CV_8U ||
+      (image.channels() != 1 && image.channels() != 3)) {
+    return false;
+  }
+
+  // compressor state is reused by every image encoded on this thread
+  thread_local TurboHandle turbo;
+  if (turbo.handle == nullptr) {
+    return false;
+  }
+
+  const bool gray = image.channels() == 1;
+  int        sampling = TJSAMP_GRAY;
+  if (!gray) {
+    switch (config()->subsampling()) {
+      case subsampling_t::s444:
+        sampling = TJSAMP_444;
+        break;
+      case subsampling_t::s422:
+        sampling = TJSAMP_422;
+        break;
+      case subsampling_t::s420:
+      default:
+        sampling = TJSAMP_420;
+        break;
+    }
+  }
+
+  // worst case size, so the library never reallocates the buffer
+  unsigned long size = tjBufSize(image.cols, image.rows, sampling);
+  output.resize(size);
+  auto* data = output.data();
+
+  if (tjCompress2(turbo.handle, image.data, image.cols,
+                  static_cast<int>(image.step), image.rows,
+                  gray ? TJPF_GRAY : TJPF_BGR, &data, &size, sampling,
+                  std::min(config()->quality(), 100),
+                  TJFLAG_NOREALLOC | TJFLAG_FASTDCT) != 0) {
+    LOG_WARN("libjpeg-turbo cannot encode image: {}",
+             tjGetErrorStr2(turbo.handle));
+    return false;
+  }
+
+  output.resize(size);
+  return true;
+}
+#else
+bool Encoder::encode_turbo([[maybe_unused]] const cv::Mat&             image,
+                           [[maybe_unused]] std::vector<std::uint8_t>& output) {
+  return false;
+}
+#endif
+}  // namespace storage
+
+NAMESPACE_END
@@ -0,0 +1,212 @@
+#ifndef LIB_STORAGE_ENCODER_HPP_
+#define LIB_STORAGE_ENCODER_HPP_
+
+/** @file encoder.hpp
+ *  @brief Image encoder
+ *
+ * Encodes images in the configured file format
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv4/opencv2/opencv.hpp>
+
+#include <libcore/core.hpp>
+
+#include "schema.hpp"
+
+NAMESPACE_BEGIN
+
+namespace storage {
+// forward declarations
+class Config;
+
+/**
+ * @brief Image encoder
+ *
+ * Every component touching image files (writer, upload, cleanup) resolves
+ * file names and content type here, so the format can be changed per site.
+ *
+ * Safe to use from several threads at once
+ */
+class Encoder {
+ public:
+  /**
+   * Encoder constructor
+   *
+   * @param config storage configuration
+   */
+  Encoder(const Config* config);
+
+  /**
+   * Encoder destructor
+   */
+  ~Encoder();
+
+  /**
+   * Encode image
+   *
+   * @param image  image to encode (8-bit, 1 or 3 channels BGR)
+   * @param output encoded file content, reused between calls
+   *
+   * @return true if success
+   */
+  bool encode(const cv::Mat& image, std::vector<std::uint8_t>& output);
+
+  /**
+   * Check whether a compressed frame from the camera can be stored as is
+   *
+   * @return true if format is JPEG
+   */
+  bool accepts_jpeg() const;
+
+  /**
+   * Get file extension
+   *
+   * @return file extension with the leading dot
+   */
+  inline const std::string& extension() const { return extension_; }
+
+  /**
+   * Get MIME type of the files
+   *
+   * @return content type
+   */
+  inline const std::string& content_type() const { return content_type_; }
+
+  /**
+   * Get file extension of a stored image
+   *
+   * @param image image metadata
+   *
+   * @return file extension with the leading dot, the configured one for
+   *         images stored before it was recorded
+   */
+  inline const std::string& extension(const schema::Image& image) const {
+    return image.extension.empty() ? extension_ : image.extension;
+  }
+
+  /**
+   * Get MIME type of the files of a stored image
+   *
+   * @param image image metadata
+   *
+   * @return content type
+   */
+  std::string content_type(const schema::Image& image) const;
+
+  /**
+   * Get extensions of every format, images stored before a format change
+   * keep theirs
+   *
+   * @return file extensions with the leading dot
+   */
+  static const std::vector<std::string>& extensions();
+
+  /**
+   * Get name of the file holding one view of an image
+   *
+   * @param hash  image hash
+   * @param view  view name, empty for the primary view
+   * @param level downscale factor, 1 for the full resolution
+   *
+   * @return file name relative to the images directory
+   */
+  inline std::string file_name(const schema::Hash& hash,
+                               const std::string&  view = "",
+                               std::size_t         level = 1) const {
+    return schema::file_name(hash, extension(), view, level);
+  }
+
+  /**
+   * Get names of the files holding every view of an image
+   *
+   * @param image image metadata, files keep the extension they have been
+   *              stored with
+   *
+   * @return file names relative to the images directory, full resolution
+   *         primary view first
+   */
+  inline std::vector<std::string> file_names(
+      const schema::Image& image) const {
+    return schema::file_names(image, extension(image));
+  }
+
+  /**
+   * Get number of encoded images
+   *
+   * @return number of encoded images
+   */
+  inline std::uint64_t encoded() const { return encoded_; }
+
+  /**
+   * Get total size of encoded images
+   *
+   * @return size in bytes
+   */
+  inline std::uint64_t encoded_bytes() const { return encoded_bytes_; }
+
+  /**
+   * Get total time spent encoding
+   *
+   * @return time in microseconds
+   */
+  inline time_unit encode_time() const { return encode_time_; }
+
+ private:
+  /**
+   * Encode JPEG with libjpeg-turbo
+   *
+   * @param image  image to encode
+   * @param output encoded file content
+   *
+   * @return true if success, false to fall back to OpenCV
+   */
+  bool encode_turbo(const cv::Mat& image, std::vector<std::uint8_t>& output);
+
+  /**
+   * Get config
+   *
+   * @return storage config
+   */
+  inline const Config* config() const { return config_; }
+
+ private:
+  /**
+   * Configuration
+   */
+  const Config* config_;
+  /**
+   * File extension
+   */
+  std::string extension_;
+  /**
+   * Content type
+   */
+  std::string content_type_;
+  /**
+   * OpenCV encoder parameters
+   */
+  std::vector<int> params_;
+  /**
+   * Number of encoded images
+   */
+  std::atomic<std::uint64_t> encoded_;
+  /**
+   * Total size of encoded images
+   */
+  std::atomic<std::uint64_t> encoded_bytes_;
+  /**
+   * Total encode time in microseconds
+   */
+  std::atomic<time_unit> encode_time_;
+};
+}  // namespace storage
+
+NAMESPACE_END
+
+#endif  // LIB_STORAGE_ENCODER_HPP_
@@ -2,108 +2,57 @@
 
 #include "listener.hpp"
 
-#include <fmt/format.h>
+#include <future>
+#include <string>
+#include <utility>
+#include <vector>
 
-#include <opencv4/opencv2/opencv.hpp>
+#include <fmt/format.h>
 
+#include <libcamera/camera.hpp>
 #include <libserver/server.hpp>
 #include <libutil/util.hpp>
 
+#include "config.hpp"
 #include "database.hpp"
+#include "encoder.hpp"
+#include "trace.hpp"
+#include "writer.hpp"
 
 NAMESPACE_BEGIN
 
 namespace storage {
-static std::string sku_card_instruction(long long sku_card_instr) {
-  if (sku_card_instr == 0) {
-    return "Colonize";
-  } else if (sku_card_instr == 1) {
-    return "Tend";
-  } else if (sku_card_instr == 2) {
-    return "ExposeFlip";
-  } else if (sku_card_instr == 3) {
-    return "FlipNylonFlip";
-  } else if (sku_card_instr == 4) {
-    return "TendFlipFlipCompFlip";
-  } else if (sku_card_instr == 5) {
-    return "FlipTend";
-  } else if (sku_card_instr == 8) {
-    return "HarvestBed";
-  } else {
-    return "Unknown";
-  }
-}
-
-static std::string sku_number(long long sku_num) {
-  if (sku_num == 99) {
-    return "Regen";
-  } else if (sku_num == 1) {
-    return "Eskimo";
-  } else if (sku_num == 2) {
-    return "Tiger";
-  } else if (sku_num == 3) {
-    return "Sapien";
-  } else {
-    return "Unknown";
-  }
-}
-
-static std::string lid_barcode(long long lid_barcode_id) {
-  auto lid_barcode_str = std::to_string(lid_barcode_id);
-
-  if (lid_barcode_str.length() != 7) {
-    return lid_barcode_str;
-  }
-
-  auto lid_type_num = lid_barcode_str.substr(0, 3);
-  auto lid_id = lid_barcode_str.substr(3);
-
-  std::string lid_type = "UNK";
-
-  if (lid_type_num.compare("000") == 0) {
-    lid_type = "NO_LID";
-  } else if (lid_type_num.compare("100") == 0) {
-    lid_type = "CL:NH";
-  } else if (lid_type_num.compare("101") == 0) {
-    lid_type = "CL:HP1";
-  } else if (lid_type_num.compare("102") == 0) {
-    lid_type = "CL:HP2";
-  } else if (lid_type_num.compare("103") == 0) {
-    lid_type = "CL:HP3";
-  } else if (lid_type_num.compare("201") == 0) {
-    lid_type = "GL:HP1";
-  } else if (lid_type_num.compare("202") == 0) {
-    lid_type = "GL:HP2";
-  } else if (lid_type_num.compare("203") == 0) {
-    lid_type = "GL:HP3";
-  }
-
-  return fmt::format("{}-{}", lid_type, lid_id);
-}
-
-static std::string infection(long long infection_num) {
-  if (infection_num == 0) {
-    return "None";
-  } else if (infection_num == 1) {
-    return "Blue/Green";
-  } else if (infection_num == 2) {
-    return "Black/Brown";
-  } else if (infection_num == 3) {
-    return "Metabolite";
-  } else {
-    return "Unknown";
-  }
-}
-StorageListener::StorageListener(const server::Config* config,
-                                 server::DataMapper*   data_mapper,
-                                 Database*             database,
-                                 const cv::Mat*        image,
-                                 bool                  autorun)
+StorageListener::StorageListener(const server::Config*       config,
+                                 const Config*               storage_config,
+                                 server::DataMapper*         data_mapper,
+                                 Database*                   database,
+                                 Encoder*                    encoder,
+                                 Spool*                      spool,
+                                 const camera::CaptureGroup* captures,
+                                 bool                        autorun)
     : config_{config},
+      storage_config_{storage_config},
       data_mapper_{data_mapper},
       database_{database},
-      image_{image} {
-  fs::create_directory(config->base_config()->images_dir());
+      captures_{captures},
+      traces_{std::make_unique<TraceStats>(storage_config)},
+      writer_{std::make_unique<Writer>(storage_config,
+                                       database,
+                                       encoder,
+                                       spool)},
+      handshake_{std::make_unique<server::Handshake>(config, data_mapper)} {
+  fs::create_directory(storage_config->images_dir());
+
+  // leftovers of a crash, before the cloud listener looks at the database
+  writer_->reconcile();
+
+  // a finished tray frees capacity, and may be waiting for an upload
+  writer_->bind_complete([this] {
+    data_mapper_->notify_all();
+    if (on_stored_) {
+      on_stored_();
+    }
+  });
   if (autorun) {
     start();
   }
@@ -111,15 +60,24 @@ StorageListener::StorageListener(const server::Config* config,
 
 StorageListener::~StorageListener() {
   running_ = false;
+  data_mapper_->notify_all();
   if (thread().joinable()) {
     thread().join();
   }
+  writer_->stop();
+}
+
+void StorageListener::bind_stored(std::function<void()> callback) {
+  Listener::LockGuard lock(mutex());
+  massert(!running(), "sanity");
+  on_stored_ = std::move(callback);
 }
 
 void StorageListener::start() {
   Listener::LockGuard lock(mutex());
   if (!running()) {
     LOG_INFO("Starting storage listener");
+    writer_->start();
     running_ = true;
     thread_ = std::thread(&StorageListener::execute, this);
   }
@@ -130,90 +88,107 @@ void StorageListener::stop() {
   if (running()) {
     LOG_INFO("Stopping storage listener");
     running_ = false;
+    // wake up the listener waiting for a request
+    data_mapper_->notify_all();
     if (thread().joinable()) {
       thread().join();
     }
+    // images already acknowledged to the PLC must reach the disk
+    writer_->stop();
+    traces_->report();
     LOG_INFO("Stopping storage listener complete");
   }
 }
 
-void StorageListener::write_status(const std::string& key, bool value) {
-  data_mapper_->status(server::mapping::alt_type_t::jetson_status, key, value);
-}
-
-long long StorageListener::read_data(const std::string& key) const {
-  return data_mapper_->data(server::mapping::alt_type_t::plc_data, key);
-}
-
 void StorageListener::execute() {
   massert(State::get() != nullptr, "sanity");
 
-  write_status(IMAGING_READY_KEY, true);
-
   while (running()) {
-    while (running() &&
-           !data_mapper_->status(server::mapping::alt_type_t::plc_status,
-                                 "imaging-request")) {
-      sleep_for<time_units::millis>(100);  // waiting
-    }
-
-    if (!running()) {
+    // woken up by every PLC write and every stored tray, no polling; the
+    // next tray is taken while previous ones are still being stored
+    if (!handshake_->request(running(),
+                             [this] { return writer_->available(); })) {
       break;
     }
 
-    auto year = read_data("year");
-    auto month = read_data("month");
-    auto day = read_data("day");
-    auto hour = read_data("hour");
-    auto minute = read_data("minute");
-    auto second = read_data("second");
-    auto raw_sku_card_instr = read_data("sku-card-instruction");
-    auto raw_sku_num = read_data("sku-number");
-    auto sku_prod_day = read_data("sku-production-day");
-    auto tray_barcode = read_data("tray-barcode");
-    auto raw_lid_barcode = read_data("lid-barcode");
-    auto batch_id = read_data("batch-id");
-    auto raw_infection_id = read_data("infection-id");
-
-    auto hash = fmt::format("TRAY_{}_{}-{}-{}_{}-{}-{}", tray_barcode, month,
-                            day, year, hour, minute, second);
+    // taken as soon as the server has applied the write of the request
+    auto trigger = monotonic_micros();
+    auto trace = traces_->begin(trigger);
+
+    // one consistent copy of everything the PLC wrote for this tray
+    const auto tray = data_mapper_->tray();
+    trace->snapshot = monotonic_micros();
+
+    auto hash = fmt::format("TRAY_{}_{}-{}-{}_{}-{}-{}", tray.tray_barcode,
+                            tray.month, tray.day, tray.year, tray.hour,
+                            tray.minute, tray.second);
+    trace->hash = hash;
+
+    // names of the codes are looked up in tables loaded from [codes]
+    const auto& codes = storage_config()->codes();
+    std::string sku_card{codes.sku_card()[tray.sku_card_instruction]};
+    std::string sku_number{codes.sku_number()[tray.sku_number]};
+    std::string infection{codes.infection()[tray.infection_id]};
 
     schema::Image image_entry{-1,
                               hash,
-                              year,
-                              month,
-                              day,
-                              hour,
-                              minute,
-                              second,
-                              sku_card_instruction(raw_sku_card_instr),
-                              sku_number(raw_sku_num),
-                              sku_prod_day,
-                              tray_barcode,
-                              lid_barcode(raw_lid_barcode),
-                              batch_id,
-                              infection(raw_infection_id)};
+                              tray.year,
+                              tray.month,
+                              tray.day,
+                              tray.hour,
+                              tray.minute,
+                              tray.second,
+                              std::move(sku_card),
+                              std::move(sku_number),
+                              tray.sku_production_day,
+                              tray.tray_barcode,
+                              codes.lid_barcode(tray.lid_barcode),
+                              tray.batch_id,
+                              std::move(infection),
+                              "",
+                              "",
+                              "",
+                              schema::PENDING,
+                              ""};
 
     LOG_INFO("Saving {}", image_entry);
 
-    write_status(IMAGING_READY_KEY, false);
-    write_status(IMAGING_DONE_KEY, false);
+    // frames taken when the tray was in position, not after processing
+    auto frames = captures()->frames(trigger);
+    trace->captured = monotonic_micros();
 
     // save data
-    database_->insert(image_entry);
-    imwrite(
-        fmt::format("{}/{}.jpg", config()->base_config()->images_dir(), hash),
-        *(image()));
-
-    write_status(IMAGING_DONE_KEY, true);
-    // wait for 3s before listening again
-    sleep_for<time_units::seconds>(3);
-    write_status(IMAGING_READY_KEY, true);
-    write_status(IMAGING_DONE_KEY, false);
-    // wait for 5s before listening again
-    sleep_for<time_units::seconds>(5);
-
-    LOG_INFO("Image has been saved");
+    if (frames.front().empty()) {
+      LOG_ERROR("No frame has been captured, skipping {}", hash);
+    } else {
+      std::vector<Writer::View> views;
+      for (std::size_t i = 0; i < frames.size(); ++i) {
+        if (frames[i].empty()) {
+          LOG_ERROR("No frame has been captured by {}, skipping view",
+                    captures()->config(i).name());
+          continue;
+        }
+
+        views.push_back(
+            {i == 0 ? std::string{} : captures()->config(i).name(),
+             std::move(frames[i])});
+      }
+
+      // encoding happens on the writer threads, only wait as long as the
+      // durability policy requires
+      auto stored = writer_->write(image_entry, std::move(views), trace);
+      trace->queued = monotonic_micros();
+      if (storage_config()->durability() != durability_t::enqueue) {
+        stored.wait();
+      }
+    }
+
+    trace->done = monotonic_micros();
+    handshake_->complete(running());
+    trace->acknowledged = monotonic_micros();
+
+    // recorded here or once the writer is done with the tray
+    trace->release();
   }
 }
 }  // namespace storage
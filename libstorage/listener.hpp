@@ -1,51 +1,72 @@
 #ifndef LIB_STORAGE_LISTENER_HPP_
 #define LIB_STORAGE_LISTENER_HPP_
 
-#include <libcore/core.hpp>
+#include <functional>
+#include <memory>
 
-// forward declarations
-namespace cv {
-class Mat;
-}
+#include <libcore/core.hpp>
 
 NAMESPACE_BEGIN
 
+// forward declarations
+namespace camera {
+class CaptureGroup;
+}  // namespace camera
+
 namespace server {
 class Config;
 class DataMapper;
+class Handshake;
 }  // namespace server
 
 namespace storage {
+class Config;
 class Database;
+class Encoder;
+class Spool;
+class TraceStats;
+class Writer;
 
 class StorageListener : public Listener {
  public:
-  StorageListener(const server::Config* config,
-                  server::DataMapper*   data_mapper,
-                  Database*             database,
-                  const cv::Mat*        image,
-                  bool                  autorun = false);
+  StorageListener(const server::Config*       config,
+                  const Config*               storage_config,
+                  server::DataMapper*         data_mapper,
+                  Database*                   database,
+                  Encoder*                    encoder,
+                  Spool*                      spool,
+                  const camera::CaptureGroup* captures,
+                  bool                        autorun = false);
   virtual ~StorageListener() override;
 
   virtual void start() override;
   virtual void stop() override;
 
+  inline const server::Handshake& handshake() const { return *handshake_; }
+
+  inline const TraceStats& traces() const { return *traces_; }
+
+  void bind_stored(std::function<void()> callback);
+
  private:
   void execute();
 
-  inline const cv::Mat* image() const { return image_; }
+  inline const camera::CaptureGroup* captures() const { return captures_; }
 
   inline const server::Config* config() const { return config_; }
 
-  void write_status(const std::string& key, bool value);
-
-  long long read_data(const std::string& key) const;
+  inline const Config* storage_config() const { return storage_config_; }
 
  private:
-  const server::Config*           config_;
-  server::DataMapper*             data_mapper_;
-  Database*                       database_;
-  const cv::Mat*                  image_;
+  const server::Config*              config_;
+  const Config*                      storage_config_;
+  server::DataMapper*                data_mapper_;
+  Database*                          database_;
+  const camera::CaptureGroup*        captures_;
+  std::unique_ptr<TraceStats>        traces_;
+  std::unique_ptr<Writer>            writer_;
+  std::unique_ptr<server::Handshake> handshake_;
+  std::function<void()>              on_stored_;
 };
 }  // namespace storage
 
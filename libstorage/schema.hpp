@@ -1,8 +1,10 @@
 #ifndef LIB_STORAGE_SCHEMA_HPP_
 #define LIB_STORAGE_SCHEMA_HPP_
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include <fmt/format.h>
 #include <fmt/ostream.h>
@@ -15,6 +17,16 @@ NAMESPACE_BEGIN
 namespace storage {
 namespace schema {
 using Hash = std::string;
+using Checksum = std::string;
+
+/**
+ * Upload state of an image waiting for upload
+ */
+inline constexpr int PENDING = 0;
+/**
+ * Upload state of an image already uploaded, kept to catch duplicates
+ */
+inline constexpr int UPLOADED = 1;
 
 struct Image {
   int         id;
@@ -32,6 +44,11 @@ struct Image {
   std::string lid_barcode;
   long long   batch_id;
   std::string infection_id;
+  std::string views;
+  Checksum    checksum;
+  std::string levels;
+  int         state;
+  std::string extension;
 
   template <typename T>
   friend T& operator<<(T& os, const Image& img) {
@@ -40,13 +57,130 @@ struct Image {
         "[Image, id={}, hash='{}', year={}, month={}, day={}, hour={}, "
         "minute={}, "
         "second={}, sku_card='{}', sku_number='{}', sku_prod_day={}, "
-        "tray_barcode={}, lid_barcode='{}', batch_id={}, infection_id='{}']",
+        "tray_barcode={}, lid_barcode='{}', batch_id={}, infection_id='{}', "
+        "views='{}', checksum='{}', levels='{}', state={}, extension='{}']",
         img.id, img.hash, img.year, img.month, img.day, img.hour, img.minute,
         img.second, img.sku_card, img.sku_number, img.sku_prod_day,
-        img.tray_barcode, img.lid_barcode, img.batch_id, img.infection_id);
+        img.tray_barcode, img.lid_barcode, img.batch_id, img.infection_id,
+        img.views, img.checksum, img.levels, img.state, img.extension);
     return os;
   }
 };
+
+/**
+ * Split a comma separated list
+ *
+ * @param list comma separated list
+ *
+ * @return non-empty items
+ */
+inline std::vector<std::string> split(const std::string& list) {
+  std::vector<std::string> items;
+
+  std::size_t begin = 0;
+  while (begin < list.size()) {
+    auto end = list.find(',', begin);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+
+    if (end > begin) {
+      items.push_back(list.substr(begin, end - begin));
+    }
+
+    begin = end + 1;
+  }
+
+  return items;
+}
+
+/**
+ * Get name of the file holding one view of an image
+ *
+ * @param hash      image hash
+ * @param extension file extension with the leading dot, see Encoder
+ * @param view      view name, empty for the primary view
+ * @param level     downscale factor, 1 for the full resolution
+ *
+ * @return file name relative to the images directory
+ */
+inline std::string file_name(const Hash&        hash,
+                             const std::string& extension,
+                             const std::string& view = "",
+                             std::size_t        level = 1) {
+  std::string name = view.empty() ? hash : fmt::format("{}-{}", hash, view);
+  if (level > 1) {
+    return fmt::format("{}@{}{}", name, level, extension);
+  }
+
+  return fmt::format("{}{}", name, extension);
+}
+
+/**
+ * Get downscale factors stored for an image
+ *
+ * @param image image metadata
+ *
+ * @return downscale factors, smallest first
+ */
+inline std::vector<std::size_t> levels(const Image& image) {
+  std::vector<std::size_t> factors;
+  for (const auto& item : split(image.levels)) {
+    factors.push_back(std::stoul(item));
+  }
+  return factors;
+}
+
+/**
+ * Get the cheapest stored level that is not smaller than needed
+ *
+ * @param image image metadata
+ * @param scale largest acceptable downscale factor
+ *
+ * @return downscale factor, 1 for the full resolution
+ */
+inline std::size_t level(const Image& image, std::size_t scale) {
+  std::size_t found = 1;
+  for (auto factor : levels(image)) {
+    if (factor <= scale) {
+      found = factor;
+    }
+  }
+  return found;
+}
+
+/**
+ * Get names of the files holding every view of an image
+ *
+ * Every file written, uploaded, or removed for an image goes through here
+ *
+ * @param image     image metadata, views is a comma separated list of the
+ *                  secondary views, levels a comma separated list of the
+ *                  downscale factors stored for every view
+ * @param extension file extension with the leading dot, see
+ *                  Encoder::extension(const Image&)
+ *
+ * @return file names relative to the images directory, full resolution
+ *         primary view first, then every level of every view
+ */
+inline std::vector<std::string> file_names(const Image&       image,
+                                           const std::string& extension) {
+  auto views = split(image.views);
+  views.insert(views.begin(), std::string{});
+
+  std::vector<std::string> names;
+  for (const auto& view : views) {
+    names.push_back(file_name(image.hash, extension, view));
+  }
+
+  for (auto factor : levels(image)) {
+    for (const auto& view : views) {
+      names.push_back(file_name(image.hash, extension, view, factor));
+    }
+  }
+
+  return names;
+}
 }  // namespace schema
 
 template <class O, class T, class... Op>
@@ -74,7 +208,22 @@ using Storage = sqlite_orm::internal::storage_t<sqlite_orm::internal::table_t<
     Column<schema::Image, decltype(schema::Image::tray_barcode)>,
     Column<schema::Image, decltype(schema::Image::lid_barcode)>,
     Column<schema::Image, decltype(schema::Image::batch_id)>,
-    Column<schema::Image, decltype(schema::Image::infection_id)>>>;
+    Column<schema::Image, decltype(schema::Image::infection_id)>,
+    Column<schema::Image,
+           decltype(schema::Image::views),
+           sqlite_orm::constraints::default_t<std::string>>,
+    Column<schema::Image,
+           decltype(schema::Image::checksum),
+           sqlite_orm::constraints::default_t<std::string>>,
+    Column<schema::Image,
+           decltype(schema::Image::levels),
+           sqlite_orm::constraints::default_t<std::string>>,
+    Column<schema::Image,
+           decltype(schema::Image::state),
+           sqlite_orm::constraints::default_t<int>>,
+    Column<schema::Image,
+           decltype(schema::Image::extension),
+           sqlite_orm::constraints::default_t<std::string>>>>;
 }  // namespace storage
 
 NAMESPACE_END
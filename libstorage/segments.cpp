@@ -0,0 +1,1182 @@
+#include "storage.hpp"
+
+#include "segments.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <fmt/format.h>
+
+#include "config.hpp"
+
+NAMESPACE_BEGIN
+
+namespace storage {
+/**
+ * Record magic, "ATMR"
+ */
+static constexpr std::uint32_t RECORD_MAGIC = 0x524d5441;
+
+/**
+ * Index magic, "ATMINDEX"
+ */
+static constexpr std::uint64_t INDEX_MAGIC = 0x5845444e494d5441;
+
+/**
+ * Index version, bumped whenever the layout changes
+ */
+static constexpr std::uint32_t INDEX_VERSION = 1;
+
+/**
+ * Size of a record header
+ */
+static constexpr std::size_t RECORD_HEADER = 32;
+
+/**
+ * Record alignment
+ */
+static constexpr std::size_t ALIGNMENT = 8;
+
+/**
+ * Smallest number of index slots
+ */
+static constexpr std::size_t MIN_CAPACITY = 1024;
+
+/**
+ * Slot states
+ */
+static constexpr std::uint16_t SLOT_EMPTY = 0;
+static constexpr std::uint16_t SLOT_USED = 1;
+static constexpr std::uint16_t SLOT_REMOVED = 2;
+
+/**
+ * Get size of a record, header and padding included
+ *
+ * @param name_size name size
+ * @param size      content size
+ *
+ * @return record size
+ */
+static std::size_t record_size(std::size_t name_size, std::size_t size) {
+  const auto bytes = RECORD_HEADER + name_size + size;
+  return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+/**
+ * Get hash a name is found by in the index
+ *
+ * @param name file name
+ *
+ * @return name hash
+ */
+static std::uint64_t key_of(const std::string& name) {
+  return util::XXHash64::hash(name.data(), name.size());
+}
+
+/**
+ * Get number of index slots for a number of files, at most 3/4 used
+ *
+ * @param files number of files
+ *
+ * @return number of slots, a power of two
+ */
+static std::size_t capacity_for(std::size_t files) {
+  std::size_t capacity = MIN_CAPACITY;
+  while (capacity / 4 * 3 < files) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+/**
+ * Read a whole buffer at an offset
+ *
+ * @param fd     file descriptor
+ * @param data   buffer
+ * @param size   buffer size
+ * @param offset file offset
+ *
+ * @return true if the whole buffer has been read
+ */
+static bool read_at(int fd, void* data, std::size_t size, std::size_t offset) {
+  auto* bytes = static_cast<std::uint8_t*>(data);
+  while (size > 0) {
+    auto count = ::pread(fd, bytes, size, static_cast<off_t>(offset));
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    bytes += count;
+    offset += static_cast<std::size_t>(count);
+    size -= static_cast<std::size_t>(count);
+  }
+
+  return true;
+}
+
+/**
+ * Write a whole buffer at an offset
+ *
+ * @param fd     file descriptor
+ * @param data   buffer
+ * @param size   buffer size
+ * @param offset file offset
+ *
+ * @return true if the whole buffer has been written
+ */
+static bool write_at(int         fd,
+                     const void* data,
+                     std::size_t size,
+                     std::size_t offset) {
+  const auto* bytes = static_cast<const std::uint8_t*>(data);
+  while (size > 0) {
+    auto count = ::pwrite(fd, bytes, size, static_cast<off_t>(offset));
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    bytes += count;
+    offset += static_cast<std::size_t>(count);
+    size -= static_cast<std::size_t>(count);
+  }
+
+  return true;
+}
+
+/**
+ * Find the next offset that may start a record
+ *
+ * @param fd     file descriptor
+ * @param offset first offset to look at, aligned
+ * @param limit  end of the area to look in
+ *
+ * @return offset of the next record magic, limit if none
+ */
+static std::size_t seek(int fd, std::size_t offset, std::size_t limit) {
+  // mostly the never written tail of a segment, read in large chunks
+  static constexpr std::size_t CHUNK = 1024 * 1024;
+  std::vector<std::uint8_t>    chunk(CHUNK);
+
+  while (offset + sizeof(RECORD_MAGIC) <= limit) {
+    const auto size = std::min(CHUNK, limit - offset);
+    if (!read_at(fd, chunk.data(), size, offset)) {
+      return limit;
+    }
+
+    for (std::size_t i = 0; i + sizeof(RECORD_MAGIC) <= size; i += ALIGNMENT) {
+      std::uint32_t magic;
+      std::memcpy(&magic, chunk.data() + i, sizeof(magic));
+      if (magic == RECORD_MAGIC) {
+        return offset + i;
+      }
+    }
+
+    offset += size;
+  }
+
+  return limit;
+}
+
+/**
+ * Flush directory entries to the disk, so new files survive a power loss
+ *
+ * @param path directory path
+ */
+static void sync_directory(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0 || ::fsync(fd) != 0) {
+    LOG_WARN("Cannot flush {}: {}", path, std::strerror(errno));
+  }
+
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+Segments::Segment::~Segment() {
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+Segments::Segments(const Config* config)
+    : config_{config},
+      ready_{false},
+      index_fd_{-1},
+      index_{nullptr},
+      index_size_{0},
+      running_{false},
+      compacted_{0} {
+  massert(config != nullptr, "sanity");
+
+  // written as is into the files
+  static_assert(sizeof(Record) == RECORD_HEADER);
+  static_assert(sizeof(Header) == 64);
+  static_assert(sizeof(Slot) == 32);
+
+  ready_ = open();
+  if (!ready()) {
+    unmap();
+    segments_.clear();
+    active_.reset();
+    return;
+  }
+
+  running_ = true;
+  compactor_ = std::thread(&Segments::execute, this);
+
+  LOG_INFO("Storing images in {}, {} images in {} segments of {} MiB",
+           config->segments_dir(), count(), segments(),
+           config->segment_size() / (1024 * 1024));
+}
+
+Segments::~Segments() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  signal_.notify_all();
+
+  if (compactor_.joinable()) {
+    compactor_.join();
+  }
+
+  if (!ready()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // records the index points to must be on the disk once it is trusted
+  for (const auto& [id, segment] : segments_) {
+    if (::fdatasync(segment->fd) != 0) {
+      LOG_WARN("Cannot flush segment {}: {}", id, std::strerror(errno));
+    }
+  }
+
+  header()->active = active_ ? active_->id : 0;
+  header()->end = active_ ? active_->end : 0;
+  header()->clean = 1;
+  if (::msync(index_, index_size_, MS_SYNC) != 0) {
+    LOG_WARN("Cannot flush index of {}: {}", config()->segments_dir(),
+             std::strerror(errno));
+  }
+
+  unmap();
+}
+
+std::string Segments::segment_path(std::uint32_t id) const {
+  return fmt::format("{}/segment-{:06}", config()->segments_dir(), id);
+}
+
+bool Segments::open() {
+  const auto& dir = config()->segments_dir();
+
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+  if (ec) {
+    LOG_ERROR("Cannot create segments directory {}: {}", dir, ec.message());
+    return false;
+  }
+
+  static constexpr std::string_view PREFIX = "segment-";
+  for (const auto& entry : fs::directory_iterator(dir, ec)) {
+    const auto name = entry.path().filename().string();
+    if (name.size() <= PREFIX.size() ||
+        name.compare(0, PREFIX.size(), PREFIX) != 0) {
+      continue;
+    }
+
+    auto segment = std::make_shared<Segment>();
+    segment->id = static_cast<std::uint32_t>(
+        std::strtoul(name.c_str() + PREFIX.size(), nullptr, 10));
+    segment->fd = ::open(entry.path().c_str(), O_RDWR | O_CLOEXEC);
+    if (segment->id == 0 || segment->fd < 0) {
+      LOG_ERROR("Cannot open segment {}: {}", entry.path().string(),
+                std::strerror(errno));
+      return false;
+    }
+
+    // appended to only if it is the active one
+    segment->end = config()->segment_size();
+    segments_[segment->id] = std::move(segment);
+  }
+
+  if (ec) {
+    LOG_ERROR("Cannot list segments directory {}: {}", dir, ec.message());
+    return false;
+  }
+
+  const auto path = fmt::format("{}/{}", dir, INDEX_FILE);
+
+  const bool existed = fs::exists(path, ec);
+  bool       trusted = existed && map(path, 0) && header()->clean == 1;
+  if (trusted) {
+    // every file must point into a known segment
+    for (std::size_t i = 0; trusted && i < header()->capacity; ++i) {
+      const auto& slot = slots()[i];
+      if (slot.state != SLOT_USED) {
+        continue;
+      }
+
+      auto it = segments_.find(slot.segment);
+      const auto size = record_size(slot.name_size, slot.size);
+      trusted = it != segments_.end() &&
+                slot.offset + size <= config()->segment_size();
+      if (trusted) {
+        it->second->live += size;
+      }
+    }
+
+    if (trusted && header()->active != 0) {
+      auto it = segments_.find(header()->active);
+      trusted = it != segments_.end();
+      if (trusted) {
+        active_ = it->second;
+        active_->end = header()->end;
+      }
+    }
+  }
+
+  if (!trusted) {
+    if (existed) {
+      LOG_WARN("Index of {} has not been closed cleanly, rebuilding it", dir);
+    }
+    unmap();
+    for (auto& [id, segment] : segments_) {
+      segment->live = 0;
+    }
+    active_.reset();
+
+    if (!map(path, capacity_for(config()->segments_capacity())) ||
+        !rebuild()) {
+      return false;
+    }
+  }
+
+  // a crash from now on rebuilds the index
+  header()->clean = 0;
+  if (::msync(index_, sizeof(Header), MS_SYNC) != 0) {
+    LOG_ERROR("Cannot flush index of {}: {}", dir, std::strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+bool Segments::map(const std::string& path, std::size_t capacity) {
+  const bool create = capacity > 0;
+
+  int fd = create ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                           0644)
+                  : ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    LOG_ERROR("Cannot open index {}: {}", path, std::strerror(errno));
+    return false;
+  }
+
+  std::size_t size = sizeof(Header) + capacity * sizeof(Slot);
+  if (create) {
+    // zero-filled, every slot is empty
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      LOG_ERROR("Cannot resize index {}: {}", path, std::strerror(errno));
+      ::close(fd);
+      return false;
+    }
+  } else {
+    struct stat status;
+    if (::fstat(fd, &status) != 0 ||
+        static_cast<std::size_t>(status.st_size) < sizeof(Header)) {
+      ::close(fd);
+      return false;
+    }
+    size = static_cast<std::size_t>(status.st_size);
+  }
+
+  void* index =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (index == MAP_FAILED) {
+    LOG_ERROR("Cannot map index {}: {}", path, std::strerror(errno));
+    ::close(fd);
+    return false;
+  }
+
+  auto* header = static_cast<Header*>(index);
+  if (create) {
+    *header = Header{INDEX_MAGIC, INDEX_VERSION, 0, capacity, 0, 0, 0, 0, 0, 0};
+  } else if (header->magic != INDEX_MAGIC || header->version != INDEX_VERSION ||
+             header->capacity == 0 ||
+             (header->capacity & (header->capacity - 1)) != 0 ||
+             size != sizeof(Header) + header->capacity * sizeof(Slot)) {
+    ::munmap(index, size);
+    ::close(fd);
+    return false;
+  }
+
+  index_fd_ = fd;
+  index_ = index;
+  index_size_ = size;
+  return true;
+}
+
+void Segments::unmap() {
+  if (index_ != nullptr) {
+    ::munmap(index_, index_size_);
+    index_ = nullptr;
+    index_size_ = 0;
+  }
+
+  if (index_fd_ >= 0) {
+    ::close(index_fd_);
+    index_fd_ = -1;
+  }
+}
+
+template <typename Function>
+std::size_t Segments::scan(const Segment& segment,
+                           std::size_t    limit,
+                           Function&&     visit) const {
+  std::size_t offset = 0;
+  std::size_t end = 0;
+  std::string name;
+
+  while (offset + sizeof(Record) <= limit) {
+    Record record;
+    if (!read_at(segment.fd, &record, sizeof(record), offset)) {
+      break;
+    }
+
+    bool valid = record.magic == RECORD_MAGIC &&
+                 offset + record_size(record.name_size, record.size) <= limit;
+    if (valid) {
+      name.resize(record.name_size);
+      valid = read_at(segment.fd, name.data(), name.size(),
+                      offset + sizeof(record));
+    }
+
+    if (valid) {
+      auto check = record;
+      check.check = 0;
+
+      util::XXHash64 hash;
+      hash.update(&check, sizeof(check));
+      hash.update(name.data(), name.size());
+      valid = static_cast<std::uint32_t>(hash.digest()) == record.check;
+    }
+
+    if (!valid) {
+      // never written, or torn by a crash while later records made it
+      offset = seek(segment.fd, offset + ALIGNMENT, limit);
+      continue;
+    }
+
+    visit(offset, record, name);
+
+    offset += record_size(record.name_size, record.size);
+    end = offset;
+  }
+
+  return end;
+}
+
+bool Segments::rebuild() {
+  const auto  begin = monotonic_micros();
+  std::size_t dropped = 0;
+
+  for (auto& [id, segment] : segments_) {
+    // a crash may have left the file shorter than a segment
+    struct stat status;
+    auto        limit = config()->segment_size();
+    if (::fstat(segment->fd, &status) == 0) {
+      limit = static_cast<std::size_t>(status.st_size);
+    }
+
+    const auto& current = segment;
+    segment->end = scan(
+        *segment, limit,
+        [this, &current, &dropped](std::size_t        offset,
+                                   const Record&      record,
+                                   const std::string& name) {
+          if (record.type == record_t::tombstone) {
+            auto* slot = find(key_of(name));
+            if (slot != nullptr && slot->segment == record.target &&
+                slot->offset == record.checksum) {
+              erase(slot);
+            }
+            return;
+          }
+
+          if (record.type != record_t::file) {
+            return;
+          }
+
+          // the header made it, the content may not have, checked when read
+          // so startup does not grow with the backlog
+          Location location;
+          location.segment = current;
+          location.offset = offset;
+          location.name_size = name.size();
+          location.size = record.size;
+          if (!put(key_of(name), location)) {
+            dropped += 1;
+          }
+        });
+
+    // appending goes on after the last record of the last segment
+    active_ = segment;
+  }
+
+  LOG_INFO(
+      "Rebuilt index of {} in {} us, {} images in {} segments, dropped {} "
+      "records",
+      config()->segments_dir(), monotonic_micros() - begin, header()->count,
+      segments_.size(), dropped);
+  return true;
+}
+
+bool Segments::rehash() {
+  const auto count = static_cast<std::size_t>(header()->count);
+  const auto path = fmt::format("{}/{}", config()->segments_dir(), INDEX_FILE);
+  const auto temp = fmt::format("{}.tmp", path);
+
+  // grows while more than half used, otherwise only drops removed slots
+  const auto capacity = capacity_for(count * 2);
+
+  const int   fd = index_fd_;
+  void* const index = index_;
+  const auto  size = index_size_;
+  const auto* previous = static_cast<const Header*>(index);
+  const auto* old_slots = reinterpret_cast<const Slot*>(previous + 1);
+  const auto  old_capacity = static_cast<std::size_t>(previous->capacity);
+
+  if (!map(temp, capacity)) {
+    return false;
+  }
+
+  header()->active = previous->active;
+  header()->end = previous->end;
+
+  const auto mask = capacity - 1;
+  for (std::size_t i = 0; i < old_capacity; ++i) {
+    const auto& slot = old_slots[i];
+    if (slot.state != SLOT_USED) {
+      continue;
+    }
+
+    auto j = static_cast<std::size_t>(slot.key) & mask;
+    while (slots()[j].state != SLOT_EMPTY) {
+      j = (j + 1) & mask;
+    }
+    slots()[j] = slot;
+    header()->count += 1;
+    header()->used += 1;
+  }
+
+  if (::rename(temp.c_str(), path.c_str()) != 0) {
+    LOG_ERROR("Cannot replace index {}: {}", path, std::strerror(errno));
+    unmap();
+    ::unlink(temp.c_str());
+    index_fd_ = fd;
+    index_ = index;
+    index_size_ = size;
+    return false;
+  }
+
+  ::munmap(index, size);
+  ::close(fd);
+
+  LOG_INFO("Resized index of {} from {} to {} slots for {} images",
+           config()->segments_dir(), old_capacity, capacity, count);
+  return true;
+}
+
+Segments::Slot* Segments::find(std::uint64_t key) const {
+  const auto mask = static_cast<std::size_t>(header()->capacity) - 1;
+  for (auto i = static_cast<std::size_t>(key) & mask;; i = (i + 1) & mask) {
+    auto& slot = slots()[i];
+    if (slot.state == SLOT_EMPTY) {
+      return nullptr;
+    }
+    if (slot.state == SLOT_USED && slot.key == key) {
+      return &slot;
+    }
+  }
+}
+
+bool Segments::put(std::uint64_t key, const Location& location) {
+  // open addressing slows down past 3/4 of the slots
+  if ((header()->used + 1) * 4 > header()->capacity * 3 && !rehash() &&
+      header()->used + 1 >= header()->capacity) {
+    LOG_ERROR("Index of {} is full", config()->segments_dir());
+    return false;
+  }
+
+  const auto mask = static_cast<std::size_t>(header()->capacity) - 1;
+  Slot*      target = nullptr;
+  for (auto i = static_cast<std::size_t>(key) & mask;; i = (i + 1) & mask) {
+    auto& slot = slots()[i];
+    if (slot.state == SLOT_EMPTY) {
+      if (target == nullptr) {
+        target = &slot;
+        header()->used += 1;
+      }
+      break;
+    }
+
+    if (slot.state == SLOT_REMOVED) {
+      target = target == nullptr ? &slot : target;
+      continue;
+    }
+
+    if (slot.key == key) {
+      // replaced, the previous record is no longer in use
+      erase(&slot);
+      target = target == nullptr ? &slot : target;
+      break;
+    }
+  }
+
+  const auto size = record_size(location.name_size, location.size);
+  *target = Slot{key,
+                 location.offset,
+                 location.segment->id,
+                 static_cast<std::uint32_t>(location.size),
+                 static_cast<std::uint16_t>(location.name_size),
+                 SLOT_USED,
+                 0};
+  header()->count += 1;
+  location.segment->live += size;
+  return true;
+}
+
+void Segments::erase(Slot* slot) {
+  auto it = segments_.find(slot->segment);
+  if (it != segments_.end()) {
+    it->second->live -= record_size(slot->name_size, slot->size);
+  }
+
+  // probing goes on past removed slots
+  slot->state = SLOT_REMOVED;
+  header()->count -= 1;
+}
+
+Segments::Location Segments::locate(const Slot& slot) const {
+  Location location;
+  auto     it = segments_.find(slot.segment);
+  if (it != segments_.end()) {
+    location.segment = it->second;
+    location.offset = static_cast<std::size_t>(slot.offset);
+    location.name_size = slot.name_size;
+    location.size = slot.size;
+  }
+  return location;
+}
+
+bool Segments::reserve(std::size_t size, Location& location) {
+  if (size > config()->segment_size()) {
+    return false;
+  }
+
+  if (!active_ || active_->end + size > config()->segment_size()) {
+    if (!roll()) {
+      return false;
+    }
+  }
+
+  location.segment = active_;
+  location.offset = active_->end;
+  active_->end += size;
+  active_->writing += 1;
+  return true;
+}
+
+void Segments::release(const Location& location) {
+  if (!location.segment) {
+    return;
+  }
+
+  location.segment->writing -= 1;
+  if (location.segment->writing == 0 && location.segment != active_) {
+    // sealed while being written, may be compacted now
+    signal_.notify_one();
+  }
+}
+
+bool Segments::roll() {
+  const std::uint32_t id =
+      segments_.empty() ? 1 : segments_.rbegin()->first + 1;
+  const auto path = segment_path(id);
+
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    LOG_ERROR("Cannot create segment {}: {}", path, std::strerror(errno));
+    return false;
+  }
+
+  // extents allocated at once, appends never grow the file
+  int rc =
+      ::posix_fallocate(fd, 0, static_cast<off_t>(config()->segment_size()));
+  if (rc != 0) {
+    LOG_ERROR("Cannot allocate segment {}: {}", path, std::strerror(rc));
+    ::close(fd);
+    ::unlink(path.c_str());
+    return false;
+  }
+
+  sync_directory(config()->segments_dir());
+
+  auto segment = std::make_shared<Segment>();
+  segment->id = id;
+  segment->fd = fd;
+  segments_[id] = segment;
+  active_ = std::move(segment);
+
+  // the previous segment may be compacted now
+  signal_.notify_one();
+
+  LOG_DEBUG("Created segment {}", path);
+  return true;
+}
+
+bool Segments::write(const Location&     location,
+                     record_t            type,
+                     const std::string&  name,
+                     const std::uint8_t* data,
+                     std::size_t         size,
+                     std::uint64_t       checksum,
+                     std::uint32_t       target,
+                     bool                flush) const {
+  Record record{RECORD_MAGIC,
+                static_cast<std::uint16_t>(name.size()),
+                type,
+                static_cast<std::uint32_t>(size),
+                target,
+                checksum,
+                0,
+                0};
+
+  util::XXHash64 hash;
+  hash.update(&record, sizeof(record));
+  hash.update(name.data(), name.size());
+  record.check = static_cast<std::uint32_t>(hash.digest());
+
+  // header and name in one write, the content right after
+  thread_local std::vector<std::uint8_t> head;
+  head.resize(sizeof(record) + name.size());
+  std::memcpy(head.data(), &record, sizeof(record));
+  std::memcpy(head.data() + sizeof(record), name.data(), name.size());
+
+  const int fd = location.segment->fd;
+  bool      ok = write_at(fd, head.data(), head.size(), location.offset) &&
+            write_at(fd, data, size, location.offset + head.size()) &&
+            (!flush || ::fdatasync(fd) == 0);
+  if (!ok) {
+    // skipped by a rebuild, the room is lost until the segment is compacted
+    LOG_ERROR("Cannot write {} to segment {}: {}", name,
+              location.segment->id, std::strerror(errno));
+  }
+
+  return ok;
+}
+
+bool Segments::append(const std::string&  name,
+                      const std::uint8_t* data,
+                      std::size_t         size,
+                      bool                flush,
+                      util::XXHash64&     hash) {
+  if (name.size() > UINT16_MAX || size > UINT32_MAX) {
+    LOG_ERROR("Cannot store {}, too large for a segment", name);
+    return false;
+  }
+
+  hash.update(data, size);
+
+  Location location;
+  location.name_size = name.size();
+  location.size = size;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!reserve(record_size(name.size(), size), location)) {
+      LOG_ERROR("Cannot store {}, no room in a segment", name);
+      return false;
+    }
+  }
+
+  // concurrent appends write their own room in parallel
+  const auto checksum = util::XXHash64::hash(data, size);
+  const bool ok = write(location, record_t::file, name, data, size, checksum,
+                        0, flush);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  release(location);
+  return ok && put(key_of(name), location);
+}
+
+bool Segments::read(const std::string&         name,
+                    std::vector<std::uint8_t>& data) {
+  Location location;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto*                       slot = find(key_of(name));
+    if (slot == nullptr) {
+      return false;
+    }
+    location = locate(*slot);
+  }
+
+  if (!location.segment) {
+    return false;
+  }
+
+  // names are only told apart by their hash in the index
+  Record      record;
+  std::string stored(location.name_size, '\0');
+  if (!read_at(location.segment->fd, &record, sizeof(record),
+               location.offset) ||
+      !read_at(location.segment->fd, stored.data(), stored.size(),
+               location.offset + sizeof(record)) ||
+      stored != name) {
+    LOG_ERROR("Cannot find {} in segment {}", name, location.segment->id);
+    return false;
+  }
+
+  data.resize(location.size);
+  if (!read_at(location.segment->fd, data.data(), data.size(),
+               location.offset + sizeof(Record) + stored.size())) {
+    LOG_ERROR("Cannot read {} from segment {}: {}", name,
+              location.segment->id, std::strerror(errno));
+    return false;
+  }
+
+  // not verified by a rebuild, torn by a crash while its header made it
+  if (util::XXHash64::hash(data.data(), data.size()) != record.checksum) {
+    LOG_ERROR("Content of {} in segment {} is damaged, removing it", name,
+              location.segment->id);
+    drop(name, location);
+    return false;
+  }
+
+  return true;
+}
+
+bool Segments::contains(const std::string& name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return find(key_of(name)) != nullptr;
+}
+
+bool Segments::rename(const std::string& from, const std::string& to) {
+  std::vector<std::uint8_t> data;
+  if (!read(from, data)) {
+    return false;
+  }
+
+  util::XXHash64 hash;
+  if (!append(to, data.data(), data.size(), false, hash)) {
+    return false;
+  }
+
+  remove(from);
+  return true;
+}
+
+void Segments::remove(const std::string& name) {
+  Location removed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto*                       slot = find(key_of(name));
+    if (slot == nullptr) {
+      return;
+    }
+
+    removed = locate(*slot);
+    erase(slot);
+  }
+
+  if (removed.segment) {
+    bury(name, removed);
+  }
+
+  signal_.notify_one();
+}
+
+void Segments::bury(const std::string& name, const Location& removed) {
+  Location location;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!reserve(record_size(name.size(), 0), location)) {
+      // only costs a rebuild the work of dropping the file again
+      LOG_WARN("Cannot record removal of {}", name);
+      return;
+    }
+  }
+
+  write(location, record_t::tombstone, name, nullptr, 0, removed.offset,
+        removed.segment->id, false);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  release(location);
+}
+
+void Segments::drop(const std::string& name, const Location& damaged) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto*                       slot = find(key_of(name));
+    if (slot == nullptr || slot->segment != damaged.segment->id ||
+        slot->offset != damaged.offset) {
+      return;
+    }
+    erase(slot);
+  }
+
+  bury(name, damaged);
+  signal_.notify_one();
+}
+
+void Segments::sync() const {
+  sync_directory(config()->segments_dir());
+}
+
+std::unordered_set<std::string> Segments::names() const {
+  std::vector<Location> locations;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::size_t i = 0; i < header()->capacity; ++i) {
+      if (slots()[i].state == SLOT_USED) {
+        locations.push_back(locate(slots()[i]));
+      }
+    }
+  }
+
+  std::unordered_set<std::string> names;
+  std::string                     name;
+  for (const auto& location : locations) {
+    name.resize(location.name_size);
+    if (location.segment &&
+        read_at(location.segment->fd, name.data(), name.size(),
+                location.offset + sizeof(Record))) {
+      names.insert(name);
+    }
+  }
+
+  return names;
+}
+
+std::size_t Segments::count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return static_cast<std::size_t>(header()->count);
+}
+
+std::size_t Segments::segments() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return segments_.size();
+}
+
+std::size_t Segments::live_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::size_t live = 0;
+  for (const auto& [id, segment] : segments_) {
+    live += segment->live;
+  }
+  return live;
+}
+
+std::shared_ptr<Segments::Segment> Segments::next() const {
+  const auto threshold =
+      config()->segment_size() / 100 * config()->segments_compact();
+
+  for (const auto& [id, segment] : segments_) {
+    // records still being written may be put in the index later
+    if (segment != active_ && segment->writing == 0 &&
+        (segment->live == 0 || segment->live < threshold)) {
+      return segment;
+    }
+  }
+
+  return nullptr;
+}
+
+void Segments::execute() {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (running_) {
+    auto segment = next();
+    if (!segment) {
+      signal_.wait(lock);
+      continue;
+    }
+
+    lock.unlock();
+    bool ok = compact(segment);
+    segment.reset();
+    lock.lock();
+
+    if (!ok && running_) {
+      // flash full or failing, do not spin on it
+      signal_.wait_for(lock, std::chrono::seconds(1));
+    }
+  }
+}
+
+bool Segments::compact(const std::shared_ptr<Segment>& segment) {
+  const auto  begin = monotonic_micros();
+  std::size_t moved = 0;
+  bool        ok = true;
+
+  std::vector<std::uint8_t> data;
+  scan(*segment, segment->end,
+       [this, &segment, &data, &moved, &ok](std::size_t        offset,
+                                            const Record&      record,
+                                            const std::string& name) {
+         if (!ok) {
+           return;
+         }
+
+         if (record.type == record_t::tombstone) {
+           // needed as long as the removed record may be read by a rebuild
+           Location location;
+           {
+             std::lock_guard<std::mutex> lock(mutex_);
+             if (record.target == segment->id ||
+                 segments_.count(record.target) == 0) {
+               return;
+             }
+             ok = reserve(record_size(name.size(), 0), location);
+           }
+           ok = ok && write(location, record_t::tombstone, name, nullptr, 0,
+                            record.checksum, record.target, false);
+
+           std::lock_guard<std::mutex> lock(mutex_);
+           release(location);
+           return;
+         }
+
+         if (record.type != record_t::file) {
+           return;
+         }
+
+         const auto key = key_of(name);
+         const auto in_use = [this, &segment, offset, key] {
+           auto* slot = find(key);
+           return slot != nullptr && slot->segment == segment->id &&
+                  slot->offset == offset;
+         };
+
+         Location source;
+         source.segment = segment;
+         source.offset = offset;
+         source.name_size = name.size();
+         source.size = record.size;
+         {
+           std::lock_guard<std::mutex> lock(mutex_);
+           if (!in_use()) {
+             return;
+           }
+         }
+
+         data.resize(record.size);
+         if (!read_at(segment->fd, data.data(), data.size(),
+                      offset + sizeof(record) + name.size())) {
+           ok = false;
+           return;
+         }
+
+         // not verified by a rebuild, a damaged copy is not carried over
+         if (util::XXHash64::hash(data.data(), data.size()) !=
+             record.checksum) {
+           LOG_WARN("Content of {} in segment {} is damaged, removing it",
+                    name, segment->id);
+           drop(name, source);
+           return;
+         }
+
+         Location location;
+         location.name_size = name.size();
+         location.size = record.size;
+         {
+           std::lock_guard<std::mutex> lock(mutex_);
+           ok = reserve(record_size(name.size(), record.size), location);
+         }
+
+         ok = ok && write(location, record_t::file, name, data.data(),
+                          data.size(), record.checksum, 0, false);
+
+         {
+           std::lock_guard<std::mutex> lock(mutex_);
+           release(location);
+           if (!ok) {
+             return;
+           }
+
+           if (in_use()) {
+             const auto size = record_size(name.size(), record.size);
+             auto*      slot = find(key);
+             slot->segment = location.segment->id;
+             slot->offset = location.offset;
+             segment->live -= size;
+             location.segment->live += size;
+             moved += 1;
+             return;
+           }
+         }
+
+         // removed while being copied, the copy must stay removed
+         bury(name, location);
+       });
+
+  if (!ok) {
+    LOG_WARN("Cannot compact segment {}", segment->id);
+    return false;
+  }
+
+  // copies are on the disk before the originals are gone
+  std::vector<std::shared_ptr<Segment>> newer;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (segment->live != 0) {
+      LOG_WARN("Segment {} still holds {} bytes in use, keeping it",
+               segment->id, segment->live);
+      return false;
+    }
+
+    for (auto it = segments_.upper_bound(segment->id); it != segments_.end();
+         ++it) {
+      newer.push_back(it->second);
+    }
+  }
+
+  for (const auto& other : newer) {
+    if (::fdatasync(other->fd) != 0) {
+      LOG_WARN("Cannot flush segment {}: {}", other->id, std::strerror(errno));
+      return false;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    segments_.erase(segment->id);
+  }
+
+  // readers still holding the segment keep its file open
+  ::unlink(segment_path(segment->id).c_str());
+  sync();
+
+  compacted_ += 1;
+  LOG_INFO("Compacted segment {} in {} us, moved {} images", segment->id,
+           monotonic_micros() - begin, moved);
+  return true;
+}
+}  // namespace storage
+
+NAMESPACE_END
@@ -0,0 +1,617 @@
+#ifndef LIB_STORAGE_SEGMENTS_HPP_
+#define LIB_STORAGE_SEGMENTS_HPP_
+
+/** @file segments.hpp
+ *  @brief Segmented image store
+ *
+ * Image files appended to large pre-allocated segment files, found through
+ * a memory-mapped index
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <libcore/core.hpp>
+#include <libutil/util.hpp>
+
+NAMESPACE_BEGIN
+
+namespace storage {
+// forward declarations
+class Config;
+
+/**
+ * @brief Segmented image store
+ *
+ * Keeps image files, known by name, as records appended to segment files
+ * of a fixed size, allocated when created, so flash and the file system
+ * only see a few large files instead of a create and an unlink per image.
+ *
+ *   - segment-NNNNNN, records of one name and its content each; a removed
+ *     file is recorded as a tombstone, records are never changed
+ *   - index, an open addressing table from the name hash to the segment,
+ *     offset and size of its last record, mapped in memory
+ *
+ * The index is only trusted if it has been closed cleanly, otherwise it is
+ * rebuilt from the record headers on open, records with a damaged header
+ * are dropped. Contents are only verified when read or compacted, so a
+ * rebuild does not read the whole store.
+ *
+ * Removing files leaves unused space in their segments. A background
+ * thread rewrites the records still in use of the oldest segment below the
+ * compaction threshold at the end of the current segment, then deletes
+ * it. Images are uploaded in order, so most segments are deleted without
+ * copying anything.
+ *
+ * Safe to use from several threads at once
+ */
+class Segments {
+ public:
+  /**
+   * Name of the index file
+   */
+  static constexpr const char* INDEX_FILE = "index";
+
+  /**
+   * Segments constructor, opens or creates the store and starts the
+   * compactor
+   *
+   * @param config storage configuration
+   */
+  Segments(const Config* config);
+
+  /**
+   * Segments destructor, flushes the index
+   */
+  ~Segments();
+
+  /**
+   * Check whether the store has been opened
+   *
+   * @return true if the store can be used
+   */
+  inline bool ready() const { return ready_; }
+
+  /**
+   * Append a file, replaces a file of the same name
+   *
+   * @param name  file name
+   * @param data  file content
+   * @param size  file size
+   * @param flush flush the segment to the disk before returning
+   * @param hash  fed with the content
+   *
+   * @return true if success
+   */
+  bool append(const std::string&  name,
+              const std::uint8_t* data,
+              std::size_t         size,
+              bool                flush,
+              util::XXHash64&     hash);
+
+  /**
+   * Read a file
+   *
+   * @param name file name
+   * @param data file content
+   *
+   * @return true if the file exists and has been read, a damaged file is
+   *         removed
+   */
+  bool read(const std::string& name, std::vector<std::uint8_t>& data);
+
+  /**
+   * Check whether a file exists
+   *
+   * @param name file name
+   *
+   * @return true if file exists
+   */
+  bool contains(const std::string& name) const;
+
+  /**
+   * Rename a file, its content is appended again
+   *
+   * @param from current file name
+   * @param to   new file name
+   *
+   * @return true if success
+   */
+  bool rename(const std::string& from, const std::string& to);
+
+  /**
+   * Remove a file
+   *
+   * @param name file name
+   */
+  void remove(const std::string& name);
+
+  /**
+   * Flush new segment files to the disk
+   */
+  void sync() const;
+
+  /**
+   * List files
+   *
+   * @return file names
+   */
+  std::unordered_set<std::string> names() const;
+
+  /**
+   * Get number of files
+   *
+   * @return number of files
+   */
+  std::size_t count() const;
+
+  /**
+   * Get number of segment files
+   *
+   * @return number of segments
+   */
+  std::size_t segments() const;
+
+  /**
+   * Get size of the files in use
+   *
+   * @return size in bytes, records included
+   */
+  std::size_t live_bytes() const;
+
+  /**
+   * Get number of segments compacted or deleted
+   *
+   * @return number of segments
+   */
+  inline std::uint64_t compacted() const { return compacted_; }
+
+ private:
+  /**
+   * Record type
+   */
+  enum class record_t : std::uint16_t {
+    file = 1,
+    tombstone = 2,
+  };
+
+  /**
+   * Record header, followed by the name and the content, records are
+   * aligned on 8 bytes
+   */
+  struct Record {
+    /**
+     * Record magic
+     */
+    std::uint32_t magic;
+    /**
+     * Name size
+     */
+    std::uint16_t name_size;
+    /**
+     * Record type
+     */
+    record_t type;
+    /**
+     * Content size
+     */
+    std::uint32_t size;
+    /**
+     * Segment of the removed record, tombstones only
+     */
+    std::uint32_t target;
+    /**
+     * Content hash, offset of the removed record for tombstones
+     */
+    std::uint64_t checksum;
+    /**
+     * Hash of the header and the name
+     */
+    std::uint32_t check;
+    /**
+     * Unused, zero
+     */
+    std::uint32_t reserved;
+  };
+
+  /**
+   * Index header
+   */
+  struct Header {
+    /**
+     * Index magic
+     */
+    std::uint64_t magic;
+    /**
+     * Index version
+     */
+    std::uint32_t version;
+    /**
+     * Closed cleanly, cleared while the index is open
+     */
+    std::uint32_t clean;
+    /**
+     * Number of slots, a power of two
+     */
+    std::uint64_t capacity;
+    /**
+     * Number of files
+     */
+    std::uint64_t count;
+    /**
+     * Number of slots not empty, files and removed
+     */
+    std::uint64_t used;
+    /**
+     * Segment appended to
+     */
+    std::uint32_t active;
+    /**
+     * Unused, zero
+     */
+    std::uint32_t reserved;
+    /**
+     * End of the records of the active segment
+     */
+    std::uint64_t end;
+    /**
+     * Unused, zero
+     */
+    std::uint64_t padding;
+  };
+
+  /**
+   * Index slot
+   */
+  struct Slot {
+    /**
+     * Name hash
+     */
+    std::uint64_t key;
+    /**
+     * Record offset
+     */
+    std::uint64_t offset;
+    /**
+     * Record segment
+     */
+    std::uint32_t segment;
+    /**
+     * Content size
+     */
+    std::uint32_t size;
+    /**
+     * Name size
+     */
+    std::uint16_t name_size;
+    /**
+     * Slot state, empty, used or removed
+     */
+    std::uint16_t state;
+    /**
+     * Unused, zero
+     */
+    std::uint32_t reserved;
+  };
+
+  /**
+   * Segment file
+   */
+  struct Segment {
+    /**
+     * Segment destructor, closes the file
+     */
+    ~Segment();
+
+    /**
+     * Segment number
+     */
+    std::uint32_t id = 0;
+    /**
+     * File descriptor, kept open by readers while being deleted
+     */
+    int fd = -1;
+    /**
+     * End of the records, appended to if active
+     */
+    std::size_t end = 0;
+    /**
+     * Size of the records in use
+     */
+    std::size_t live = 0;
+    /**
+     * Number of records reserved and not written yet, not compacted until
+     * none is left
+     */
+    std::size_t writing = 0;
+  };
+
+  /**
+   * Location of a record
+   */
+  struct Location {
+    /**
+     * Segment
+     */
+    std::shared_ptr<Segment> segment;
+    /**
+     * Record offset
+     */
+    std::size_t offset = 0;
+    /**
+     * Name size
+     */
+    std::size_t name_size = 0;
+    /**
+     * Content size
+     */
+    std::size_t size = 0;
+  };
+
+  /**
+   * Open the index and the segments, rebuilds the index if needed
+   *
+   * @return true if success
+   */
+  bool open();
+
+  /**
+   * Map the index file
+   *
+   * @param path     index file path
+   * @param capacity number of slots, 0 to map the existing file
+   *
+   * @return true if success
+   */
+  bool map(const std::string& path, std::size_t capacity);
+
+  /**
+   * Unmap the index file
+   */
+  void unmap();
+
+  /**
+   * Rebuild the index from the records of every segment
+   *
+   * @return true if success
+   */
+  bool rebuild();
+
+  /**
+   * Grow the index, or clear removed slots, must hold mutex
+   *
+   * @return true if success
+   */
+  bool rehash();
+
+  /**
+   * Visit records of a segment in order, damaged records are skipped
+   *
+   * @param segment segment
+   * @param limit   end of the area to scan
+   * @param visit   called with the offset, header and name of every record
+   *
+   * @return end of the last record
+   */
+  template <typename Function>
+  std::size_t scan(const Segment& segment,
+                   std::size_t    limit,
+                   Function&&     visit) const;
+
+  /**
+   * Find the slot of a name, must hold mutex
+   *
+   * @param key name hash
+   *
+   * @return slot, null if missing
+   */
+  Slot* find(std::uint64_t key) const;
+
+  /**
+   * Point a name to a record, must hold mutex
+   *
+   * @param key      name hash
+   * @param location record
+   *
+   * @return true if success, false if the index is full
+   */
+  bool put(std::uint64_t key, const Location& location);
+
+  /**
+   * Remove a name, must hold mutex
+   *
+   * @param slot slot of the name
+   */
+  void erase(Slot* slot);
+
+  /**
+   * Get location of a slot, must hold mutex
+   *
+   * @param slot slot
+   *
+   * @return location, no segment if it does not exist
+   */
+  Location locate(const Slot& slot) const;
+
+  /**
+   * Reserve room for a record at the end of the active segment, must hold
+   * mutex
+   *
+   * @param size     record size
+   * @param location reserved room
+   *
+   * @return true if success
+   */
+  bool reserve(std::size_t size, Location& location);
+
+  /**
+   * Release reserved room once written or given up, must hold mutex
+   *
+   * @param location reserved room, nothing is done without a segment
+   */
+  void release(const Location& location);
+
+  /**
+   * Create the next segment and append to it, must hold mutex
+   *
+   * @return true if success
+   */
+  bool roll();
+
+  /**
+   * Write a record into reserved room
+   *
+   * @param location reserved room
+   * @param type     record type
+   * @param name     file name
+   * @param data     content
+   * @param size     content size
+   * @param checksum content hash, offset of the removed record for
+   *                 tombstones
+   * @param target   segment of the removed record, tombstones only
+   * @param flush    flush the segment to the disk
+   *
+   * @return true if success
+   */
+  bool write(const Location&     location,
+             record_t            type,
+             const std::string&  name,
+             const std::uint8_t* data,
+             std::size_t         size,
+             std::uint64_t       checksum,
+             std::uint32_t       target,
+             bool                flush) const;
+
+  /**
+   * Append a tombstone, so a rebuild does not bring a removed record back
+   *
+   * @param name    file name
+   * @param removed removed record
+   */
+  void bury(const std::string& name, const Location& removed);
+
+  /**
+   * Remove a name whose content does not match its checksum
+   *
+   * @param name    file name
+   * @param damaged damaged record, nothing is done if the name has moved
+   */
+  void drop(const std::string& name, const Location& damaged);
+
+  /**
+   * Compactor loop
+   */
+  void execute();
+
+  /**
+   * Pick the next segment to compact, oldest first, must hold mutex
+   *
+   * @return segment, null if none
+   */
+  std::shared_ptr<Segment> next() const;
+
+  /**
+   * Move records in use out of a segment, then delete it
+   *
+   * @param segment segment
+   *
+   * @return true if deleted
+   */
+  bool compact(const std::shared_ptr<Segment>& segment);
+
+  /**
+   * Get path of a segment file
+   *
+   * @param id segment number
+   *
+   * @return segment path
+   */
+  std::string segment_path(std::uint32_t id) const;
+
+  /**
+   * Get index header, must hold mutex
+   *
+   * @return index header
+   */
+  inline Header* header() const { return static_cast<Header*>(index_); }
+
+  /**
+   * Get index slots, must hold mutex
+   *
+   * @return index slots
+   */
+  inline Slot* slots() const {
+    return reinterpret_cast<Slot*>(static_cast<Header*>(index_) + 1);
+  }
+
+  /**
+   * Get config
+   *
+   * @return storage config
+   */
+  inline const Config* config() const { return config_; }
+
+ private:
+  /**
+   * Configuration
+   */
+  const Config* config_;
+  /**
+   * Opened
+   */
+  bool ready_;
+  /**
+   * Index file descriptor
+   */
+  int index_fd_;
+  /**
+   * Mapped index
+   */
+  void* index_;
+  /**
+   * Size of the mapped index
+   */
+  std::size_t index_size_;
+  /**
+   * Segments by number
+   */
+  std::map<std::uint32_t, std::shared_ptr<Segment>> segments_;
+  /**
+   * Segment appended to, null until the first record
+   */
+  std::shared_ptr<Segment> active_;
+  /**
+   * Index and segments mutex
+   */
+  mutable std::mutex mutex_;
+  /**
+   * Signalled when a segment may be compacted or the store closes
+   */
+  std::condition_variable signal_;
+  /**
+   * Running status
+   */
+  bool running_;
+  /**
+   * Number of segments compacted or deleted
+   */
+  std::atomic<std::uint64_t> compacted_;
+  /**
+   * Compactor thread
+   */
+  std::thread compactor_;
+};
+}  // namespace storage
+
+NAMESPACE_END
+
+#endif  // LIB_STORAGE_SEGMENTS_HPP_
@@ -0,0 +1,514 @@
+#include "storage.hpp"
+
+#include "spool.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "config.hpp"
+#include "segments.hpp"
+
+NAMESPACE_BEGIN
+
+namespace storage {
+/**
+ * Check whether a name ends with a suffix
+ *
+ * @param name   name
+ * @param suffix suffix
+ *
+ * @return true if name ends with suffix
+ */
+static bool ends_with(std::string_view name, std::string_view suffix) {
+  return name.size() >= suffix.size() &&
+         name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+ * Write whole buffer to a temporary file, then rename it
+ *
+ * @param path  file path
+ * @param data  buffer
+ * @param size  buffer size
+ * @param flush flush file to the disk before returning
+ * @param hash  fed with every chunk as it is written
+ *
+ * @return true if success
+ */
+static bool write_file(const std::string&  path,
+                       const std::uint8_t* data,
+                       std::size_t         size,
+                       bool                flush,
+                       util::XXHash64&     hash) {
+  // the file only appears under its name once complete
+  const auto temp = fmt::format("{}{}", path, Spool::TEMP_SUFFIX);
+
+  int fd =
+      ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    LOG_ERROR("Cannot open {}: {}", temp, std::strerror(errno));
+    return false;
+  }
+
+  bool ok = true;
+  while (size > 0) {
+    auto written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ok = false;
+      break;
+    }
+    hash.update(data, static_cast<std::size_t>(written));
+    data += written;
+    size -= static_cast<std::size_t>(written);
+  }
+
+  if (ok && flush && ::fsync(fd) != 0) {
+    ok = false;
+  }
+
+  if (::close(fd) != 0) {
+    ok = false;
+  }
+
+  if (ok && ::rename(temp.c_str(), path.c_str()) != 0) {
+    ok = false;
+  }
+
+  if (!ok) {
+    LOG_ERROR("Cannot write {}: {}", path, std::strerror(errno));
+    ::unlink(temp.c_str());
+  }
+
+  return ok;
+}
+
+/**
+ * Flush directory entries to the disk, so new files survive a power loss
+ *
+ * @param path directory path
+ */
+static void sync_directory(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0 || ::fsync(fd) != 0) {
+    LOG_WARN("Cannot flush {}: {}", path, std::strerror(errno));
+  }
+
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+Spool::Spool(const Config* config)
+    : config_{config},
+      staging_{false},
+      threshold_{0},
+      staged_bytes_{0},
+      flushed_{0},
+      running_{false} {
+  massert(config != nullptr, "sanity");
+
+  if (config->segments()) {
+    segments_ = std::make_unique<Segments>(config);
+    if (segments_->ready()) {
+      // appended to large files on the flash, not worth staging
+      return;
+    }
+
+    LOG_ERROR("Cannot open segments in {}, writing one file per image",
+              config->segments_dir());
+    segments_.reset();
+  }
+
+  // acknowledged trays must be on the flash with fsync durability
+  staging_ = !config->staging_dir().empty() &&
+             config->durability() != durability_t::fsync;
+  if (!staging()) {
+    return;
+  }
+
+  std::error_code ec;
+  fs::create_directories(config->staging_dir(), ec);
+  if (ec) {
+    LOG_ERROR("Cannot create staging directory {}: {}", config->staging_dir(),
+              ec.message());
+    staging_ = false;
+    return;
+  }
+
+  threshold_ = config->staging_budget() / 4 * 3;
+  running_ = true;
+  flusher_ = std::thread(&Spool::execute, this);
+
+  LOG_INFO("Staging images in {} up to {} MiB for {} s",
+           config->staging_dir(), config->staging_budget() / (1024 * 1024),
+           config->staging_age());
+}
+
+Spool::~Spool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  signal_.notify_all();
+
+  if (flusher_.joinable()) {
+    flusher_.join();
+  }
+}
+
+std::string Spool::staged_path(const std::string& name) const {
+  return fmt::format("{}/{}", config()->staging_dir(), name);
+}
+
+std::string Spool::persistent_path(const std::string& name) const {
+  return fmt::format("{}/{}", config()->images_dir(), name);
+}
+
+bool Spool::write(const std::string&  name,
+                  const std::uint8_t* data,
+                  std::size_t         size,
+                  bool                flush,
+                  util::XXHash64&     hash) {
+  if (segmented()) {
+    return segments_->append(name, data, size, flush, hash);
+  }
+
+  bool staged = false;
+  if (staging() && !flush) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (staged_bytes_ + size <= config()->staging_budget()) {
+      // busy until written, the flusher must not pick it up before
+      entries_[name] = Entry{size, monotonic_micros(), true, false};
+      staged_bytes_ += size;
+      staged = true;
+    }
+  }
+
+  if (!staged) {
+    return write_file(persistent_path(name), data, size, flush, hash);
+  }
+
+  bool ok = write_file(staged_path(name), data, size, false, hash);
+
+  bool notify = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ok) {
+      entries_[name].busy = false;
+      notify = crowded();
+    } else {
+      staged_bytes_ -= size;
+      entries_.erase(name);
+    }
+  }
+
+  if (notify) {
+    signal_.notify_one();
+  }
+
+  return ok;
+}
+
+std::string Spool::path(const std::string& name) const {
+  if (staging()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        it = entries_.find(name);
+    if (it != entries_.end() && !it->second.removed) {
+      return staged_path(name);
+    }
+  }
+
+  return persistent_path(name);
+}
+
+bool Spool::read(const std::string&         name,
+                 std::vector<std::uint8_t>& data) const {
+  if (segmented() && segments_->read(name, data)) {
+    return true;
+  }
+
+  const auto    file = path(name);
+  std::ifstream input(file, std::ios::binary | std::ios::ate);
+  if (!input) {
+    LOG_ERROR("Cannot open {}", file);
+    return false;
+  }
+
+  data.resize(static_cast<std::size_t>(input.tellg()));
+  input.seekg(0);
+  if (!input.read(reinterpret_cast<char*>(data.data()),
+                  static_cast<std::streamsize>(data.size()))) {
+    LOG_ERROR("Cannot read {}", file);
+    return false;
+  }
+
+  return true;
+}
+
+bool Spool::exists(const std::string& name) const {
+  if (segmented() && segments_->contains(name)) {
+    return true;
+  }
+
+  std::error_code ec;
+  return fs::exists(path(name), ec);
+}
+
+bool Spool::rename(const std::string& from, const std::string& to) {
+  if (segmented() && segments_->contains(from)) {
+    return segments_->rename(from, to);
+  }
+
+  std::string source;
+  std::string target;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        it = entries_.find(from);
+    if (it != entries_.end()) {
+      if (it->second.busy) {
+        return false;
+      }
+
+      if (::rename(staged_path(from).c_str(), staged_path(to).c_str()) != 0) {
+        LOG_ERROR("Cannot rename {} to {}: {}", from, to,
+                  std::strerror(errno));
+        return false;
+      }
+
+      auto entry = it->second;
+      entries_.erase(it);
+      entries_[to] = entry;
+      return true;
+    }
+
+    source = persistent_path(from);
+    target = persistent_path(to);
+  }
+
+  if (::rename(source.c_str(), target.c_str()) != 0) {
+    LOG_ERROR("Cannot rename {} to {}: {}", from, to, std::strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+void Spool::remove(const std::string& name) {
+  if (segmented() && segments_->contains(name)) {
+    segments_->remove(name);
+    return;
+  }
+
+  if (staging()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        it = entries_.find(name);
+    if (it != entries_.end()) {
+      ::unlink(staged_path(name).c_str());
+
+      if (it->second.busy) {
+        // the flusher drops its copy once done
+        it->second.removed = true;
+      } else {
+        staged_bytes_ -= it->second.size;
+        entries_.erase(it);
+      }
+      return;
+    }
+  }
+
+  ::unlink(persistent_path(name).c_str());
+}
+
+void Spool::sync() const {
+  if (segmented()) {
+    segments_->sync();
+    return;
+  }
+
+  sync_directory(config()->images_dir());
+}
+
+std::unordered_set<std::string> Spool::files() {
+  std::unordered_set<std::string> names;
+  std::error_code                 ec;
+
+  for (const auto& entry :
+       fs::directory_iterator(config()->images_dir(), ec)) {
+    auto name = entry.path().filename().string();
+    if (ends_with(name, TEMP_SUFFIX)) {
+      fs::remove(entry.path(), ec);
+    } else if (!segmented() || entry.is_regular_file(ec)) {
+      names.insert(std::move(name));
+    }
+  }
+
+  if (segmented()) {
+    // files written before segments were enabled are uploaded as usual
+    names.merge(segments_->names());
+    return names;
+  }
+
+  if (!staging()) {
+    return names;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& entry :
+       fs::directory_iterator(config()->staging_dir(), ec)) {
+    auto name = entry.path().filename().string();
+    if (ends_with(name, TEMP_SUFFIX) || names.count(name) > 0) {
+      // temporary file, or already moved when the previous run stopped
+      fs::remove(entry.path(), ec);
+      continue;
+    }
+
+    auto size = static_cast<std::size_t>(fs::file_size(entry.path(), ec));
+    if (ec) {
+      size = 0;
+    }
+    if (entries_.count(name) == 0) {
+      entries_[name] = Entry{size, monotonic_micros(), false, false};
+      staged_bytes_ += size;
+    }
+    names.insert(std::move(name));
+  }
+
+  return names;
+}
+
+std::size_t Spool::staged() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+std::size_t Spool::staged_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return staged_bytes_;
+}
+
+std::string Spool::next(bool all) const {
+  const std::string* oldest = nullptr;
+  time_unit          staged_at = 0;
+  for (const auto& [name, entry] : entries_) {
+    if (entry.busy) {
+      continue;
+    }
+
+    if (oldest == nullptr || entry.staged_at < staged_at) {
+      oldest = &name;
+      staged_at = entry.staged_at;
+    }
+  }
+
+  if (oldest == nullptr) {
+    return {};
+  }
+
+  const auto age = config()->staging_age() * 1000000;
+  if (all || crowded() || monotonic_micros() - staged_at >= age) {
+    return *oldest;
+  }
+
+  return {};
+}
+
+void Spool::execute() {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  // anything still staged on shutdown is kept on the flash
+  bool stopping = false;
+  while (true) {
+    stopping = !running_;
+
+    auto name = next(stopping);
+    if (name.empty()) {
+      if (stopping) {
+        break;
+      }
+      signal_.wait_for(lock, std::chrono::seconds(1));
+      continue;
+    }
+
+    auto& entry = entries_[name];
+    entry.busy = true;
+    auto size = entry.size;
+
+    lock.unlock();
+    bool ok = flush(name, size);
+    lock.lock();
+
+    if (!ok) {
+      if (stopping) {
+        break;
+      }
+      // flash full or failing, do not spin on it
+      signal_.wait_for(lock, std::chrono::seconds(1));
+    }
+  }
+}
+
+bool Spool::flush(const std::string& name, std::size_t size) {
+  const auto source = staged_path(name);
+  const auto target = persistent_path(name);
+
+  // only one flusher, the buffer is reused for every file
+  static std::vector<std::uint8_t> buffer;
+  buffer.resize(size);
+
+  std::ifstream input(source, std::ios::binary);
+  bool          ok = input.read(reinterpret_cast<char*>(buffer.data()),
+                       static_cast<std::streamsize>(size))
+                .good();
+  input.close();
+
+  util::XXHash64 hash;
+  ok = ok && write_file(target, buffer.data(), size, true, hash);
+  if (ok) {
+    sync_directory(config()->images_dir());
+  }
+
+  bool removed = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        it = entries_.find(name);
+    removed = it->second.removed;
+    if (ok || removed) {
+      staged_bytes_ -= it->second.size;
+      entries_.erase(it);
+    } else {
+      it->second.busy = false;
+    }
+  }
+
+  if (removed) {
+    // uploaded while being moved
+    ::unlink(target.c_str());
+    return true;
+  }
+
+  if (!ok) {
+    LOG_ERROR("Cannot move {} out of staging", name);
+    return false;
+  }
+
+  ::unlink(source.c_str());
+  flushed_ += 1;
+  LOG_DEBUG("Moved {} out of staging", name);
+  return true;
+}
+}  // namespace storage
+
+NAMESPACE_END
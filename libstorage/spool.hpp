@@ -0,0 +1,331 @@
+#ifndef LIB_STORAGE_SPOOL_HPP_
+#define LIB_STORAGE_SPOOL_HPP_
+
+/** @file spool.hpp
+ *  @brief Image file spool
+ *
+ * Image files waiting for upload, optionally staged in RAM or appended to
+ * segment files
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <libcore/core.hpp>
+#include <libutil/util.hpp>
+
+NAMESPACE_BEGIN
+
+namespace storage {
+// forward declarations
+class Config;
+class Segments;
+
+/**
+ * @brief Image file spool
+ *
+ * Owns every image file between the writer and the upload, files are only
+ * known by name and may live in one of two directories:
+ *
+ *   - staging, a RAM-backed directory (tmpfs) used while it has room
+ *   - the images directory on persistent storage
+ *
+ * A background thread moves staged files to the images directory once they
+ * are older than the staging age, or oldest first while staged files use
+ * more than 3/4 of the budget. Files uploaded quickly are removed from RAM
+ * and never touch the flash. Everything still staged is moved on shutdown.
+ *
+ * Staging is bypassed with fsync durability, staged files do not survive a
+ * power loss.
+ *
+ * With segments enabled files are appended to the segment store instead and
+ * never staged, files written before are still found in the images
+ * directory until removed.
+ *
+ * Safe to use from several threads at once
+ */
+class Spool {
+ public:
+  /**
+   * Suffix of files being written
+   */
+  static constexpr const char* TEMP_SUFFIX = ".tmp";
+
+  /**
+   * Spool constructor, starts the flusher if staging is enabled
+   *
+   * @param config storage configuration
+   */
+  Spool(const Config* config);
+
+  /**
+   * Spool destructor, moves staged files to the images directory
+   */
+  ~Spool();
+
+  /**
+   * Write a new file atomically
+   *
+   * @param name  file name
+   * @param data  file content
+   * @param size  file size
+   * @param flush flush file to the disk, never staged
+   * @param hash  fed with every chunk as it is written
+   *
+   * @return true if success
+   */
+  bool write(const std::string&  name,
+             const std::uint8_t* data,
+             std::size_t         size,
+             bool                flush,
+             util::XXHash64&     hash);
+
+  /**
+   * Read a file
+   *
+   * A staged file may be moved to the images directory meanwhile, reading
+   * can fail once
+   *
+   * @param name file name
+   * @param data file content
+   *
+   * @return true if success
+   */
+  bool read(const std::string& name, std::vector<std::uint8_t>& data) const;
+
+  /**
+   * Check whether a file exists
+   *
+   * @param name file name
+   *
+   * @return true if file exists in either directory
+   */
+  bool exists(const std::string& name) const;
+
+  /**
+   * Rename a file, in the directory it lives in
+   *
+   * @param from current file name
+   * @param to   new file name
+   *
+   * @return true if success
+   */
+  bool rename(const std::string& from, const std::string& to);
+
+  /**
+   * Remove a file
+   *
+   * @param name file name
+   */
+  void remove(const std::string& name);
+
+  /**
+   * Flush new directory entries of the images directory to the disk
+   */
+  void sync() const;
+
+  /**
+   * List files of both directories, must be called before files are
+   * written
+   *
+   * Temporary files are removed, staged files left by a previous run are
+   * taken over
+   *
+   * @return file names
+   */
+  std::unordered_set<std::string> files();
+
+  /**
+   * Check whether staging is enabled
+   *
+   * @return true if staging is enabled
+   */
+  inline bool staging() const { return staging_; }
+
+  /**
+   * Check whether files are appended to segments
+   *
+   * @return true if segments are enabled
+   */
+  inline bool segmented() const { return segments_ != nullptr; }
+
+  /**
+   * Get segment store
+   *
+   * @return segment store, null if segments are disabled
+   */
+  inline const Segments* segments() const { return segments_.get(); }
+
+  /**
+   * Get number of staged files
+   *
+   * @return number of staged files
+   */
+  std::size_t staged() const;
+
+  /**
+   * Get size of staged files
+   *
+   * @return size in bytes
+   */
+  std::size_t staged_bytes() const;
+
+  /**
+   * Get number of files moved to the images directory
+   *
+   * @return number of flushed files
+   */
+  inline std::uint64_t flushed() const { return flushed_; }
+
+ private:
+  /**
+   * Staged file
+   */
+  struct Entry {
+    /**
+     * File size
+     */
+    std::size_t size;
+    /**
+     * Time the file has been staged, monotonic microseconds
+     */
+    time_unit staged_at;
+    /**
+     * Being written or moved to the images directory
+     */
+    bool busy;
+    /**
+     * Removed while being moved
+     */
+    bool removed;
+  };
+
+  /**
+   * Flusher loop
+   */
+  void execute();
+
+  /**
+   * Pick the next file to move, oldest first, must hold mutex
+   *
+   * @param all pick regardless of age and budget
+   *
+   * @return file name, empty if none
+   */
+  std::string next(bool all) const;
+
+  /**
+   * Get current path of a file
+   *
+   * The file may be moved to the images directory right after, opening the
+   * returned path can fail once
+   *
+   * @param name file name
+   *
+   * @return file path
+   */
+  std::string path(const std::string& name) const;
+
+  /**
+   * Get path of a file in the staging directory
+   *
+   * @param name file name
+   *
+   * @return file path
+   */
+  std::string staged_path(const std::string& name) const;
+
+  /**
+   * Get path of a file in the images directory
+   *
+   * @param name file name
+   *
+   * @return file path
+   */
+  std::string persistent_path(const std::string& name) const;
+
+  /**
+   * Move one staged file to the images directory
+   *
+   * @param name file name
+   * @param size file size
+   *
+   * @return true if moved or removed meanwhile
+   */
+  bool flush(const std::string& name, std::size_t size);
+
+  /**
+   * Check whether staged files use more than the flush threshold, must hold
+   * mutex
+   *
+   * @return true if above the threshold
+   */
+  inline bool crowded() const { return staged_bytes_ > threshold_; }
+
+  /**
+   * Get config
+   *
+   * @return storage config
+   */
+  inline const Config* config() const { return config_; }
+
+ private:
+  /**
+   * Configuration
+   */
+  const Config* config_;
+  /**
+   * Staging enabled
+   */
+  bool staging_;
+  /**
+   * Segment store, null if disabled
+   */
+  std::unique_ptr<Segments> segments_;
+  /**
+   * Staged files moved above this size
+   */
+  std::size_t threshold_;
+  /**
+   * Staged files
+   */
+  std::unordered_map<std::string, Entry> entries_;
+  /**
+   * Size of staged files
+   */
+  std::size_t staged_bytes_;
+  /**
+   * Number of files moved to the images directory
+   */
+  std::atomic<std::uint64_t> flushed_;
+  /**
+   * Entries mutex
+   */
+  mutable std::mutex mutex_;
+  /**
+   * Signalled when staged files cross the threshold or the spool stops
+   */
+  std::condition_variable signal_;
+  /**
+   * Running status
+   */
+  bool running_;
+  /**
+   * Flusher thread
+   */
+  std::thread flusher_;
+};
+}  // namespace storage
+
+NAMESPACE_END
+
+#endif  // LIB_STORAGE_SPOOL_HPP_
@@ -12,7 +12,11 @@
 // 1. STL
 #include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <future>
 #include <string>
+#include <string_view>
+#include <thread>
 
 // 2. Vendor
 #include <sqlite3.h>
@@ -25,13 +29,29 @@
 
 #include <libstorage/storage.hpp>
 
+#include <libcamera/camera.hpp>
+
 #include <libgui/gui.hpp>
 
 // 4. Local
 #include "schema.hpp"
 
+#include "codes.hpp"
+
+#include "config.hpp"
+
 #include "database.hpp"
 
+#include "encoder.hpp"
+
+#include "segments.hpp"
+
+#include "spool.hpp"
+
+#include "trace.hpp"
+
+#include "writer.hpp"
+
 #include "listener.hpp"
 
 #endif  // LIB_STORAGE_STORAGE_HPP_
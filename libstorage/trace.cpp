@@ -0,0 +1,295 @@
+#include "storage.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include <fmt/format.h>
+
+#include <libutil/util.hpp>
+
+#include "config.hpp"
+
+NAMESPACE_BEGIN
+
+namespace storage {
+/**
+ * Get time between two timestamps
+ *
+ * @param from  earlier timestamp
+ * @param to    later timestamp
+ * @param value time in microseconds
+ *
+ * @return false if either timestamp is missing
+ */
+static bool elapsed(time_unit from, time_unit to, time_unit& value) {
+  if (from == 0 || to == 0 || to < from) {
+    return false;
+  }
+
+  value = to - from;
+  return true;
+}
+
+/**
+ * Get a percentile of sorted values, nearest rank
+ *
+ * @param sorted     values, smallest first, not empty
+ * @param percentile percentile, 1-100
+ *
+ * @return value
+ */
+static time_unit percentile(const std::vector<time_unit>& sorted,
+                            std::size_t                   percentile) {
+  auto rank = (sorted.size() * percentile + 99) / 100;
+  return sorted[std::max<std::size_t>(rank, 1) - 1];
+}
+
+Trace::Trace(TraceStats* stats, time_unit requested)
+    : requested{requested},
+      snapshot{0},
+      captured{0},
+      queued{0},
+      encode{0},
+      write{0},
+      insert{0},
+      stored{0},
+      done{0},
+      acknowledged{0},
+      stats_{stats},
+      holders_{1} {}
+
+void Trace::retain() {
+  holders_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Trace::release() {
+  // timestamps of the other holders are visible to the last one
+  if (holders_.fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+      stats_ != nullptr) {
+    stats_->record(*this);
+  }
+}
+
+TraceStats::TraceStats(const Config* config)
+    : config_{config}, trays_{0}, reported_{0}, running_{true} {
+  massert(config != nullptr, "sanity");
+
+  for (auto& window : windows_) {
+    window.values.reserve(config->trace_window());
+  }
+
+  if (config->trace_interval() > 0) {
+    reporter_ = std::thread(&TraceStats::execute, this);
+  }
+}
+
+TraceStats::~TraceStats() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  signal_.notify_all();
+
+  if (reporter_.joinable()) {
+    reporter_.join();
+  }
+}
+
+std::shared_ptr<Trace> TraceStats::begin(time_unit requested) {
+  return std::make_shared<Trace>(this, requested);
+}
+
+const char* TraceStats::name(stage_t stage) {
+  switch (stage) {
+    case stage_t::snapshot:
+      return "snapshot";
+    case stage_t::capture:
+      return "capture";
+    case stage_t::queue:
+      return "queue";
+    case stage_t::encode:
+      return "encode";
+    case stage_t::write:
+      return "write";
+    case stage_t::insert:
+      return "insert";
+    case stage_t::stored:
+      return "stored";
+    case stage_t::done:
+      return "done";
+    case stage_t::handshake:
+      return "handshake";
+    default:
+      return "unknown";
+  }
+}
+
+void TraceStats::add(stage_t stage, time_unit value) {
+  auto& window = windows_[static_cast<std::size_t>(stage)];
+  if (window.values.size() < config()->trace_window()) {
+    window.values.push_back(value);
+    return;
+  }
+
+  window.values[window.next] = value;
+  window.next = (window.next + 1) % window.values.size();
+}
+
+void TraceStats::record(const Trace& trace) {
+  std::array<time_unit, STAGES> timings{};
+  std::array<bool, STAGES>      present{};
+
+  auto set = [&present](stage_t stage, bool ok) {
+    present[static_cast<std::size_t>(stage)] = ok;
+  };
+
+  auto at = [&timings](stage_t stage) -> time_unit& {
+    return timings[static_cast<std::size_t>(stage)];
+  };
+
+  set(stage_t::snapshot,
+      elapsed(trace.requested, trace.snapshot, at(stage_t::snapshot)));
+  set(stage_t::capture,
+      elapsed(trace.snapshot, trace.captured, at(stage_t::capture)));
+  set(stage_t::queue,
+      elapsed(trace.captured, trace.queued, at(stage_t::queue)));
+  set(stage_t::stored,
+      elapsed(trace.requested, trace.stored, at(stage_t::stored)));
+  set(stage_t::done, elapsed(trace.requested, trace.done, at(stage_t::done)));
+  set(stage_t::handshake,
+      elapsed(trace.done, trace.acknowledged, at(stage_t::handshake)));
+
+  // only trays handed to the writer spent time in it
+  at(stage_t::encode) = trace.encode;
+  at(stage_t::write) = trace.write;
+  at(stage_t::insert) = trace.insert;
+  set(stage_t::encode, trace.queued != 0);
+  set(stage_t::write, trace.queued != 0);
+  set(stage_t::insert, trace.stored != 0);
+
+  LOG_DEBUG(
+      "Tray {} timings in us: snapshot {}, capture {}, queue {}, encode {}, "
+      "write {}, insert {}, stored {}, done {}, handshake {}",
+      trace.hash, at(stage_t::snapshot), at(stage_t::capture),
+      at(stage_t::queue), at(stage_t::encode), at(stage_t::write),
+      at(stage_t::insert), at(stage_t::stored), at(stage_t::done),
+      at(stage_t::handshake));
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::size_t i = 0; i < STAGES; ++i) {
+      if (present[i]) {
+        add(static_cast<stage_t>(i), timings[i]);
+      }
+    }
+  }
+
+  trays_ += 1;
+}
+
+void TraceStats::execute() {
+  const auto interval = std::chrono::seconds(config()->trace_interval());
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!signal_.wait_for(lock, interval, [this] { return !running_; })) {
+    // nothing new while idle, the last report still holds
+    const std::uint64_t trays = trays_;
+    if (trays == reported_) {
+      continue;
+    }
+    reported_ = trays;
+
+    lock.unlock();
+    report();
+    lock.lock();
+  }
+}
+
+TraceStats::Summary TraceStats::summary(stage_t stage) const {
+  std::vector<time_unit> sorted;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sorted = windows_[static_cast<std::size_t>(stage)].values;
+  }
+
+  Summary result;
+  if (sorted.empty()) {
+    return result;
+  }
+
+  std::sort(sorted.begin(), sorted.end());
+  result.count = sorted.size();
+  result.p50 = percentile(sorted, 50);
+  result.p90 = percentile(sorted, 90);
+  result.p99 = percentile(sorted, 99);
+  result.max = sorted.back();
+  return result;
+}
+
+void TraceStats::report() const {
+  std::array<Summary, STAGES> summaries;
+  for (std::size_t i = 0; i < STAGES; ++i) {
+    summaries[i] = summary(static_cast<stage_t>(i));
+  }
+
+  if (summaries[static_cast<std::size_t>(stage_t::done)].count > 0) {
+    fmt::memory_buffer buffer;
+    for (std::size_t i = 0; i < STAGES; ++i) {
+      const auto& s = summaries[i];
+      fmt::format_to(std::back_inserter(buffer),
+                     "{}{} {:.1f}/{:.1f}/{:.1f}", i == 0 ? "" : ", ",
+                     name(static_cast<stage_t>(i)), s.p50 / 1000.0,
+                     s.p90 / 1000.0, s.p99 / 1000.0);
+    }
+
+    LOG_INFO("Tray timings of the last {} trays, p50/p90/p99 in ms: {}",
+             summaries[static_cast<std::size_t>(stage_t::done)].count,
+             fmt::to_string(buffer));
+  }
+
+  if (!config()->trace_file().empty()) {
+    write(summaries);
+  }
+}
+
+void TraceStats::write(const std::array<Summary, STAGES>& summaries) const {
+  fmt::memory_buffer buffer;
+  auto               out = std::back_inserter(buffer);
+
+  fmt::format_to(out, "{{\n  \"trays\": {},\n  \"window\": {},\n", trays(),
+                 config()->trace_window());
+  fmt::format_to(out, "  \"unit\": \"us\",\n  \"stages\": {{\n");
+  for (std::size_t i = 0; i < STAGES; ++i) {
+    const auto& s = summaries[i];
+    fmt::format_to(out,
+                   "    \"{}\": {{\"count\": {}, \"p50\": {}, \"p90\": {}, "
+                   "\"p99\": {}, \"max\": {}}}{}\n",
+                   name(static_cast<stage_t>(i)), s.count, s.p50, s.p90,
+                   s.p99, s.max, i + 1 < STAGES ? "," : "");
+  }
+  fmt::format_to(out, "  }}\n}}\n");
+
+  // readers never see a partial file
+  const auto& path = config()->trace_file();
+  const auto  temp = fmt::format("{}.tmp", path);
+  {
+    std::ofstream file(temp, std::ios::trunc);
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    if (!file.good()) {
+      LOG_WARN("Cannot write tray timings to {}", temp);
+      return;
+    }
+  }
+
+  if (std::rename(temp.c_str(), path.c_str()) != 0) {
+    LOG_WARN("Cannot write tray timings to {}", path);
+  }
+}
+}  // namespace storage
+
+NAMESPACE_END
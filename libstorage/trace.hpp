@@ -0,0 +1,314 @@
+#ifndef LIB_STORAGE_TRACE_HPP_
+#define LIB_STORAGE_TRACE_HPP_
+
+/** @file trace.hpp
+ *  @brief Per-tray latency trace
+ *
+ * Timestamps of every tray from the request to the handshake, aggregated
+ * into rolling percentiles
+ */
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libcore/core.hpp>
+
+NAMESPACE_BEGIN
+
+namespace storage {
+// forward declarations
+class Config;
+class TraceStats;
+
+/**
+ * Timings of a tray, in order
+ */
+enum class stage_t : std::size_t {
+  snapshot,   // imaging-request detected to registers copied
+  capture,    // registers copied to frames picked
+  queue,      // frames picked to every view queued
+  encode,     // decoding, reducing and encoding, summed over the views
+  write,      // writing files, summed over the views
+  insert,     // database insert
+  stored,     // imaging-request detected to database entry
+  done,       // imaging-request detected to imaging-done raised
+  handshake,  // imaging-done raised to ready for the next request
+};
+
+/**
+ * @brief Trace of one tray
+ *
+ * Timestamps are monotonic microseconds, 0 if the tray never got there.
+ * Each timestamp is written by a single thread, durations summed by the
+ * writer threads are atomic.
+ *
+ * Shared by the listener and the writer, recorded once both released it
+ */
+struct Trace {
+  /**
+   * Trace constructor
+   *
+   * @param stats     aggregator recording the trace once released, may be
+   *                  null
+   * @param requested time imaging-request has been detected
+   */
+  Trace(TraceStats* stats = nullptr, time_unit requested = 0);
+
+  /**
+   * Hold the trace until released
+   */
+  void retain();
+
+  /**
+   * Release the trace, the last release records it
+   */
+  void release();
+
+  /**
+   * Image hash
+   */
+  std::string hash;
+  /**
+   * Time imaging-request has been detected
+   */
+  time_unit requested;
+  /**
+   * Time registers have been copied
+   */
+  time_unit snapshot;
+  /**
+   * Time frames have been picked
+   */
+  time_unit captured;
+  /**
+   * Time every view has been queued
+   */
+  time_unit queued;
+  /**
+   * Time spent decoding, reducing and encoding
+   */
+  std::atomic<time_unit> encode;
+  /**
+   * Time spent writing files
+   */
+  std::atomic<time_unit> write;
+  /**
+   * Time spent inserting the database entry
+   */
+  time_unit insert;
+  /**
+   * Time the database entry has been inserted
+   */
+  time_unit stored;
+  /**
+   * Time imaging-done has been raised
+   */
+  time_unit done;
+  /**
+   * Time the handshake has been completed
+   */
+  time_unit acknowledged;
+
+ private:
+  /**
+   * Aggregator
+   */
+  TraceStats* stats_;
+  /**
+   * Number of holders
+   */
+  std::atomic<std::size_t> holders_;
+};
+
+/**
+ * @brief Rolling percentiles of the tray timings
+ *
+ * Keeps the timings of the last trays, configured by [storage.trace], and
+ * periodically logs their percentiles and writes them to a JSON file so
+ * tuning can be measured. Each tray is logged at debug level.
+ *
+ * Reports are made by a thread of their own, recording a tray never touches
+ * a file.
+ *
+ * Safe to use from several threads at once
+ */
+class TraceStats {
+ public:
+  /**
+   * Number of stages
+   */
+  static constexpr std::size_t STAGES = 9;
+
+  /**
+   * Percentiles of one stage, in microseconds
+   */
+  struct Summary {
+    /**
+     * Number of trays in the window
+     */
+    std::size_t count = 0;
+    /**
+     * Median
+     */
+    time_unit p50 = 0;
+    /**
+     * 90th percentile
+     */
+    time_unit p90 = 0;
+    /**
+     * 99th percentile
+     */
+    time_unit p99 = 0;
+    /**
+     * Maximum
+     */
+    time_unit max = 0;
+  };
+
+  /**
+   * Trace stats constructor
+   *
+   * @param config storage configuration
+   */
+  TraceStats(const Config* config);
+
+  /**
+   * Trace stats destructor, stops reporting
+   */
+  ~TraceStats();
+
+  /**
+   * Start tracing a tray, held by the caller
+   *
+   * @param requested time imaging-request has been detected
+   *
+   * @return trace
+   */
+  std::shared_ptr<Trace> begin(time_unit requested);
+
+  /**
+   * Record a finished tray
+   *
+   * @param trace finished trace
+   */
+  void record(const Trace& trace);
+
+  /**
+   * Get percentiles of a stage over the window
+   *
+   * @param stage stage
+   *
+   * @return percentiles
+   */
+  Summary summary(stage_t stage) const;
+
+  /**
+   * Get number of trays recorded
+   *
+   * @return number of trays
+   */
+  inline std::uint64_t trays() const { return trays_; }
+
+  /**
+   * Log percentiles and write the stats file
+   */
+  void report() const;
+
+  /**
+   * Get name of a stage
+   *
+   * @param stage stage
+   *
+   * @return stage name
+   */
+  static const char* name(stage_t stage);
+
+ private:
+  /**
+   * Timings of one stage, oldest overwritten first
+   */
+  struct Window {
+    /**
+     * Timings in microseconds
+     */
+    std::vector<time_unit> values;
+    /**
+     * Next slot to overwrite once full
+     */
+    std::size_t next = 0;
+  };
+
+  /**
+   * Add a timing, must hold mutex
+   *
+   * @param stage stage
+   * @param value timing in microseconds
+   */
+  void add(stage_t stage, time_unit value);
+
+  /**
+   * Write the stats file atomically
+   *
+   * @param summaries percentiles of every stage
+   */
+  void write(const std::array<Summary, STAGES>& summaries) const;
+
+  /**
+   * Reporter loop, reports every interval if trays have been recorded
+   */
+  void execute();
+
+  /**
+   * Get config
+   *
+   * @return storage config
+   */
+  inline const Config* config() const { return config_; }
+
+ private:
+  /**
+   * Configuration
+   */
+  const Config* config_;
+  /**
+   * Timings per stage
+   */
+  std::array<Window, STAGES> windows_;
+  /**
+   * Number of trays recorded
+   */
+  std::atomic<std::uint64_t> trays_;
+  /**
+   * Number of trays recorded at the last report
+   */
+  std::uint64_t reported_;
+  /**
+   * Windows mutex
+   */
+  mutable std::mutex mutex_;
+  /**
+   * Signalled when reporting stops
+   */
+  std::condition_variable signal_;
+  /**
+   * Running status
+   */
+  bool running_;
+  /**
+   * Reporter thread, only if reports are enabled
+   */
+  std::thread reporter_;
+};
+}  // namespace storage
+
+NAMESPACE_END
+
+#endif  // LIB_STORAGE_TRACE_HPP_
@@ -0,0 +1,541 @@
+#include "storage.hpp"
+
+#include "writer.hpp"
+
+#include <algorithm>
+
+#include <fmt/format.h>
+
+#include <libutil/util.hpp>
+
+#include "config.hpp"
+#include "database.hpp"
+#include "encoder.hpp"
+#include "spool.hpp"
+#include "trace.hpp"
+
+NAMESPACE_BEGIN
+
+namespace storage {
+Writer::Writer(const Config* config,
+               Database*     database,
+               Encoder*      encoder,
+               Spool*        spool)
+    : config_{config},
+      database_{database},
+      encoder_{encoder},
+      spool_{spool},
+      running_{false},
+      in_flight_{0} {
+  massert(config != nullptr, "sanity");
+  massert(database != nullptr, "sanity");
+  massert(encoder != nullptr, "sanity");
+  massert(spool != nullptr, "sanity");
+}
+
+Writer::~Writer() {
+  stop();
+}
+
+void Writer::reconcile() {
+  const auto begin = monotonic_micros();
+
+  std::size_t removed_entries = 0;
+  std::size_t removed_views = 0;
+  std::size_t removed_files = 0;
+
+  try {
+    // one listing of the directories, temporary files are already gone
+    auto files = spool_->files();
+
+    // a large backlog is reconciled in one transaction each, entries
+    // losing a view are updated in place and keep their place in the queue
+    std::vector<schema::Hash>  stale;
+    std::vector<schema::Image> updated;
+
+    auto images = database_->get_all();
+    for (auto& image : images) {
+      // files of uploaded images are gone, entries only catch duplicates
+      if (image.state != schema::PENDING) {
+        continue;
+      }
+
+      // stored in another format if the configured one has changed since
+      auto extension = encoder_->extension(image);
+      if (files.count(schema::file_name(image.hash, extension)) == 0) {
+        for (const auto& other : Encoder::extensions()) {
+          if (files.count(schema::file_name(image.hash, other)) > 0) {
+            extension = other;
+            break;
+          }
+        }
+      }
+
+      if (files.erase(schema::file_name(image.hash, extension)) == 0) {
+        LOG_WARN("Image {} has no file, removing database entry", image.hash);
+        stale.push_back(image.hash);
+        removed_entries += 1;
+        continue;
+      }
+
+      // only list secondary views still on disk
+      std::vector<std::string> kept{std::string{}};
+      std::string              views;
+      for (const auto& view : schema::split(image.views)) {
+        if (files.erase(schema::file_name(image.hash, extension, view)) > 0) {
+          views += views.empty() ? "" : ",";
+          views += view;
+          kept.push_back(view);
+        } else {
+          LOG_WARN("View {} of {} has no file, unlisting it", view,
+                   image.hash);
+          removed_views += 1;
+        }
+      }
+
+      // reduced copies are only listed if every kept view has all of them
+      std::vector<std::string> reduced;
+      for (auto level : schema::levels(image)) {
+        for (const auto& view : kept) {
+          reduced.push_back(
+              schema::file_name(image.hash, extension, view, level));
+        }
+      }
+
+      auto levels = image.levels;
+      if (std::all_of(reduced.begin(), reduced.end(),
+                      [&files](const std::string& file) {
+                        return files.count(file) > 0;
+                      })) {
+        for (const auto& file : reduced) {
+          files.erase(file);
+        }
+      } else {
+        LOG_WARN("Reduced copies of {} are missing, unlisting them",
+                 image.hash);
+        levels.clear();
+      }
+
+      if (views != image.views || levels != image.levels ||
+          extension != image.extension) {
+        image.views = views;
+        image.levels = levels;
+        image.extension = extension;
+        updated.push_back(image);
+      }
+    }
+
+    database_->update_views(updated);
+    database_->remove_many(stale);
+
+    // written without an entry, or uploaded without being deleted, files
+    // of an entry have been taken out of the listing whatever their format
+    for (const auto& file : files) {
+      for (const auto& extension : Encoder::extensions()) {
+        if (file.size() > extension.size() &&
+            file.compare(file.size() - extension.size(), extension.size(),
+                         extension) == 0) {
+          spool_->remove(file);
+          removed_files += 1;
+          break;
+        }
+      }
+    }
+
+    LOG_INFO(
+        "Reconciled {} images in {} us, removed {} entries, {} views and {} "
+        "files",
+        images.size(), monotonic_micros() - begin, removed_entries,
+        removed_views, removed_files);
+  } catch (const std::exception& e) {
+    LOG_ERROR("Cannot reconcile images with the database: {}", e.what());
+  }
+}
+
+void Writer::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_) {
+    return;
+  }
+
+  LOG_INFO("Starting {} image writers", config()->workers());
+  running_ = true;
+  for (std::size_t i = 0; i < config()->workers(); ++i) {
+    workers_.emplace_back(&Writer::execute, this);
+  }
+}
+
+void Writer::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+      return;
+    }
+
+    LOG_INFO("Stopping image writers, {} files pending", queue_.size());
+    running_ = false;
+  }
+
+  // workers leave once the queue is drained
+  not_empty_.notify_all();
+  not_full_.notify_all();
+
+  for (auto& worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  workers_.clear();
+
+  LOG_INFO("Stopping image writers complete");
+}
+
+std::size_t Writer::pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size();
+}
+
+bool Writer::available() const {
+  return in_flight_ < config()->trays();
+}
+
+schema::Hash Writer::reserve(const schema::Hash& hash) {
+  std::lock_guard<std::mutex> lock(keys_mutex_);
+
+  // the same tray triggered twice within a second gets the same hash
+  auto key = hash;
+  for (std::size_t i = 1; keys_.count(key) > 0 || database_->check(key); ++i) {
+    key = fmt::format("{}_{}", hash, i);
+  }
+
+  keys_.insert(key);
+  return key;
+}
+
+std::future<bool> Writer::write(const schema::Image&   image,
+                                std::vector<View>      views,
+                                std::shared_ptr<Trace> trace) {
+  massert(!views.empty(), "sanity");
+
+  auto batch = std::make_shared<Batch>();
+  // released once the tray is finished
+  batch->trace = trace ? std::move(trace) : std::make_shared<Trace>();
+  batch->trace->retain();
+  batch->image = image;
+  batch->image.hash = reserve(image.hash);
+  batch->image.views.clear();
+  batch->image.checksum.clear();
+  batch->image.levels.clear();
+  // files are found through the row after a format change
+  batch->image.extension = encoder_->extension();
+  batch->stored.assign(views.size(), 0);
+  batch->checksums.assign(views.size(), 0);
+  batch->derived.assign(views.size(), 0);
+  batch->remaining = views.size();
+  for (const auto& view : views) {
+    batch->views.push_back(view.name);
+  }
+
+  auto result = batch->done.get_future();
+  in_flight_ += 1;
+
+  for (std::size_t i = 0; i < views.size(); ++i) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // keeps the number of frames held by the writer bounded
+    not_full_.wait(lock, [this] {
+      return !running_ || queue_.size() < config()->queue();
+    });
+
+    if (!running_) {
+      lock.unlock();
+      LOG_ERROR("Image writers are stopped, dropping {}", image.hash);
+      Task task{batch, i, {}};
+      finish(task, false);
+      continue;
+    }
+
+    queue_.push_back(Task{batch, i, std::move(views[i].frame)});
+    lock.unlock();
+    not_empty_.notify_one();
+  }
+
+  return result;
+}
+
+void Writer::execute() {
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      not_empty_.wait(lock, [this] { return !running_ || !queue_.empty(); });
+
+      if (queue_.empty()) {
+        break;  // stopped and drained
+      }
+
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    not_full_.notify_one();
+
+    const auto& batch = *task.batch;
+    auto name = encoder_->file_name(batch.image.hash, batch.views[task.view]);
+
+    bool ok = store(name, task.frame, task.batch->checksums[task.view],
+                    *batch.trace);
+    if (ok) {
+      // from the frame store() has just decoded, if any
+      task.batch->derived[task.view] = derive(
+          batch.image.hash, batch.views[task.view], task.frame, *batch.trace);
+    }
+    // give the buffer back to the frame pool before touching the database
+    task.frame = camera::Frame{};
+
+    finish(task, ok);
+  }
+}
+
+bool Writer::store(const std::string& name,
+                   camera::Frame&     frame,
+                   std::uint64_t&     checksum,
+                   Trace&             trace) const {
+  const bool     flush = config()->durability() == durability_t::fsync;
+  util::XXHash64 hash;
+
+  auto begin = monotonic_micros();
+  if (frame.compressed() && encoder_->accepts_jpeg()) {
+    // already a JPEG from the camera, no need to decode and re-encode
+    bool ok = spool_->write(name, frame.encoded.data, frame.encoded.total(),
+                            flush, hash);
+    trace.write += monotonic_micros() - begin;
+    checksum = hash.digest();
+    return ok;
+  }
+
+  if (!frame.decode()) {
+    LOG_ERROR("Cannot decode frame for {}", name);
+    return false;
+  }
+
+  // reused by every image encoded on this thread
+  thread_local std::vector<std::uint8_t> buffer;
+  bool encoded = encoder_->encode(frame.image, buffer);
+
+  auto written = monotonic_micros();
+  trace.encode += written - begin;
+  if (!encoded) {
+    LOG_ERROR("Cannot encode {}", name);
+    return false;
+  }
+
+  bool ok = spool_->write(name, buffer.data(), buffer.size(), flush, hash);
+  trace.write += monotonic_micros() - written;
+  checksum = hash.digest();
+  return ok;
+}
+
+/**
+ * Get OpenCV flag decoding a JPEG directly at a reduced size
+ *
+ * @param level downscale factor
+ *
+ * @return imread flag, -1 if libjpeg cannot scale by this factor
+ */
+static int reduced_flag(std::size_t level) {
+  switch (level) {
+    case 2:
+      return cv::IMREAD_REDUCED_COLOR_2;
+    case 4:
+      return cv::IMREAD_REDUCED_COLOR_4;
+    case 8:
+      return cv::IMREAD_REDUCED_COLOR_8;
+    default:
+      return -1;
+  }
+}
+
+bool Writer::derive(const schema::Hash& hash,
+                    const std::string&  view,
+                    camera::Frame&      frame,
+                    Trace&              trace) const {
+  const auto& levels = config()->levels();
+  if (levels.empty()) {
+    return true;
+  }
+
+  const bool  flush = config()->durability() == durability_t::fsync;
+  cv::Mat     current = frame.image;
+  std::size_t scale = 1;
+  auto        begin = monotonic_micros();
+
+  if (current.empty()) {
+    // stored as is, libjpeg scales while decoding at a fraction of the cost
+    // of a full decode
+    std::size_t factor = 8;
+    while (factor > levels.front()) {
+      factor /= 2;
+    }
+
+    auto flag = reduced_flag(factor);
+    if (flag >= 0) {
+      current = cv::imdecode(frame.encoded, flag);
+      scale = factor;
+    } else if (frame.decode()) {
+      current = frame.image;
+    }
+  }
+
+  if (current.empty()) {
+    LOG_ERROR("Cannot decode frame for reduced copies of {}", hash);
+    return false;
+  }
+
+  // reused by every image encoded on this thread
+  thread_local std::vector<std::uint8_t> buffer;
+  for (auto level : levels) {
+    if (level != scale) {
+      // each level is reduced from the previous one, area averaging avoids
+      // aliasing on large factors
+      const auto ratio =
+          static_cast<double>(scale) / static_cast<double>(level);
+      cv::Size size{std::max(1, cvRound(current.cols * ratio)),
+                    std::max(1, cvRound(current.rows * ratio))};
+      cv::Mat  reduced;
+      cv::resize(current, reduced, size, 0, 0, cv::INTER_AREA);
+      current = reduced;
+      scale = level;
+    }
+
+    auto name = encoder_->file_name(hash, view, level);
+    bool encoded = encoder_->encode(current, buffer);
+
+    auto written = monotonic_micros();
+    trace.encode += written - begin;
+    if (!encoded) {
+      LOG_ERROR("Cannot encode {}", name);
+      return false;
+    }
+
+    util::XXHash64 checksum;
+    bool ok =
+        spool_->write(name, buffer.data(), buffer.size(), flush, checksum);
+
+    begin = monotonic_micros();
+    trace.write += begin - written;
+    if (!ok) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool Writer::insert(Batch& batch) {
+  std::lock_guard<std::mutex> lock(keys_mutex_);
+  keys_.erase(batch.image.hash);
+
+  try {
+    // same tray with the same content as a stored one, checked and inserted
+    // at once so two copies finishing together cannot both get in
+    if (database_->check_duplicate(batch.image)) {
+      LOG_WARN("Image {} is a duplicate of a stored image, discarding",
+               batch.image.hash);
+      for (const auto& file : encoder_->file_names(batch.image)) {
+        spool_->remove(file);
+      }
+      return true;
+    }
+
+    // another tray with the same frame, kept but the camera may have stalled
+    if (database_->check_checksum(batch.image.checksum)) {
+      LOG_WARN("Image {} has the same content as another tray, keeping it",
+               batch.image.hash);
+    }
+
+    database_->insert(batch.image);
+  } catch (const std::exception& e) {
+    LOG_ERROR("Cannot insert {} into database: {}", batch.image.hash,
+              e.what());
+    return false;
+  }
+
+  return true;
+}
+
+void Writer::finish(Task& task, bool ok) {
+  auto& batch = *task.batch;
+  batch.stored[task.view] = ok ? 1 : 0;
+
+  // results of the other views are visible to the last one
+  if (batch.remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+
+  if (config()->durability() == durability_t::fsync) {
+    spool_->sync();
+  }
+
+  // primary view is required, secondary views are only listed once they are
+  // on disk, database entry is added once files exist
+  for (std::size_t i = 1; i < batch.views.size(); ++i) {
+    if (batch.stored[i]) {
+      batch.image.views += batch.image.views.empty() ? "" : ",";
+      batch.image.views += batch.views[i];
+    }
+  }
+
+  // reduced copies are only listed once every stored view has all of them
+  const auto& levels = config()->levels();
+  if (!levels.empty()) {
+    bool derived = true;
+    for (std::size_t i = 0; i < batch.views.size(); ++i) {
+      derived = derived && (!batch.stored[i] || batch.derived[i]);
+    }
+
+    if (derived) {
+      for (auto level : levels) {
+        batch.image.levels += batch.image.levels.empty() ? "" : ",";
+        batch.image.levels += std::to_string(level);
+      }
+    } else {
+      for (auto level : levels) {
+        for (const auto& view : batch.views) {
+          spool_->remove(encoder_->file_name(batch.image.hash, view, level));
+        }
+      }
+    }
+  }
+
+  bool stored = batch.stored.front();
+  if (stored) {
+    // primary view identifies the content
+    batch.image.checksum = util::to_hex(batch.checksums.front());
+
+    auto begin = monotonic_micros();
+    stored = insert(batch);
+
+    auto end = monotonic_micros();
+    batch.trace->insert = end - begin;
+    batch.trace->stored = stored ? end : 0;
+  } else {
+    std::lock_guard<std::mutex> lock(keys_mutex_);
+    keys_.erase(batch.image.hash);
+  }
+
+  if (stored) {
+    LOG_INFO("Image {} has been saved", batch.image.hash);
+  } else {
+    LOG_ERROR("Cannot store {}", batch.image.hash);
+  }
+
+  batch.done.set_value(stored);
+  batch.trace->release();
+
+  in_flight_ -= 1;
+  if (on_complete_) {
+    on_complete_();
+  }
+}
+}  // namespace storage
+
+NAMESPACE_END
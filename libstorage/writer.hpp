@@ -0,0 +1,349 @@
+#ifndef LIB_STORAGE_WRITER_HPP_
+#define LIB_STORAGE_WRITER_HPP_
+
+/** @file writer.hpp
+ *  @brief Background image writer
+ *
+ * Encodes and writes images on a pool of worker threads
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <libcore/core.hpp>
+
+#include <libcamera/frame.hpp>
+
+#include "schema.hpp"
+
+NAMESPACE_BEGIN
+
+namespace storage {
+// forward declarations
+class Config;
+class Database;
+class Encoder;
+class Spool;
+struct Trace;
+
+/**
+ * @brief Bounded pool of encoder threads
+ *
+ * Every view of a tray becomes one task in a bounded queue, queueing blocks
+ * while the queue is full so memory held by pending frames stays bounded.
+ * The worker finishing the last view of a tray inserts the database entry,
+ * so an entry never exists without its files.
+ *
+ * Files are hashed while they are written, a tray with the same content as
+ * one waiting for upload is discarded. Reduced copies of every view are
+ * encoded from the frame decoded for the full resolution, so readers can
+ * fetch the cheapest size that fits. Files are written through the spool,
+ * a crash never leaves a partial file.
+ */
+class Writer {
+ public:
+  /**
+   * One view of a tray
+   */
+  struct View {
+    /**
+     * View name, empty for the primary view
+     */
+    std::string name;
+    /**
+     * Frame to store
+     */
+    camera::Frame frame;
+  };
+
+  /**
+   * Writer constructor
+   *
+   * @param config   storage configuration
+   * @param database database to insert stored images into
+   * @param encoder  image encoder
+   * @param spool    image files
+   */
+  Writer(const Config* config,
+         Database*     database,
+         Encoder*      encoder,
+         Spool*        spool);
+
+  /**
+   * Writer destructor, waits for queued images
+   */
+  ~Writer();
+
+  /**
+   * Match database entries against the image files, must be called before
+   * anything else uses either
+   *
+   * Entries without their primary file are removed, missing secondary views
+   * are unlisted, temporary files and files without an entry are deleted.
+   * Remaining entries are uploaded as usual
+   */
+  void reconcile();
+
+  /**
+   * Start workers
+   */
+  void start();
+
+  /**
+   * Stop workers once every queued image is stored
+   */
+  void stop();
+
+  /**
+   * Queue every view of a tray
+   *
+   * Blocks while the queue is full
+   *
+   * @param image image metadata, views and checksum are filled in by the
+   *              writer, hash gets a suffix if it is already taken
+   * @param views views to store, primary view first
+   * @param trace trace of the tray, held until the tray is finished, may be
+   *              null
+   *
+   * @return true once files are written (and flushed, depending on
+   *         durability) and the database entry exists or the tray is a
+   *         duplicate, false if the primary view cannot be stored
+   */
+  std::future<bool> write(const schema::Image&   image,
+                          std::vector<View>      views,
+                          std::shared_ptr<Trace> trace = nullptr);
+
+  /**
+   * Get number of files waiting for a worker
+   *
+   * @return number of queued files
+   */
+  std::size_t pending() const;
+
+  /**
+   * Get number of trays queued but not stored yet
+   *
+   * @return number of trays in flight
+   */
+  inline std::size_t in_flight() const { return in_flight_; }
+
+  /**
+   * Check whether another tray can be taken without waiting
+   *
+   * @return true if fewer trays than configured are in flight
+   */
+  bool available() const;
+
+  /**
+   * Set callback called on a worker thread whenever a tray is finished,
+   * stored or not
+   *
+   * Must be set before start()
+   *
+   * @param callback completion callback
+   */
+  inline void bind_complete(std::function<void()> callback) {
+    on_complete_ = std::move(callback);
+  }
+
+ private:
+  /**
+   * Views of one tray
+   */
+  struct Batch {
+    /**
+     * Image metadata
+     */
+    schema::Image image;
+    /**
+     * View names
+     */
+    std::vector<std::string> views;
+    /**
+     * Store result per view, each written by a single worker
+     */
+    std::vector<std::uint8_t> stored;
+    /**
+     * Content hash per view, each written by a single worker
+     */
+    std::vector<std::uint64_t> checksums;
+    /**
+     * Whether every reduced copy is stored per view, each written by a
+     * single worker
+     */
+    std::vector<std::uint8_t> derived;
+    /**
+     * Number of views not stored yet
+     */
+    std::atomic<std::size_t> remaining;
+    /**
+     * Result of the whole tray
+     */
+    std::promise<bool> done;
+    /**
+     * Trace of the tray
+     */
+    std::shared_ptr<Trace> trace;
+  };
+
+  /**
+   * One file to store
+   */
+  struct Task {
+    /**
+     * Tray the file belongs to
+     */
+    std::shared_ptr<Batch> batch;
+    /**
+     * View index in the tray
+     */
+    std::size_t view;
+    /**
+     * Frame to store
+     */
+    camera::Frame frame;
+  };
+
+  /**
+   * Worker loop
+   */
+  void execute();
+
+  /**
+   * Reserve a hash not used by another image
+   *
+   * @param hash hash built from the tray data
+   *
+   * @return hash, with a suffix if it is already taken
+   */
+  schema::Hash reserve(const schema::Hash& hash);
+
+  /**
+   * Encode and write one frame
+   *
+   * @param name     file name
+   * @param frame    frame to write, decoded if the format is not JPEG
+   * @param checksum content hash of the written file
+   * @param trace    trace of the tray
+   *
+   * @return true if success
+   */
+  bool store(const std::string& name,
+             camera::Frame&     frame,
+             std::uint64_t&     checksum,
+             Trace&             trace) const;
+
+  /**
+   * Encode and write reduced copies of one frame
+   *
+   * @param hash  image hash
+   * @param view  view name, empty for the primary view
+   * @param frame frame already stored, decoded if needed
+   * @param trace trace of the tray
+   *
+   * @return true if every level has been written
+   */
+  bool derive(const schema::Hash& hash,
+              const std::string&  view,
+              camera::Frame&      frame,
+              Trace&              trace) const;
+
+  /**
+   * Insert a finished tray into the database unless it is a duplicate
+   *
+   * @param batch finished tray
+   *
+   * @return true if inserted or duplicate
+   */
+  bool insert(Batch& batch);
+
+  /**
+   * Record result of a task, completes the tray with its last view
+   *
+   * @param task finished task
+   * @param ok   task result
+   */
+  void finish(Task& task, bool ok);
+
+  /**
+   * Get config
+   *
+   * @return storage config
+   */
+  inline const Config* config() const { return config_; }
+
+ private:
+  /**
+   * Configuration
+   */
+  const Config* config_;
+  /**
+   * Database
+   */
+  Database* database_;
+  /**
+   * Image encoder
+   */
+  Encoder* encoder_;
+  /**
+   * Image files
+   */
+  Spool* spool_;
+  /**
+   * Queued files
+   */
+  std::deque<Task> queue_;
+  /**
+   * Queue mutex
+   */
+  mutable std::mutex mutex_;
+  /**
+   * Signalled when a task is queued or the writer stops
+   */
+  std::condition_variable not_empty_;
+  /**
+   * Signalled when a task is taken
+   */
+  std::condition_variable not_full_;
+  /**
+   * Workers
+   */
+  std::vector<std::thread> workers_;
+  /**
+   * Running status
+   */
+  bool running_;
+  /**
+   * Trays in flight
+   */
+  std::atomic<std::size_t> in_flight_;
+  /**
+   * Hashes of the trays in flight
+   */
+  std::unordered_set<schema::Hash> keys_;
+  /**
+   * Serializes hash reservation and database insertion
+   */
+  std::mutex keys_mutex_;
+  /**
+   * Completion callback
+   */
+  std::function<void()> on_complete_;
+};
+}  // namespace storage
+
+NAMESPACE_END
+
+#endif  // LIB_STORAGE_WRITER_HPP_
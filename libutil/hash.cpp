@@ -0,0 +1,152 @@
+#include "util.hpp"
+
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace util {
+static constexpr std::uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+static constexpr std::uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr std::uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+static constexpr std::uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr std::uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+static inline std::uint64_t rotl(std::uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+// little endian loads, every supported target is little endian
+static inline std::uint64_t read64(const std::uint8_t* data) {
+  std::uint64_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static inline std::uint32_t read32(const std::uint8_t* data) {
+  std::uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static inline std::uint64_t round(std::uint64_t acc, std::uint64_t input) {
+  acc += input * PRIME_2;
+  acc = rotl(acc, 31);
+  return acc * PRIME_1;
+}
+
+static inline std::uint64_t merge(std::uint64_t acc, std::uint64_t value) {
+  acc ^= round(0, value);
+  return acc * PRIME_1 + PRIME_4;
+}
+
+XXHash64::XXHash64(std::uint64_t seed) {
+  reset(seed);
+}
+
+void XXHash64::reset(std::uint64_t seed) {
+  seed_ = seed;
+  state_ = {seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1};
+  buffered_ = 0;
+  length_ = 0;
+}
+
+void XXHash64::update(const void* data, std::size_t size) {
+  auto* input = static_cast<const std::uint8_t*>(data);
+  length_ += size;
+
+  // complete the stripe left over by the previous call
+  if (buffered_ > 0) {
+    auto count = std::min(size, buffer_.size() - buffered_);
+    std::memcpy(buffer_.data() + buffered_, input, count);
+    buffered_ += count;
+    input += count;
+    size -= count;
+
+    if (buffered_ < buffer_.size()) {
+      return;
+    }
+
+    for (std::size_t i = 0; i < 4; ++i) {
+      state_[i] = round(state_[i], read64(buffer_.data() + i * 8));
+    }
+    buffered_ = 0;
+  }
+
+  while (size >= buffer_.size()) {
+    for (std::size_t i = 0; i < 4; ++i) {
+      state_[i] = round(state_[i], read64(input + i * 8));
+    }
+    input += buffer_.size();
+    size -= buffer_.size();
+  }
+
+  if (size > 0) {
+    std::memcpy(buffer_.data(), input, size);
+    buffered_ = size;
+  }
+}
+
+std::uint64_t XXHash64::digest() const {
+  std::uint64_t result;
+  if (length_ >= buffer_.size()) {
+    result = rotl(state_[0], 1) + rotl(state_[1], 7) + rotl(state_[2], 12) +
+             rotl(state_[3], 18);
+    for (std::size_t i = 0; i < 4; ++i) {
+      result = merge(result, state_[i]);
+    }
+  } else {
+    result = seed_ + PRIME_5;
+  }
+
+  result += length_;
+
+  const std::uint8_t* input = buffer_.data();
+  const std::uint8_t* end = input + buffered_;
+
+  while (input + 8 <= end) {
+    result ^= round(0, read64(input));
+    result = rotl(result, 27) * PRIME_1 + PRIME_4;
+    input += 8;
+  }
+
+  if (input + 4 <= end) {
+    result ^= static_cast<std::uint64_t>(read32(input)) * PRIME_1;
+    result = rotl(result, 23) * PRIME_2 + PRIME_3;
+    input += 4;
+  }
+
+  while (input < end) {
+    result ^= static_cast<std::uint64_t>(*input) * PRIME_5;
+    result = rotl(result, 11) * PRIME_1;
+    ++input;
+  }
+
+  // avalanche
+  result ^= result >> 33;
+  result *= PRIME_2;
+  result ^= result >> 29;
+  result *= PRIME_3;
+  result ^= result >> 32;
+  return result;
+}
+
+std::uint64_t XXHash64::hash(const void*   data,
+                             std::size_t   size,
+                             std::uint64_t seed) {
+  XXHash64 hasher{seed};
+  hasher.update(data, size);
+  return hasher.digest();
+}
+
+std::string to_hex(std::uint64_t digest) {
+  static constexpr char DIGITS[] = "0123456789abcdef";
+
+  std::string hex(16, '0');
+  for (std::size_t i = 0; i < hex.size(); ++i) {
+    hex[hex.size() - 1 - i] = DIGITS[digest & 0xF];
+    digest >>= 4;
+  }
+  return hex;
+}
+}  // namespace util
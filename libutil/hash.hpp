@@ -0,0 +1,97 @@
+#ifndef LIB_UTIL_HASH_HPP_
+#define LIB_UTIL_HASH_HPP_
+
+/** @file hash.hpp
+ *  @brief Content hash helper definitions
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace util {
+/**
+ * @brief Streaming xxHash64
+ *
+ * Same digest as XXH64 of the reference implementation, bytes can be fed in
+ * chunks of any size as they become available
+ */
+class XXHash64 {
+ public:
+  /**
+   * XXHash64 constructor
+   *
+   * @param seed seed
+   */
+  explicit XXHash64(std::uint64_t seed = 0);
+
+  /**
+   * Start a new digest
+   *
+   * @param seed seed
+   */
+  void reset(std::uint64_t seed = 0);
+
+  /**
+   * Feed bytes
+   *
+   * @param data bytes
+   * @param size number of bytes
+   */
+  void update(const void* data, std::size_t size);
+
+  /**
+   * Get digest of the bytes fed so far
+   *
+   * @return digest
+   */
+  std::uint64_t digest() const;
+
+  /**
+   * Hash a buffer at once
+   *
+   * @param data bytes
+   * @param size number of bytes
+   * @param seed seed
+   *
+   * @return digest
+   */
+  static std::uint64_t hash(const void*   data,
+                            std::size_t   size,
+                            std::uint64_t seed = 0);
+
+ private:
+  /**
+   * Accumulators
+   */
+  std::array<std::uint64_t, 4> state_;
+  /**
+   * Bytes not consumed yet, less than a stripe
+   */
+  std::array<std::uint8_t, 32> buffer_;
+  /**
+   * Number of bytes in buffer
+   */
+  std::size_t buffered_;
+  /**
+   * Number of bytes fed
+   */
+  std::uint64_t length_;
+  /**
+   * Seed
+   */
+  std::uint64_t seed_;
+};
+
+/**
+ * Format digest as fixed width lowercase hexadecimal
+ *
+ * @param digest digest
+ *
+ * @return 16 characters
+ */
+std::string to_hex(std::uint64_t digest);
+}  // namespace util
+
+#endif  // LIB_UTIL_HASH_HPP_
@@ -63,6 +63,14 @@ time_unit micros() {
   return static_cast<time_unit>(us);
 }
 
+time_unit monotonic_micros() {
+  uint64_t us = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+  return static_cast<time_unit>(us);
+}
+
 template <>
 void sleep_for<time_units::micros>(time_unit time) {
   std::this_thread::sleep_for(std::chrono::microseconds(time));
@@ -53,6 +53,16 @@ time_unit micros(void);
  */
 time_unit nanos(void);
 
+/**
+ * @brief Get monotonic time stamp in microseconds.
+ *
+ * Unlike micros(), it is not affected by wall clock adjustments so it is
+ * suitable to order and compare events (e.g. frame and trigger time)
+ *
+ * @return monotonic time stamp in microseconds
+ */
+time_unit monotonic_micros(void);
+
 /**
  * @brief Sleep for relative time from now
  *
@@ -28,6 +28,7 @@
 #include "bit.hpp"
 #include "boolean.hpp"
 #include "filesystem.hpp"
+#include "hash.hpp"
 #include "macros.hpp"
 #include "pair.hpp"
 #include "timer.hpp"